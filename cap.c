@@ -0,0 +1,156 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "cap.h"
+#include "dsp.h"
+
+volatile cap_t cap;
+
+/*
+ * single producer, pump(), single consumer, SOF; indices
+ * are free running, each written by its own side only
+ */
+static cap_frame_t ring[CAP_SIZE];
+static volatile uint16_t head, tail;
+
+/*
+ * decimator state, dsp side
+ */
+static struct {
+	float l;
+	float r;
+	int32_t dl;
+	int32_t dr;
+	unsigned n;
+} acc;
+
+/*
+ * packet pacing, usb side: 1/1000 frames carried over,
+ * nothing's sent till ring is half full
+ */
+static struct {
+	uint32_t frac;
+	bool filled;
+} pace;
+
+void cap_start(bool on)
+{
+	cap.on = false;
+	head = tail = 0;
+	bzero(&acc, sizeof(acc));
+	bzero(&pace, sizeof(pace));
+	cap.on = on;
+}
+
+void cap_set_tap(cap_tap tap)
+{
+	if (tap >= CAP_TAP_NUM)
+		return;
+	cap.tap = tap;
+	bzero(&acc, sizeof(acc));
+}
+
+/*
+ * new stream, dsp side: decimation may have changed
+ */
+void cap_reset(void)
+{
+	bzero(&acc, sizeof(acc));
+}
+
+static void push(int32_t l, int32_t r)
+{
+	uint16_t h = head;
+
+	if ((uint16_t)(h - tail) >= CAP_SIZE) {
+		cap.overrun++;
+		return;
+	}
+
+	ring[h % CAP_SIZE].l = __ssat(l, 16);
+	ring[h % CAP_SIZE].r = __ssat(r, 16);
+	head = h + 1;
+}
+
+/*
+ * input rate frames, past filter()
+ */
+void cap_filter(const frame_t *src, unsigned nframes, bool dr)
+{
+	unsigned decim = CAP_DECIM << dr;
+	float k = 32768.0f / decim;
+
+	while (nframes--) {
+		acc.l += src->l;
+		acc.r += src->r;
+		src++;
+		if (++acc.n == decim) {
+			push(acc.l * k, acc.r * k);
+			acc.l = acc.r = 0.0f;
+			acc.n = 0;
+		}
+	}
+}
+
+/*
+ * noise shaper output, l/r/c duty bytes; span is output
+ * frames per capture frame
+ */
+void cap_duty(const uint8_t *src, unsigned nframes, unsigned span)
+{
+	const int32_t qf = 1 << (PWM_WIDTH - 1);
+
+	while (nframes--) {
+		acc.dl += src[0] - qf;
+		acc.dr += src[1] - qf;
+		src += NCHANNELS;
+		if (++acc.n == span) {
+			push(acc.dl * (32768 / qf) / (int32_t)span,
+			     acc.dr * (32768 / qf) / (int32_t)span);
+			acc.dl = acc.dr = 0;
+			acc.n = 0;
+		}
+	}
+}
+
+/*
+ * next packet, once a ms: nominal frames, one more or less as
+ * ring fill strays from half, which tracks device clock
+ */
+uint16_t cap_packet(cap_frame_t *dst, sample_rate rate)
+{
+	uint16_t t = tail, fill = head - t, n;
+
+	pace.frac += rate / (CAP_DECIM << (rate > SAMPLE_RATE_48000));
+	n = pace.frac / 1000;
+	pace.frac %= 1000;
+
+	if (!pace.filled) {
+		if (fill < CAP_SIZE / 2)
+			return 0;
+		pace.filled = true;
+	}
+
+	if (fill > CAP_SIZE / 2 + CAP_PACKET_FRAMES)
+		n++;
+	else if (fill < CAP_SIZE / 2 - CAP_PACKET_FRAMES && n)
+		n--;
+	n = MIN(n, CAP_PACKET_FRAMES);
+
+	if (n > fill) {			/* ran dry, fill up again */
+		cap.underrun++;
+		pace.filled = false;
+		n = fill;
+	}
+
+	for (unsigned i = 0; i < n; i++)
+		dst[i] = ring[(t + i) % CAP_SIZE];
+	tail = t + n;
+
+	return n;
+}
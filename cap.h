@@ -0,0 +1,49 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * loopback capture: decimated copy of what's played goes back to
+ * host over iso IN, as UAC capture of 16 bit stereo at playback rate
+ * over CAP_DECIM (doubled at 88.2/96k), i.e. 14.7 or 16k. Tap is
+ * either l/r past filter(), boost crossover included, averaged over
+ * CAP_DECIM input frames, or noise shaper output, pwm duty averaged
+ * over same span of output frames, so quantisation and clipping
+ * show. pump() fills SPSC ring at dsp priority, SOF drains it
+ */
+#define CAP_DECIM	3
+#define CAP_SHIFT	7		/* ring, 2^N frames */
+#define CAP_SIZE	(1 << CAP_SHIFT)
+
+/*
+ * nominal frames per ms, plus one to track device clock
+ */
+#define CAP_PACKET_FRAMES	(SAMPLE_RATE_48000 / CAP_DECIM / 1000 + 1)
+
+typedef enum {
+	CAP_TAP_FILTER,
+	CAP_TAP_NS,
+	CAP_TAP_NUM
+} cap_tap;
+
+typedef struct {
+	int16_t l;
+	int16_t r;
+} cap_frame_t;
+
+typedef struct {
+	bool on;
+	cap_tap tap;
+	uint32_t overrun;	/* frames dropped on full ring */
+	uint32_t underrun;	/* packets sent short */
+} cap_t;
+
+extern volatile cap_t cap;
+
+void cap_start(bool on);
+void cap_set_tap(cap_tap tap);
+void cap_reset(void);
+void cap_filter(const frame_t *src, unsigned nframes, bool dr);
+void cap_duty(const uint8_t *src, unsigned nframes, unsigned span);
+uint16_t cap_packet(cap_frame_t *dst, sample_rate rate);
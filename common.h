@@ -8,33 +8,97 @@
 #include "debug.h"
 
 /*
- * guard against unsupported mcu family
+ * guard against unsupported mcu family;
+ * HOST builds dsp core natively, see mk/host,
+ * EMU for an emulated cortex-m4, see mk/emu
  */
-#if !defined(AT32F40X)
+#if !defined(AT32F40X) && !defined(HOST) && !defined(EMU)
 #error "unsupported MCU family"
 #endif
 
+/*
+ * hot path placement: dsp kernels and isrs run from sram, tables
+ * they read are kept there too; both are copied out of flash at
+ * startup along with .data. Checked post link, see mk/ram
+ */
+#if defined(HOST) || defined(EMU)
+#define __fastcode
+#define __fastdata
+#define __fastentry
+#else
+#define __fastcode	__attribute__((section(".ramtext")))
+#define __fastdata	__attribute__((section(".data.fast")))
+/* checked by name, so kept out of line even with a single caller */
+#define __fastentry	__fastcode __attribute__((noinline))
+#endif
+
 /*
  * number of audio frames after upsampling, must be 2^(4+N)
  */
+#ifdef LOWLATENCY
+#define NFRAMES		(1 << 8)
+#else
 #define NFRAMES		(1 << 9)
+#endif
+
+/*
+ * pwm dma buffer pages, NFRAMES each; pages are rendered in
+ * (1 << BLOCK_SHIFT) blocks of BFRAMES, at most BLOCKS_AHEAD
+ * of the one being played: more is more latency, but also
+ * more slack for pump() running late.
+ * CHASE renders small blocks just ahead of dma read position
+ */
+#define NPAGES		4
+#ifdef CHASE
+#define BLOCK_SHIFT	2
+#define BLOCKS_AHEAD	2
+#else
+#define BLOCK_SHIFT	0
+#define BLOCKS_AHEAD	(NPAGES - 1)
+#endif
+#define BFRAMES		(NFRAMES >> BLOCK_SHIFT)
+#define NBLOCKS		(NPAGES << BLOCK_SHIFT)
+
+#if BLOCKS_AHEAD >= NBLOCKS
+#error BLOCKS_AHEAD must be less than NBLOCKS
+#endif
+#if BFRAMES < (1 << 4)
+#error BFRAMES must be 2^(4+N)
+#endif
 
 /*
- * pwm width
+ * pwm width; it and noise shaper order can be given on command
+ * line, for tools/explore.py
  */
+#ifndef PWM_WIDTH
 #define PWM_WIDTH 	7
+#endif
 #define PWM_PERIOD	(1 << PWM_WIDTH)
 #define PWM_PRESCALER	5
 
+#if PWM_WIDTH > 8
+#error PWM_WIDTH must fit byte-wide dma buffers
+#endif
+
 /*
  * noise shaper order
  */
+#ifndef NS_ORDER
 #define NS_ORDER	4
+#endif
+
+#if NS_ORDER < 3 || NS_ORDER > 5
+#error NS_ORDER must be 3, 4 or 5
+#endif
 
 /*
  * circular buffer size, must be 2^N
  */
+#ifdef LOWLATENCY
+#define RINGBUF_SHIFT	11
+#else
 #define RINGBUF_SHIFT	12
+#endif
 #define RBSIZE		(1 << RINGBUF_SHIFT)
 
 /*
@@ -42,8 +106,7 @@
  * frames # per 1ms in Q10.14 format
  */
 #define FEEDBACK_SHIFT	14
-#define FEEDBACK	(48 << FEEDBACK_SHIFT)
-#define FEEDBACK_MIN	(42 << FEEDBACK_SHIFT)
+#define FEEDBACK(rate)	(((uint32_t)(rate) << FEEDBACK_SHIFT) / 1000)
 
 /*
  * how often we'll send it
@@ -51,17 +114,18 @@
 #define SOF_SHIFT	4
 
 /*
- * how feedback value relates to circular buffer position:
- * delta in 0 .. (RBSIZE << SOF_SHIFT) to +- 1/8 FEEDBACK =>
- * +- (6 << FEEDBACK_SHIFT) / (1 << (RINGBUF_SHIFT + SOF_SHIFT) =>
- * 0 .. 3 * (1 << (FEEDBACK_SHIFT + 2 - RINGBUF_SHIFT - SOF_SHIFT)) =>
- * > (1 << (FEEDBACK_SHIFT + 3 - SOF_SHIFT - RINGBUF_SHIFT))
+ * feedback is device rate, as measured by pwm dma progress between
+ * updates and EWMA-filtered by 1/(1 << FB_METER_SHIFT), plus slow
+ * PI trim on ring fill error in 1/16 frames, once per
+ * (1 << SOF_SHIFT) ms:
+ * Kp = 1/1024 frames per ms per frame of error,
+ * Ki = Kp^2 / 8, i.e. slightly overdamped;
+ * output is clamped to nominal +- 1/8
  */
-#if (FEEDBACK_SHIFT + 3 - SOF_SHIFT) > RINGBUF_SHIFT
-#define DELTA_SHIFT(x) ((x) << (FEEDBACK_SHIFT + 3 - SOF_SHIFT - RINGBUF_SHIFT))
-#else
-#define DELTA_SHIFT(x) ((x) >> (RINGBUF_SHIFT + SOF_SHIFT - 3 - FEEDBACK_SHIFT))
-#endif
+#define FB_METER_SHIFT	3
+#define FB_KP_SHIFT	0
+#define FB_KI_SHIFT	9
+#define FB_RANGE_SHIFT	3
 
 /*
  * audio frame
@@ -74,14 +138,6 @@ typedef struct {
 
 #define NCHANNELS       (sizeof(frame_t)/sizeof(float))
 
-/*
- * double buffered dma halves
- */
-typedef enum {
-	BUSY_PAGE,
-	FREE_PAGE
-} page_t;
-
 /*
  * sync'd with usb descriptor alt settings order
  */
@@ -90,7 +146,9 @@ typedef enum {
 	SAMPLE_FORMAT_S16,
 	SAMPLE_FORMAT_S24,
 	SAMPLE_FORMAT_S32,
-	SAMPLE_FORMAT_F32
+	SAMPLE_FORMAT_F32,
+	SAMPLE_FORMAT_S16_LFE,		/* 2.1, lfe from host */
+	SAMPLE_FORMAT_S24_LFE
 } sample_fmt;
 
 typedef enum {
@@ -101,25 +159,42 @@ typedef enum {
 	SAMPLE_RATE_96000 = 96000
 } sample_rate;
 
+/*
+ * input channels: l, r and, for 2.1 formats, c
+ */
+static inline uint16_t nchannels(sample_fmt fmt)
+{
+	return fmt >= SAMPLE_FORMAT_S16_LFE ? 3 : 2;
+}
+
 /*
  * input frame size, bytes
  */
 static inline uint16_t framesize(sample_fmt fmt)
 {
-	return (const uint16_t []) {
-		2 * 2,	/* SAMPLE_FORMAT_NONE */
-		2 * 2,	/* SAMPLE_FORMAT_S16 */
-		2 * 3,	/* SAMPLE_FORMAT_S24 */
-		2 * 4,	/* SAMPLE_FORMAT_S32 */
-		2 * 4	/* SAMPLE_FORMAT_F32 */
+	return nchannels(fmt) * (const uint16_t []) {
+		2,	/* SAMPLE_FORMAT_NONE */
+		2,	/* SAMPLE_FORMAT_S16 */
+		3,	/* SAMPLE_FORMAT_S24 */
+		4,	/* SAMPLE_FORMAT_S32 */
+		4,	/* SAMPLE_FORMAT_F32 */
+		2,	/* SAMPLE_FORMAT_S16_LFE */
+		3	/* SAMPLE_FORMAT_S24_LFE */
 	} [fmt];
 }
 
+/*
+ * double rate ones, 88.2 and 96k
+ */
+static inline bool doubleratep(sample_rate rate)
+{
+	return rate == SAMPLE_RATE_88200 || rate == SAMPLE_RATE_96000;
+}
+
 /*
  *
  */
 typedef struct {
-	bool seen;
 	enum {
 		STATE_CLOSED,
 		STATE_FILL,
@@ -139,8 +214,42 @@ typedef struct {
 	sample_rate rate;
 	float rms[2];
 	float peak[2];
+	float load;		/* cpu, not idle share */
 } cs_t;
 
+/*
+ * interrupt priorities, upper 4 bits significant, lower is more urgent:
+ * - pwm dma and usb share the top level: both are short, and both
+ *   post to the event queue, which wants a single producer priority;
+ * - dsp runs off PendSV, pended by both, and consumes events;
+ * - display refresh, buttons and encoder go last.
+ * So dsp is delayed by at most one usb and one dma isr run,
+ * and display never delays either.
+ */
+#define IRQ_PRIO_PWM	(0 << 4)
+#define IRQ_PRIO_USB	(0 << 4)
+#define IRQ_PRIO_DSP	(1 << 4)
+#define IRQ_PRIO_DISP	(2 << 4)
+
+typedef enum { IRQ_PWM, IRQ_USB, IRQ_DSP, IRQ_DISP, IRQ_NUM } irq_src;
+
+/*
+ * runtime counters
+ */
+typedef struct {
+	uint32_t late;		/* pwm blocks played before rendered */
+	uint32_t underrun;	/* pwm blocks concealed */
+	uint32_t overrun;	/* packets dropped on full ring */
+	uint32_t partial;	/* packets with incomplete frame dropped */
+	uint32_t missed;	/* events lost, or serviced past deadline */
+	uint32_t evlate;	/* worst event service latency, frames */
+	uint32_t clip[NCHANNELS]; /* noise shaper saturations, l/r/c */
+	uint32_t opens;		/* streams opened */
+	uint32_t bypassed;	/* blocks conv bypassed on overload */
+	uint32_t irqlat[IRQ_NUM]; /* worst isr entry latency, cycles */
+	uint32_t irqrun[IRQ_NUM]; /* worst isr run time, cycles */
+} stats_t;
+
 /*
  * UAC Ids
  */
@@ -149,7 +258,12 @@ typedef enum {
 	UAC_FU_MAIN_ID,
 	UAC_FU_SPEAKER_ID,
 	UAC_OT_HEADSET_ID,
-	UAC_OT_SPEAKER_ID
+	UAC_OT_SPEAKER_ID,
+	UAC_IT_CAPTURE_ID,		/* loopback, see cap.h */
+	UAC_OT_CAPTURE_ID,
+	UAC_IT_PCM21_ID,		/* 2.1 alt settings */
+	UAC_FU_MAIN21_ID,
+	UAC_OT_SPEAKER21_ID
 } uac_id_t;
 /*
  *
@@ -0,0 +1,263 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "conv.h"
+#include "prof.h"
+#include "tables.h"
+
+volatile conv_t conv;
+
+extern volatile cs_t cstate;
+extern volatile stats_t stats;
+
+/*
+ * taps as uploaded, l and r, then banks of them as dsp has them,
+ * reversed, so output frame i is dot product of taps and history
+ * from frame i on; bank in use is dsp's, spare one usb's
+ */
+static float staging[2][CONV_MAXTAPS];
+static float ir[2][2][CONV_MAXTAPS];
+static unsigned bank;
+static volatile uint16_t staged;
+
+/*
+ * conv's cost per block when pump() went over, what it'd add back
+ */
+static uint32_t tripped;
+
+/*
+ * CONV_MAXTAPS - 1 input frames of history, whatever ntaps is, so
+ * banks swap seamlessly, then block being filtered
+ */
+#define NFRAMES_MAX	(BFRAMES >> UPSAMPLE_SHIFT_DR)
+#define HISTORY		(CONV_MAXTAPS - 1)
+
+static float hist[2][HISTORY + NFRAMES_MAX];
+
+#define PHASELEN	(NUMTAPS_SR >> UPSAMPLE_SHIFT_SR)
+
+/*
+ * n taps from offset on, for channel ch; taps as they come over
+ * usb, little endian floats, not necessarily aligned
+ */
+bool conv_load(unsigned ch, unsigned offset, const void *taps, unsigned n)
+{
+	if (ch > 1 || offset + n > CONV_MAXTAPS)
+		return false;
+
+	memcpy(&staging[ch][offset], taps, n * sizeof(float));
+	return true;
+}
+
+/*
+ * block period in prof_time() units: cpu cycles on target, where
+ * pwm frame is PWM_PERIOD * PWM_PRESCALER of them at either pll
+ * setting, and in simulator; nanoseconds in host builds
+ */
+static float period(sample_rate rate)
+{
+#if defined(HOST) && !defined(SIM)
+	unsigned shift = rate > SAMPLE_RATE_48000 ?
+		UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+
+	return 1e9f * BFRAMES / ((uint32_t)rate << shift);
+#else
+	(void)rate;
+	return BFRAMES * PWM_PERIOD * PWM_PRESCALER;
+#endif
+}
+
+/*
+ * taps pump() has room for at rate: what it takes without conv,
+ * and conv's cost per tap, both as measured, or as it was when
+ * bypassed on overload; till conv has run, that's estimated off
+ * upsample(), whose MACs per block are known
+ */
+uint16_t conv_budget(sample_rate rate)
+{
+	bool dr = rate > SAMPLE_RATE_48000;
+	unsigned nframes = BFRAMES >> (dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR);
+	bool running = conv.ntaps && prof[PROF_CONV].n;
+	float limit = period(rate) * CONV_LOAD / 100, base, tap;
+
+#ifdef EMU
+	return CONV_MAXTAPS;		/* prof counts nothing */
+#endif
+	if (!rate || !prof[PROF_PUMP].n || !prof[PROF_UPSAMPLE].n)
+		return CONV_MAXTAPS;	/* nothing to go by yet */
+
+	base = prof[PROF_PUMP].avg;
+	if (running) {
+		base -= prof[PROF_CONV].avg;
+		tap = (float)(conv.overloaded ? tripped :
+			      prof[PROF_CONV].avg) / conv.ntaps;
+	} else {
+		tap = 2.0f * nframes * prof[PROF_UPSAMPLE].avg /
+			(BFRAMES * PHASELEN * NCHANNELS);
+	}
+
+	if (base >= limit || tap <= 0)
+		return 0;
+
+	return MIN((limit - base) / tap, CONV_MAXTAPS);
+}
+
+/*
+ * staged taps to spare bank, reversed; 0 taps bypasses conv.
+ * Refused over budget, or with last commit not picked up yet
+ */
+bool conv_commit(uint16_t ntaps, sample_rate rate)
+{
+	float (*b)[CONV_MAXTAPS];
+
+	if (conv.pending || ntaps > conv_budget(rate))
+		return false;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);	/* bank swapped */
+	b = ir[!bank];
+	for (unsigned ch = 0; ch < 2; ch++)
+		for (unsigned i = 0; i < ntaps; i++)
+			b[ch][i] = staging[ch][ntaps - 1 - i];
+
+	staged = ntaps;
+	__atomic_thread_fence(__ATOMIC_RELEASE);	/* taps first, then flag */
+	conv.pending = true;
+
+	return true;
+}
+
+/*
+ * new stream, no history; taps bypassed on overload are given
+ * another go, rate may well be different
+ */
+void conv_reset(void)
+{
+	bzero(hist, sizeof(hist));
+	conv.overloaded = false;
+	prof[PROF_CONV].n = 0;
+}
+
+/*
+ * kernels go at -O3 whatever the rest is built with,
+ * as in dsp.c
+ */
+#ifndef DSP_OS
+#pragma GCC push_options
+#pragma GCC optimize 3
+#endif
+
+/*
+ * four output frames at a time, so each tap and input frame loaded
+ * does for four MACs; blocks are multiple of 4 frames at any rate
+ */
+#if (BFRAMES >> UPSAMPLE_SHIFT_SR) % 4 || (BFRAMES >> UPSAMPLE_SHIFT_DR) % 4
+#error block must be multiple of 4 input frames
+#endif
+
+static void __fastcode fir(float *x, const float *h, unsigned ntaps,
+			   unsigned nframes, float *y, unsigned stride)
+{
+	const float *from = x + HISTORY + 1 - ntaps;
+
+	for (unsigned i = 0; i < nframes; i += 4) {
+		const float *s = from + i;
+		float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+		float x0 = s[0], x1 = s[1], x2 = s[2], x3;
+
+#pragma GCC unroll 4
+		for (unsigned k = 0; k < ntaps; k++) {
+			float c = h[k];
+
+			x3 = s[k + 3];
+			a0 += c * x0;
+			a1 += c * x1;
+			a2 += c * x2;
+			a3 += c * x3;
+			x0 = x1;
+			x1 = x2;
+			x2 = x3;
+		}
+
+		*y = a0; y += stride;
+		*y = a1; y += stride;
+		*y = a2; y += stride;
+		*y = a3; y += stride;
+	}
+
+	memmove(x, x + nframes, HISTORY * sizeof(float));
+}
+
+/*
+ * pump() over CONV_LOAD bypasses conv; once pump() without it, plus
+ * what conv took when it went over, is under CONV_RESUME, it's back.
+ * Either way conv's own figures start over, as they're off by then
+ */
+static void __fastcode overload(void)
+{
+	float pct = period(cstate.rate) / 100;
+	float pump = prof[PROF_PUMP].avg;
+
+	if (!prof[PROF_PUMP].n)
+		return;
+
+	if (!conv.overloaded && pump > pct * CONV_LOAD) {
+		tripped = prof[PROF_CONV].avg;
+		conv.overloaded = true;
+		conv.overload++;
+	} else if (conv.overloaded && prof[PROF_CONV].n &&
+		   pump - prof[PROF_CONV].avg + tripped < pct * CONV_RESUME) {
+		conv.overloaded = false;
+	} else {
+		return;
+	}
+
+	prof[PROF_CONV].n = 0;
+}
+
+/*
+ * at block start: bank committed since is picked up, then l/r go
+ * through history; bypassed, history still goes on
+ */
+void __fastentry conv_run(frame_t *frame, unsigned nframes)
+{
+	if (conv.pending) {
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		bank = !bank;
+		conv.ntaps = staged;
+		conv.overloaded = false;
+		prof[PROF_CONV].n = 0;	/* cost per tap changed */
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		conv.pending = false;
+	}
+
+	for (unsigned i = 0; i < nframes; i++) {
+		hist[0][HISTORY + i] = frame[i].l;
+		hist[1][HISTORY + i] = frame[i].r;
+	}
+
+	if (conv.ntaps) {
+		overload();
+		if (conv.overloaded)
+			stats.bypassed++;
+	}
+
+	if (!conv.ntaps || conv.overloaded) {
+		memmove(hist[0], hist[0] + nframes, HISTORY * sizeof(float));
+		memmove(hist[1], hist[1] + nframes, HISTORY * sizeof(float));
+		return;
+	}
+
+	fir(hist[0], ir[bank][0], conv.ntaps, nframes, &frame->l,
+	    sizeof(frame_t) / sizeof(float));
+	fir(hist[1], ir[bank][1], conv.ntaps, nframes, &frame->r,
+	    sizeof(frame_t) / sizeof(float));
+}
+
+#ifndef DSP_OS
+#pragma GCC pop_options
+#endif
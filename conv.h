@@ -0,0 +1,35 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * headphone correction: FIR on l/r at input rate, ahead of filter()
+ * and upsample(), impulse response uploaded over usb into ram.
+ * Time domain, a block at a time: at a few hundred taps it's cheaper
+ * than partitioned fft convolution, and adds no latency. Upload goes
+ * to staging taps, commit puts them in spare bank, dsp swaps banks
+ * at block start. Taps committed are capped by budget, off measured
+ * pump() cost at rate last played; running, conv is bypassed should
+ * pump() go over CONV_LOAD of block period all the same, till it'd
+ * fit CONV_RESUME with conv back in, next commit or next stream
+ */
+#define CONV_MAXTAPS	256
+#define CONV_CHUNK	16	/* taps per upload, as control buffer has room */
+#define CONV_LOAD	75	/* %, of block period pump() may take */
+#define CONV_RESUME	60	/* %, it has to be under for conv to resume */
+
+typedef struct {
+	uint16_t ntaps;		/* committed, 0 bypassed */
+	bool pending;		/* committed, not picked up yet */
+	bool overloaded;	/* bypassed for now, pump() went over */
+	uint32_t overload;	/* times bypassed for pump() going over */
+} conv_t;
+
+extern volatile conv_t conv;
+
+bool conv_load(unsigned ch, unsigned offset, const void *taps, unsigned n);
+bool conv_commit(uint16_t ntaps, sample_rate rate);
+uint16_t conv_budget(sample_rate rate);
+void conv_reset(void);
+void conv_run(frame_t *frame, unsigned nframes);
@@ -0,0 +1,143 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#if defined(HOST) && !defined(SIM)
+#include <signal.h>
+#include <stddef.h>
+#elif !defined(EMU)
+#include <libopencm3/cm3/cortex.h>
+#endif
+
+#include "common.h"
+#include "ctl.h"
+
+ctl_t ctl;
+
+extern volatile cs_t cstate;
+
+/*
+ * published copy and its sequence count, writers' side
+ */
+static volatile struct {
+	uint32_t seq;
+	ctl_t c;
+} box;
+
+static uint32_t taken;		/* seq of dsp's copy */
+
+/*
+ * resets asked for and carried out, free running; request
+ * seq is usb's to bump, done dsp's
+ */
+static volatile struct {
+	uint16_t seq;
+	uint16_t done;
+	sample_fmt fmt;
+	bool dr;
+} req;
+
+/*
+ * writers kept apart, interrupts masked; host tools' interrupts
+ * are signals, kernels under emulator have none
+ */
+#if defined(HOST) && !defined(SIM)
+#define LOCK()		sigset_t all, mask;			\
+			sigfillset(&all);			\
+			sigprocmask(SIG_BLOCK, &all, &mask)
+#define UNLOCK()	sigprocmask(SIG_SETMASK, &mask, NULL)
+#elif defined(EMU)
+#define LOCK()
+#define UNLOCK()
+#else
+#define LOCK()		uint32_t mask = cm_mask_interrupts(1)
+#define UNLOCK()	cm_mask_interrupts(mask)
+#endif
+
+void ctl_publish(void)
+{
+	LOCK();
+
+	box.seq++;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	box.c.attn = cstate.attn;
+	box.c.muted = cstate.on[muted];
+	box.c.boost = cstate.on[boost];
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	box.seq++;
+
+	UNLOCK();
+}
+
+/*
+ * dsp, at block start: true if there's a newer copy, and
+ * it's been taken
+ */
+bool __fastcode ctl_take(void)
+{
+	for (unsigned i = 0; i < CTL_RETRIES; i++) {
+		uint32_t seq = box.seq;
+		ctl_t c;
+
+		if (seq == taken)
+			return false;
+		if (seq & 1)
+			continue;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		c.attn = box.c.attn;
+		c.muted = box.c.muted;
+		c.boost = box.c.boost;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (box.seq != seq)
+			continue;
+
+		ctl = c;
+		taken = seq;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * usb: one asked for while another's pending replaces it
+ */
+void ctl_reset(sample_fmt fmt, bool dr)
+{
+	req.fmt = fmt;
+	req.dr = dr;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	req.seq++;
+}
+
+bool ctl_pending(void)
+{
+	bool pending = req.seq != req.done;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return pending;
+}
+
+/*
+ * dsp: seq is read first, so should usb ask again while
+ * this one's carried out, it's still pending after
+ */
+bool __fastcode ctl_due(ctl_req_t *r)
+{
+	if ((r->seq = req.seq) == req.done)
+		return false;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	r->fmt = req.fmt;
+	r->dr = req.dr;
+	return true;
+}
+
+void ctl_done(const ctl_req_t *r)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	req.done = r->seq;
+}
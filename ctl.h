@@ -0,0 +1,38 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * control state as dsp sees it. Writers, usb control requests,
+ * encoder and buttons, startup, change cstate, then ctl_publish()
+ * copies what dsp goes by into mailbox under a sequence count, odd
+ * while copying; writers run at different priorities, so that's done
+ * with interrupts masked. At block start dsp takes a copy, retrying
+ * should a writer get in meanwhile, keeping one it has should that
+ * go on: it never waits on anyone. Ring and format resets are
+ * deferred alike: usb, which owns ring head, asks for one with
+ * ctl_reset(), and drops packets till dsp has carried it out
+ */
+#define CTL_RETRIES	4
+
+typedef struct {
+	uint16_t attn;
+	bool muted;
+	bool boost;
+} ctl_t;
+
+typedef struct {
+	sample_fmt fmt;
+	bool dr;
+	uint16_t seq;
+} ctl_req_t;
+
+extern ctl_t ctl;		/* dsp's, as of block start */
+
+void ctl_publish(void);
+void ctl_reset(sample_fmt fmt, bool dr);
+bool ctl_pending(void);
+bool ctl_take(void);
+bool ctl_due(ctl_req_t *req);
+void ctl_done(const ctl_req_t *req);
@@ -0,0 +1,146 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include <stdarg.h>
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/itm.h>
+
+#include "common.h"
+
+/*
+ * multi producer ring: any isr claims a slot with CAS on head,
+ * fills it and commits by setting seq; single consumer, main loop,
+ * takes committed slots in order. Producers never wait, on full
+ * ring record is dropped and counted, drop count goes out with
+ * next record drained.
+ *
+ * On the wire, ITM port DBG_ITM_PORT, 32 bit words:
+ * DBG_SYNC << 24 | nargs << 16 | seq, stamp (cycles),
+ * format string address or trace port, function name address,
+ * nargs arguments. Dropped count is sent as a record with port 0.
+ */
+#define DBG_SHIFT	6
+#define DBG_SIZE	(1 << DBG_SHIFT)
+#define DBG_SYNC	0xdb
+#define DBG_ITM_PORT	1
+
+typedef struct {
+	volatile uint32_t seq;		/* claim # + 1 once written */
+	uint32_t stamp;
+	const char *fmt;
+	const char *func;
+	uint32_t n;
+	uint32_t arg[DBG_NARGS];
+} dbg_rec_t;
+
+static dbg_rec_t ring[DBG_SIZE];
+static volatile uint32_t head, tail, dropped;
+
+static dbg_rec_t *dbg_claim(uint32_t *seq)
+{
+	uint32_t h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+
+	do {
+		if (h - tail >= DBG_SIZE) {
+			__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+			return NULL;
+		}
+	} while (!__atomic_compare_exchange_n(&head, &h, h + 1, true,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+	*seq = h + 1;
+	return &ring[h & (DBG_SIZE - 1)];
+}
+
+static inline void dbg_commit(dbg_rec_t *r, uint32_t seq)
+{
+	__atomic_store_n(&r->seq, seq, __ATOMIC_RELEASE);
+}
+
+void dbg_trace(uint32_t port, uint32_t val)
+{
+	uint32_t seq;
+	dbg_rec_t *r = dbg_claim(&seq);
+
+	if (!r) return;
+
+	r->stamp = DWT_CYCCNT;
+	r->fmt = (const char *)port;
+	r->func = NULL;
+	r->n = 1;
+	r->arg[0] = val;
+	dbg_commit(r, seq);
+}
+
+void dbg_log(const char *fmt, const char *func, unsigned n, ...)
+{
+	uint32_t seq;
+	dbg_rec_t *r = dbg_claim(&seq);
+	va_list ap;
+
+	if (!r) return;
+
+	r->stamp = DWT_CYCCNT;
+	r->fmt = fmt;
+	r->func = func;
+	r->n = MIN(n, DBG_NARGS);
+	va_start(ap, n);
+	for (unsigned i = 0; i < r->n; i++)
+		r->arg[i] = va_arg(ap, uint32_t);
+	va_end(ap);
+	dbg_commit(r, seq);
+}
+
+#ifdef HOST
+void itm_send(uint32_t val);
+#else
+static void itm_send(uint32_t val)
+{
+	while (!(ITM_STIM32(DBG_ITM_PORT) & ITM_STIM_FIFOREADY));
+	ITM_STIM32(DBG_ITM_PORT) = val;
+}
+#endif
+
+static void dbg_send(uint32_t seq, uint32_t stamp, const char *fmt,
+		     const char *func, uint32_t n, const uint32_t *arg)
+{
+	itm_send(DBG_SYNC << 24 | n << 16 | (seq & 0xffff));
+	itm_send(stamp);
+	itm_send((uint32_t)fmt);
+	itm_send((uint32_t)func);
+	while (n--)
+		itm_send(*arg++);
+}
+
+/*
+ * main loop only; stops at a claimed but not yet committed slot,
+ * which can't really happen, as every producer preempts us
+ */
+void dbg_drain(void)
+{
+	static uint32_t lost;
+	uint32_t t = tail, d;
+	dbg_rec_t *r;
+
+	if (!(ITM_TER[0] & (1 << DBG_ITM_PORT))) {	/* nobody listens */
+		tail = head;
+		return;
+	}
+
+	if ((d = dropped) != lost) {
+		dbg_send(0, DWT_CYCCNT, NULL, NULL, 1, (uint32_t []){ d - lost });
+		lost = d;
+	}
+
+	while (t != head) {
+		r = &ring[t & (DBG_SIZE - 1)];
+		if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != t + 1)
+			break;
+		dbg_send(r->seq, r->stamp, r->fmt, r->func, r->n, r->arg);
+		r->seq = 0;
+		__atomic_store_n(&tail, ++t, __ATOMIC_RELEASE);
+	}
+}
@@ -5,27 +5,32 @@
 
 #ifdef DEBUG
 
-#include <inttypes.h>
-#include <stdio.h>
+#include <stdint.h>
 
-#include "trace.h"
+/*
+ * binary log: isrs only put records in a ring, format strings
+ * go by address, to be looked up in the elf by tools/dbgdecode.py;
+ * main loop drains it to ITM when idle. At most DBG_NARGS
+ * integer arguments per debugf()
+ */
+#define DBG_NARGS	5
+
+#define DBG_COUNT(args...) DBG_COUNT_(0, ##args, 5, 4, 3, 2, 1, 0)
+#define DBG_COUNT_(_0, _1, _2, _3, _4, _5, n, ...) n
 
-extern volatile uint32_t systicks;
+void dbg_log(const char *fmt, const char *func, unsigned n, ...);
+void dbg_trace(uint32_t port, uint32_t val);
+void dbg_drain(void);
 
-#define trace(port, val)                        \
-    do {                                        \
-        trace_send_blocking32(port, systicks);  \
-        trace_send_blocking32(port, val);       \
-    } while(0)
+#define trace(port, val) dbg_trace(port, val)
 
-#define debugf(fmt, args...)                                            \
-    do {                                                                \
-        printf("[%08lx] %s(): " fmt, systicks, __func__, ##args);       \
-    } while (0)
+#define debugf(fmt, args...) \
+	dbg_log(fmt, __func__, DBG_COUNT(args), ##args)
 
 #else
 
 #define trace(port, val)
 #define debugf(fmt, args...)
+#define dbg_drain()
 
 #endif
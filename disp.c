@@ -12,30 +12,34 @@
 
 #include <string.h>
 #include "common.h"
-#include "icons.h"
+#include "ctl.h"
+#include "irq.h"
+#include "lat.h"
+#include "screen.h"
 #include "tables.h"
-#include "font.h"
 
 extern volatile ev_t e;
 extern volatile cs_t cstate;
 
 extern void speaker();
-extern void set_scale();
 extern void uac_notify(uint8_t);
 
-#define DISP_X		128
-#define DISP_Y		64
-#define DISP_PAGE_NUM	(DISP_Y / 8)
-#define DISP_PAGE_SIZE	(DISP_X)
-#define SICONSZ		24	/* 24x24 px */
-#define LICONSZ		40	/* 40x40 px */
-
-#define DISPNUM		2
 #define REFRESH_HZ	30
 #define REFRESH_DIV_PRE	1024
 #define REFRESH_DIV	(REFRESH_DIV_PRE * REFRESH_HZ * DISPNUM * DISP_PAGE_NUM)
 
-static uint8_t dispbuf[DISP_PAGE_SIZE] __attribute__((aligned(4)));
+/*
+ * retained screen: page is rendered and sent only when what it
+ * shows has changed, otherwise its tick is left idle. What's shown
+ * is snapshot and diffed once a refresh, at page 0 tick, rather
+ * than every tick; buttons and encoder are still polled every one
+ */
+static uint8_t fb[SCREEN_PAGES][DISP_PAGE_SIZE] __attribute__((aligned(4)));
+static volatile uint32_t dirty = (1U << SCREEN_PAGES) - 1;
+
+#if SCREEN_PAGES > 32
+#error too many pages for dirty mask
+#endif
 
 /*
  *
@@ -77,165 +81,6 @@ static void disp_select_page(uint8_t i)
 	while (SPI_SR(SPI4) & SPI_SR_BSY);
 	gpio_set(GPIOB, GPIO8);				/* D/C */
 }
-/*
- *
- */
-static const icon iconrow[] = {
-	[spmuted]	= icon_headphones_box,
-	[boost]		= icon_subwoofer,
-	[muted]		= icon_volume_mute,
-	[sine]		= icon_sine_wave,
-	[usb]		= icon_usb
-};
-
-#define NICONS (sizeof(iconrow)/sizeof(iconrow[0]))
-
-#define BAR_START	4
-#define BAR_LEN		(DISP_PAGE_SIZE - 2 * BAR_START)
-
-static unsigned f_to_barlen(float f)
-{
-	return MIN((unsigned)(BAR_LEN * f), BAR_LEN - 1);
-}
-
-static void disp_draw_bar(uint8_t *dst, uint8_t c, float f)
-{
-	unsigned len = f_to_barlen(f) / 2;
-	uint16_t *p = (uint16_t *)dst;
-	while (len--) *p++ = (uint16_t)c << 8;
-}
-
-static void disp_draw_icon(uint8_t *dst, icon ico, uint16_t page)
-{
-	const char *src = icons[ico].p + page;
-	unsigned iconsz = icons[ico].h;
-	for (unsigned i=0; i<iconsz; i++) {
-		*dst++ = *src;
-		src += iconsz / 8;
-	}
-}
-
-static void disp_draw_char(uint8_t *dst, uint16_t c, uint16_t page)
-{
-	const uint8_t *src = font_bits + font_height * c + font_width * (1 - page);
-	memcpy(dst, src, font_width);
-}
-
-static void disp_draw_string(uint8_t *dst, const char *s, uint16_t page)
-{
-	while (*s) {
-		disp_draw_char(dst, *s++, page);
-		dst += font_width;
-	}
-}
-
-static const char * const vol_strings[] = {
-	" 0 ", "-1 ", "-2 ", "-3 ", "-4 ", "-5 ", "-6 ", "-7 ",
-	"-8 ", "-9 ", "-10", "-11", "-12", "-13", "-14", "-15",
-	"-16", "-17", "-18", "-19", "-20", "-21", "-22", "-23",
-	"-24", "-25", "-26", "-27", "-28", "-29", "-30", "-31",
-	"-32", "-33", "-34", "-35", "-36", "-37", "-38", "-39",
-	"-40", "-41", "-42", "-43", "-44", "-45", "-46", "-47",
-	"-48", "-49", "-50", "-51", "-52", "-53", "-54", "-55",
-	"-56", "-57", "-58", "-59", "-60"
-};
-
-static const char * const fmt_strings[] = {
-	[SAMPLE_FORMAT_NONE]	= "-:-",
-	[SAMPLE_FORMAT_S16]	= "S16",
-	[SAMPLE_FORMAT_S24]	= "S24",
-	[SAMPLE_FORMAT_S32]	= "S32",
-	[SAMPLE_FORMAT_F32]	= "F32"
-};
-
-static const char * rate_strings(sample_rate rate)
-{
-	const struct {
-		sample_rate rate;
-		const char *s;
-	} strings[] = {
-		{ .rate = SAMPLE_RATE_44100, .s = "44k" },
-		{ .rate = SAMPLE_RATE_48000, .s = "48k" },
-		{ .rate = SAMPLE_RATE_88200, .s = "88k" },
-		{ .rate = SAMPLE_RATE_96000, .s = "96k" },
-		{ .rate = SAMPLE_RATE_NONE,  .s = "-:-" }
-	}, *rs = strings;
-
-	while (rs->rate && rs->rate != rate) rs++;
-	return rs->s;
-}
-
-static void disp_fill_page(unsigned page)
-{
-	disp_select_page(page);
-
-	bzero(dispbuf, sizeof(dispbuf));
-
-	switch (page) {
-	case 0 ... 2:
-		for (unsigned i=0; i<NICONS; i++)
-			if (cstate.on[i])
-				disp_draw_icon(dispbuf + i * (SICONSZ + 2),
-					       iconrow[i], page);
-		break;
-	case 3 ... 7:
-		disp_draw_icon(dispbuf + LICONSZ,
-			       e.state == STATE_RUNNING ? icon_play : icon_pause,
-			       page - 3);
-		if (page > 5) {
-			disp_draw_string(dispbuf + 4, "dB:", page - 6);
-			disp_draw_string(dispbuf + 100,
-					 rate_strings(cstate.rate), page - 6);
-		}
-		else if (page > 3) {
-			disp_draw_string(dispbuf + 4,
-					 vol_strings[cstate.attn], page - 4);
-			disp_draw_string(dispbuf + 100,
-					 fmt_strings[cstate.format], page - 4);
-		}
-		break;
-	case 9:
-		disp_draw_bar(dispbuf + BAR_START, 0xff, 4 * cstate.rms[1]);
-		dispbuf[BAR_START + f_to_barlen(4 * cstate.peak[1])] = 0x55;
-		break;
-	case 10:
-		disp_draw_bar(dispbuf + BAR_START, 0x7f, 4 * cstate.rms[1]);
-		dispbuf[BAR_START + f_to_barlen(4 * cstate.peak[1])] = 0x55;
-		break;
-	case 11:
-		disp_draw_bar(dispbuf + BAR_START, 0x70, scale[cstate.attn]);
-		break;
-	case 12:
-		disp_draw_bar(dispbuf + BAR_START, 0x0e, scale[cstate.attn]);
-		break;
-	case 13:
-		disp_draw_bar(dispbuf + BAR_START, 0xfe, 4 * cstate.rms[0]);
-		dispbuf[BAR_START + f_to_barlen(4 * cstate.peak[0])] = 0xaa;
-		break;
-	case 14:
-		disp_draw_bar(dispbuf + BAR_START, 0xff, 4 * cstate.rms[0]);
-		dispbuf[BAR_START + f_to_barlen(4 * cstate.peak[0])] = 0xaa;
-	default:
-		break;
-	}
-
-	switch (page) {
-	case 0:
-	case 8:
-		for (unsigned i=0; i<DISP_PAGE_SIZE; i++)
-			dispbuf[i] |= 0x01;
-		break;
-	case 7:
-	case 15:
-		for (unsigned i=0; i<DISP_PAGE_SIZE; i++)
-			dispbuf[i] |= 0x80;
-	default:
-		break;
-	}
-
-	dispbuf[0] = dispbuf[DISP_PAGE_SIZE - 1] = 0xff;
-}
-
 static volatile unsigned swapdisp;
 
 #define DBCNT 12
@@ -272,6 +117,7 @@ static void disp_poll_buttons(unsigned now)
 		if (cstate.on[spmuted] != sp) {
 			cstate.on[spmuted] = sp;
 			cstate.on[boost] = !sp;
+			ctl_publish();
 			uac_notify(UAC_FU_SPEAKER_ID);
 		}
 		speaker();
@@ -289,7 +135,7 @@ static void disp_poll_encoder(unsigned now)
 	if (attn < 0 || attn == VOLSTEPS) return;
 	cstate.attn = attn;
 	uac_notify(UAC_FU_MAIN_ID);
-	set_scale();
+	ctl_publish();
 }
 
 void dma2_channel1_isr()
@@ -299,16 +145,54 @@ void dma2_channel1_isr()
 	dma_disable_channel(DMA2, DMA_CHANNEL1);
 }
 
+static void disp_snap(screen_t *s)
+{
+	for (unsigned i = 0; i < sw_num; i++)
+		s->on[i] = cstate.on[i];
+	s->running = e.state == STATE_RUNNING;
+	s->attn = cstate.attn;
+	s->format = cstate.format;
+	s->rate = cstate.rate;
+	for (unsigned i = 0; i < 2; i++) {
+		s->rms[i] = screen_barlen(4 * cstate.rms[i]);
+		s->peak[i] = screen_barlen(4 * cstate.peak[i]);
+	}
+	s->vol = screen_barlen(scale[cstate.attn]);
+	s->load = screen_barlen(cstate.load);
+	s->lat = !lat.armed ? 0 : !lat.seq ? SCREEN_LAT_NONE :
+		MAX(lat_us(lat.peak - lat.rx, cstate.rate) / 100, 1U);
+}
+
 void tim4_isr()
 {
+	static screen_t shown;
+	uint32_t t0 = irq_enter(IRQ_DISP,
+				timer_get_counter(TIM4) * REFRESH_DIV_PRE);
+	unsigned page = timer_get_counter(TIM3);
+
 	timer_clear_flag(TIM4, TIM_SR_UIF);
 	disp_poll_buttons(gpio_get(GPIOA, GPIO2|GPIO3) >> 2);
 	disp_poll_encoder(timer_get_counter(TIM2));
-	disp_fill_page(timer_get_counter(TIM3));
-	dma_set_memory_address(DMA2, DMA_CHANNEL1, (uint32_t)dispbuf);
-	dma_set_number_of_data(DMA2, DMA_CHANNEL1, sizeof(dispbuf));
-	dma_enable_channel(DMA2, DMA_CHANNEL1);
-	spi_enable_tx_dma(SPI4);
+
+	if (page == 0) {
+		screen_t now;
+
+		disp_snap(&now);
+		dirty |= screen_dirty(&shown, &now);
+		shown = now;
+	}
+
+	if (dirty & (1U << page)) {
+		dirty &= ~(1U << page);
+		disp_select_page(page);
+		screen_page(fb[page], page, &shown);
+		dma_set_memory_address(DMA2, DMA_CHANNEL1, (uint32_t)fb[page]);
+		dma_set_number_of_data(DMA2, DMA_CHANNEL1, DISP_PAGE_SIZE);
+		dma_enable_channel(DMA2, DMA_CHANNEL1);
+		spi_enable_tx_dma(SPI4);
+	}
+
+	irq_exit(IRQ_DISP, t0);
 }
 
 void tim3_isr()
@@ -317,6 +201,7 @@ void tim3_isr()
 	if (swapdisp) {
 		swapdisp = 0;
 		TIM_CCER(TIM3) ^= TIM_CCER_CC1P | TIM_CCER_CC2P;
+		dirty = (1U << SCREEN_PAGES) - 1;
 	}
 }
 
@@ -347,8 +232,10 @@ void disp()
 	dma_set_read_from_memory(DMA2, DMA_CHANNEL1);
 	dma_set_peripheral_address(DMA2, DMA_CHANNEL1, (uint32_t)&SPI_DR(SPI4));
 	dma_enable_transfer_complete_interrupt(DMA2, DMA_CHANNEL1);
+	nvic_set_priority(NVIC_DMA2_CHANNEL1_IRQ, IRQ_PRIO_DISP);
 	nvic_enable_irq(NVIC_DMA2_CHANNEL1_IRQ);
 
+	nvic_set_priority(NVIC_TIM4_IRQ, IRQ_PRIO_DISP);
 	nvic_enable_irq(NVIC_TIM4_IRQ);
 	timer_enable_irq(TIM4, TIM_DIER_UIE);
 	timer_set_prescaler(TIM4, REFRESH_DIV_PRE - 1);
@@ -359,6 +246,7 @@ void disp()
 	timer_enable_oc_output(TIM4, TIM_OC1);
 	timer_enable_preload(TIM4);
 
+	nvic_set_priority(NVIC_TIM3_IRQ, IRQ_PRIO_DISP);
 	nvic_enable_irq(NVIC_TIM3_IRQ);
 	timer_enable_irq(TIM3, TIM_DIER_UIE);
 	timer_slave_set_mode(TIM3, TIM_SMCR_SMS_ECM1);
@@ -9,16 +9,29 @@
 #include <string.h>
 
 #include "common.h"
+#include "cap.h"
+#include "conv.h"
+#include "ctl.h"
 #include "dsp.h"
+#include "lat.h"
+#include "prof.h"
 #include "tables.h"
 
 extern volatile cs_t cstate;
+extern volatile stats_t stats;
+extern uint32_t pwm_position(void);
 
 /*
  *
  */
-static frame_t framebuf[NFRAMES];
-static uint8_t ringbuf[RBSIZE + 4] __attribute__((aligned(4)));
+static frame_t framebuf[BFRAMES];
+
+/*
+ * frame wrapping ring end is reframed in place, with ring head
+ * copied past the end: RBPAD covers largest frame less a byte
+ */
+#define RBPAD	8
+static uint8_t ringbuf[RBSIZE + RBPAD] __attribute__((aligned(4)));
 
 typedef union {
 	struct {
@@ -56,41 +69,91 @@ static inline uint16_t rb_space_to_end(rb_t r)
 
 static struct {
 	bool doublerate;
+	bool lfe;			/* c supplied by host */
 	sample_fmt fmt;
 	uint16_t nframes;
 	uint16_t framesize;
 	uint16_t chunksize;
 	float scale;
 	const float *taps;
+	uint8_t mark[8];		/* latency marker, l and r */
+	uint8_t marklen;
 } format;
 
+/*
+ * ring bytes in and out since rb_setup(), for latency marker
+ * accounting; at is frame of block being rendered it's found at
+ */
+static struct {
+	uint32_t in;
+	uint32_t out;
+	int16_t at;
+} mark;
+
+static struct {
+	frame_t last;
+	bool active;
+} xrun;
+
 static void reset_zstate();
 
-void set_scale()
+/*
+ * off dsp's copy of control state, see ctl.h
+ */
+static void set_scale(void)
 {
-	uint16_t idx = cstate.on[muted] ? VOLSTEPS - 1 : cstate.attn;
+	uint16_t idx = ctl.muted ? VOLSTEPS - 1 : ctl.attn;
 	format.scale = scale[idx]  / (const float[]) {
 		[SAMPLE_FORMAT_NONE] = 1<<0,
 		[SAMPLE_FORMAT_S16] = 1<<15,
 		[SAMPLE_FORMAT_S24] = 1<<23,
-		[SAMPLE_FORMAT_S32] = 1<<31,
-		[SAMPLE_FORMAT_F32] = 1<<0
+		[SAMPLE_FORMAT_S32] = 1U<<31,
+		[SAMPLE_FORMAT_F32] = 1<<0,
+		[SAMPLE_FORMAT_S16_LFE] = 1<<15,
+		[SAMPLE_FORMAT_S24_LFE] = 1<<23
 	} [format.fmt];
 }
 
+/*
+ * l at positive, r at negative full scale, as they come over usb
+ */
+static void mark_setup(sample_fmt fmt)
+{
+	unsigned width = framesize(fmt) / nchannels(fmt);
+	uint8_t *p = format.mark;
+
+	if (fmt == SAMPLE_FORMAT_F32) {
+		memcpy(p, &(const float[]) { 1.0f, -1.0f }, 8);
+	} else {
+		memset(p, 0xff, width - 1);
+		p[width - 1] = 0x7f;
+		memset(p + width, 0, width - 1);
+		p[2 * width - 1] = 0x80;
+	}
+	format.marklen = 2 * width;
+}
+
 void rb_setup(sample_fmt fmt, bool dr)
 {
 	rb.u32 = 0;
+	mark.in = mark.out = 0;
+	mark.at = -1;
+	lat_reset();
 
 	format.doublerate = dr;
 	format.fmt = fmt;
+	format.lfe = nchannels(fmt) > 2;
 	format.nframes = dr ?
-		NFRAMES >> UPSAMPLE_SHIFT_DR :
-		NFRAMES >> UPSAMPLE_SHIFT_SR;
+		BFRAMES >> UPSAMPLE_SHIFT_DR :
+		BFRAMES >> UPSAMPLE_SHIFT_SR;
 	format.framesize = framesize(fmt);
 	format.chunksize = format.framesize * format.nframes;
 	format.taps = dr ? hc_dr : hc_sr;
+	mark_setup(fmt);
+	conv_reset();
+	cap_reset();
 	cstate.rms[0] = cstate.rms[1] = 0;
+	bzero(&xrun, sizeof(xrun));
 	reset_zstate();
 	set_scale();
 }
@@ -100,14 +163,29 @@ static void __attribute__((constructor)) rb_init(void)
 	rb_setup(SAMPLE_FORMAT_NONE, false);
 }
 
+/*
+ * with reset pending, ring's about to go: packet is dropped,
+ * ring reported empty. Incomplete frame at packet end is dropped
+ */
 uint16_t rb_put(void *src, uint16_t len)
 {
 	rb_t r;
 	uint16_t count, space;
 
+	if (ctl_pending())
+		return RBSIZE - 1;
+
+	if ((count = len % format.framesize)) {
+		len -= count;
+		stats.partial++;
+	}
+
 	r.u32 = rb.u32;
 
-	if ((space = rb_space(r)) < len) return 0;
+	if ((space = rb_space(r)) < len) {
+		stats.overrun++;
+		return 0;
+	}
 
 	rb.head = (r.head + len) & (RBSIZE - 1);
 	space -= len;
@@ -125,11 +203,21 @@ uint16_t rb_put(void *src, uint16_t len)
 		memcpy((void *)ringbuf, src, len);
 	}
 
+	mark.in += count + len;
+	if (lat.armed)
+		lat_rx(mark.in, pwm_position());
+
 	return space;
 }
 
+/*
+ * kernels go at -O3 whatever the rest is built with;
+ * DSP_OS leaves them at that, to compare code generation
+ */
+#ifndef DSP_OS
 #pragma GCC push_options
 #pragma GCC optimize 3
+#endif
 
 #define EWMA (1.0f/128)
 static void ewma(float in, float *result)
@@ -137,7 +225,7 @@ static void ewma(float in, float *result)
 	*result = EWMA * in + (1.0f - EWMA) * *result;
 }
 
-static void rms(frame_t *frame)
+static void __fastcode rms(frame_t *frame)
 {
 	unsigned nframes = format.nframes;
 	float acc, suml, sumr, peakl, peakr;
@@ -159,7 +247,7 @@ static void rms(frame_t *frame)
 /*
  * TF2 biquads
  */
-const float lowpass[] = {
+const float lowpass[] __fastdata = {
 	.00006080142895919634f,
 	.00012160285791839268f,
 	.00006080142895919634f,
@@ -173,7 +261,7 @@ const float lowpass[] = {
 	-.9880499709065751f,
 };
 
-const float highpass[] = {
+const float highpass[] __fastdata = {
 	.9856351058506718f,
 	-1.9712702117013436f,
 	.9856351058506718f,
@@ -200,7 +288,7 @@ static inline float qq(float x, float *z, const float *ab)
 	return y;
 }
 
-static void filter(frame_t *frame)
+static void __fastcode filter(frame_t *frame)
 {
 	unsigned nframes = format.nframes;
 	float l, r, x;
@@ -232,7 +320,7 @@ static void filter(frame_t *frame)
 #define UPSAMPLE(x) (1U << UPSAMPLE_SHIFT_##x)
 #define PHASELEN(x) (NUMTAPS_##x >> UPSAMPLE_SHIFT_##x)
 #define BACKLOG(x)  (PHASELEN(x) - 1)
-#define NSAMPLES(x) (NFRAMES >> UPSAMPLE_SHIFT_##x)
+#define NSAMPLES(x) (BFRAMES >> UPSAMPLE_SHIFT_##x)
 
 #if (PHASELEN(DR) != PHASELEN(SR)) || (BACKLOG(DR) != BACKLOG(SR))
 #error PHASELEN and BACKLOG must match
@@ -244,7 +332,7 @@ static void filter(frame_t *frame)
 #define STATELEN (BACKLOG(DR) + NSAMPLES(DR))
 #endif
 
-static void upsample(frame_t *dst, const frame_t *src)
+static void __fastcode upsample(frame_t *dst, const frame_t *src)
 {
 	static frame_t state[STATELEN];
 	frame_t *samples = &state[BACKLOG(DR)];
@@ -288,11 +376,11 @@ static void upsample(frame_t *dst, const frame_t *src)
 
 #define QF (1U << (PWM_WIDTH - 1))
 #if (NS_ORDER == 5)
-const float abg[] = { .0028f, .0344f, .1852f, .5904f, 1.1120f, -.002f, -.0007f };
+const float abg[] __fastdata = { .0028f, .0344f, .1852f, .5904f, 1.1120f, -.002f, -.0007f };
 #elif (NS_ORDER == 4)
-const float abg[] = { .0157f, .1359f, .514f, .3609f, -.0018, -.003f };
+const float abg[] __fastdata = { .0157f, .1359f, .514f, .3609f, -.0018, -.003f };
 #else
-const float abg[] = { .0751f, .0421f, .9811, -.0014f };
+const float abg[] __fastdata = { .0751f, .0421f, .9811, -.0014f };
 #endif
 static float zstate[NCHANNELS * (NS_ORDER + 1)];
 
@@ -301,11 +389,12 @@ static void reset_zstate()
 	bzero(zstate, sizeof(zstate));
 }
 
-static uint16_t ns(float src, float *z)
+static uint8_t __fastcode ns(float src, float *z, uint32_t *clip)
 {
 	const float *x = abg;
 	const float *g = &abg[NS_ORDER];
 	float sum;
+	int32_t v;
 	int8_t p;
 
 	sum = src - z[0];
@@ -322,27 +411,50 @@ static uint16_t ns(float src, float *z)
 	z[2] += z[3] + *x++ * sum + g[0] * z[1];
 	z[1] += z[2] + *x * sum;
 	sum += z[1] + z[0];
-	z[0] = (p = __ssat((int32_t)(sum * QF), PWM_WIDTH)) / (float)QF;
+	v = sum * QF;
+	z[0] = (p = __ssat(v, PWM_WIDTH)) / (float)QF;
+	*clip += (p != v);
 
 	return QF + p;
 }
 
-static void sigmadelta(uint16_t *dst, const frame_t *src)
+static void __fastcode sigmadelta(uint8_t *dst, const frame_t *src)
 {
+	uint32_t clip[NCHANNELS] = { 0 };
+
 #pragma GCC unroll 4
-	for (uint16_t nframes = NFRAMES; nframes; nframes--, src++) {
-		*dst++ = ns(src->l, zstate);
-		*dst++ = ns(src->r, &zstate[NS_ORDER + 1]);
-		*dst++ = ns(src->c, &zstate[(NS_ORDER + 1)<<1]);
+	for (uint16_t nframes = BFRAMES; nframes; nframes--, src++) {
+		*dst++ = ns(src->l, zstate, &clip[0]);
+		*dst++ = ns(src->r, &zstate[NS_ORDER + 1], &clip[1]);
+		*dst++ = ns(src->c, &zstate[(NS_ORDER + 1)<<1], &clip[2]);
 	}
+
+	for (unsigned i = 0; i < NCHANNELS; i++)
+		stats.clip[i] += clip[i];
 }
 
-static void resample(uint16_t *dst, frame_t *src)
+static void __fastcode resample(uint8_t *dst, frame_t *src)
 {
+	uint32_t t = prof_time();
+
 	rms(src);
-	if (cstate.on[boost]) filter(src);
+	t = prof_end(PROF_RMS, t);
+	conv_run(src, format.nframes);
+	t = prof_end(PROF_CONV, t);
+	if (ctl.boost && !format.lfe) {
+		filter(src);
+		t = prof_end(PROF_FILTER, t);
+	}
+	if (cap.on && cap.tap == CAP_TAP_FILTER)
+		cap_filter(src, format.nframes, format.doublerate);
 	upsample(framebuf, src);
+	t = prof_end(PROF_UPSAMPLE, t);
 	sigmadelta(dst, framebuf);
+	prof_end(PROF_SIGMADELTA, t);
+	if (cap.on && cap.tap == CAP_TAP_NS)
+		cap_duty(dst, BFRAMES, format.doublerate ?
+			 (2 * CAP_DECIM) << UPSAMPLE_SHIFT_DR :
+			 CAP_DECIM << UPSAMPLE_SHIFT_SR);
 }
 
 /*
@@ -366,39 +478,55 @@ static inline void reframe_s32(frame_t *dst, const int32_t *src, uint16_t nframe
 	}
 }
 
-static inline void reframe_s24(frame_t *dst, const uint16_t *src, uint16_t nframes)
+static inline int32_t s24(const uint8_t *p)
 {
-	union {
-		struct __attribute__((packed)) {
-			int32_t l : 24;
-			int32_t r : 24;
-		};
-		uint16_t u[3];
-	} s;
+	return (int32_t)((uint32_t)p[0] << 8 |
+			 (uint32_t)p[1] << 16 |
+			 (uint32_t)p[2] << 24) >> 8;
+}
 
+static inline void reframe_s24(frame_t *dst, const uint8_t *src,
+				uint16_t nframes, unsigned nch)
+{
 	while (nframes--) {
-		s.u[0] = *src++;
-		s.u[1] = *src++;
-		s.u[2] = *src++;
-		dst->l = format.scale * s.l;
-		dst->r = format.scale * s.r;
+		dst->l = format.scale * s24(src);
+		dst->r = format.scale * s24(src + 3);
+		if (nch > 2)
+			dst->c = format.scale * s24(src + 6);
+		src += 3 * nch;
 		dst++;
 	}
 }
 
-static inline void reframe_s16(frame_t *dst, const int16_t *src, uint16_t nframes)
+static inline void reframe_s16(frame_t *dst, const int16_t *src,
+				uint16_t nframes, unsigned nch)
 {
 	while (nframes--) {
-		dst->l = format.scale * *src++;
-		dst->r = format.scale * *src++;
+		dst->l = format.scale * src[0];
+		dst->r = format.scale * src[1];
+		if (nch > 2)
+			dst->c = format.scale * src[2];
+		src += nch;
 		dst++;
 	}
 }
 
+/*
+ * latency marker, looked for only while armed, first one per block
+ */
+static void mark_scan(const frame_t *dst, const uint8_t *src, uint16_t nframes)
+{
+	for (unsigned i = 0; i < nframes; i++, src += format.framesize)
+		if (!memcmp(src, format.mark, format.marklen)) {
+			mark.at = dst + i - &framebuf[BFRAMES - format.nframes];
+			return;
+		}
+}
+
 /*
  * reframes len bytes, containing nframes full frames
  */
-static uint16_t reframe(frame_t *dst, const void *src, uint16_t len)
+static uint16_t __fastcode reframe(frame_t *dst, const void *src, uint16_t len)
 {
 	uint16_t nframes = len / format.framesize;
 
@@ -412,45 +540,140 @@ static uint16_t reframe(frame_t *dst, const void *src, uint16_t len)
 		break;
 
 	case SAMPLE_FORMAT_S24:
-		reframe_s24(dst, src, nframes);
+		reframe_s24(dst, src, nframes, 2);
 		break;
 
 	case SAMPLE_FORMAT_S16:
-		reframe_s16(dst, src, nframes);
+		reframe_s16(dst, src, nframes, 2);
+		break;
+
+	case SAMPLE_FORMAT_S24_LFE:
+		reframe_s24(dst, src, nframes, 3);
+		break;
+
+	case SAMPLE_FORMAT_S16_LFE:
+		reframe_s16(dst, src, nframes, 3);
 		break;
 
 	case SAMPLE_FORMAT_NONE:
 		break;
 	}
 
+	if (lat.armed && mark.at < 0)
+		mark_scan(dst, src, nframes);
+
 	return nframes;
 }
 
+/*
+ * underrun: fade from last frame we've got to silence over
+ * a block, then fade back in with first block of new data
+ */
+static void __fastcode fade(frame_t *frame, float from, float to)
+{
+	unsigned nframes = format.nframes;
+	float g = from, dg = (to - from) / nframes;
+
+	while (nframes--) {
+		frame->l *= g;
+		frame->r *= g;
+		frame->c *= g;
+		g += dg;
+		frame++;
+	}
+}
+
+static void __fastcode conceal(uint8_t *dst)
+{
+	frame_t *buf = &framebuf[BFRAMES - format.nframes];
+
+	for (unsigned i = 0; i < format.nframes; i++)
+		buf[i] = xrun.last;
+
+	fade(buf, 1.0f, 0.0f);
+	bzero(&xrun.last, sizeof(xrun.last));
+	xrun.active = true;
+
+	resample(dst, buf);
+}
+
 /*
  *
  */
-extern uint16_t *pframe(page_t page);
+extern uint8_t *pframe(void);
+extern uint32_t pframe_pos(void);
+extern bool pframe_due(void);
 
-void pump(page_t page)
+/*
+ * output frames from first upsampled frame of input sample to
+ * peak of its impulse response, centre of symmetric FIR
+ */
+#define GROUP_DELAY(x) (NUMTAPS_##x >> 1)
+
+static void marked(void)
 {
-	uint16_t count, len = format.chunksize;
-	uint16_t tail = 0, framelen = format.framesize;
-	uint16_t *dst = pframe(page);
+	uint32_t peak = pframe_pos() + (format.doublerate ?
+		(mark.at << UPSAMPLE_SHIFT_DR) + GROUP_DELAY(DR) :
+		(mark.at << UPSAMPLE_SHIFT_SR) + GROUP_DELAY(SR));
+
+	lat_found(mark.out + mark.at * format.framesize, peak, pwm_position());
+	mark.at = -1;
+}
+
+/*
+ * block start: reset usb asked for, then control state as last
+ * published; nothing else touches ring and format mid block
+ */
+void __fastcode dsp_sync(void)
+{
+	ctl_req_t req;
+
+	if (ctl_due(&req)) {
+		rb_setup(req.fmt, req.dr);
+		ctl_done(&req);
+	}
+	if (ctl_take())
+		set_scale();
+}
+
+/*
+ * renders next free pwm block, if there's one and enough data;
+ * fir backlog and noise shaper state carry over between blocks.
+ * On underrun, block due next is concealed rather than left stale
+ */
+bool __fastentry pump(void)
+{
+	uint16_t count, len, tail = 0, framelen;
+	uint32_t t0 = prof_time(), t;
+	uint8_t *dst;
 	frame_t *p, *buf;
 	rb_t r;
 
+	dsp_sync();
+	t = prof_time();		/* reframe stage starts past sync */
+	len = format.chunksize;
+	framelen = format.framesize;
 	r.u32 = rb.u32;
 
-	if (rb_count(r) < len) return;
+	if (rb_count(r) < len) {
+		if (pframe_due() && (dst = pframe())) {
+			stats.underrun++;
+			trace(6, rb_count(r));
+			conceal(dst);
+		}
+		return false;
+	}
+
+	if (!(dst = pframe())) return false;
 
-	p = buf = &framebuf[NFRAMES - format.nframes];
+	p = buf = &framebuf[BFRAMES - format.nframes];
 
 	count = rb_count_to_end(r);
 
 	if (count) {
 		count = MIN(count, len);
 		if ((tail = count % framelen)) {
-			*(uint32_t *)&ringbuf[RBSIZE] = *(uint32_t *)ringbuf;
+			memcpy(&ringbuf[RBSIZE], ringbuf, RBPAD);
 			tail = framelen - tail;
 			count += tail;
 		}
@@ -463,6 +686,20 @@ void pump(page_t page)
 	}
 
 	rb.tail = (r.tail + format.chunksize) & (RBSIZE - 1);
+	prof_end(PROF_REFRAME, t);
+
+	xrun.last = buf[format.nframes - 1];
+	if (xrun.active) {
+		xrun.active = false;
+		fade(buf, 0.0f, 1.0f);
+	}
 
 	resample(dst, buf);
+	if (mark.at >= 0)
+		marked();
+	mark.out += format.chunksize;
+	prof_end(PROF_PUMP, t0);
+	trace(7, prof_time() - t0);
+
+	return true;
 }
@@ -26,4 +26,20 @@
 		out;                            \
 	})
 
+#else
+
+/*
+ * portable equivalents, for HOST builds
+ */
+#include <math.h>
+
+#define __ssat(val, sat)						\
+	({								\
+		int32_t __v = (val);					\
+		int32_t __m = (1 << ((sat) - 1)) - 1;			\
+		__v > __m ? __m : __v < -__m - 1 ? -__m - 1 : __v;	\
+	})
+
+#define __vsqrt(in)	sqrtf(in)
+
 #endif
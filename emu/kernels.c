@@ -0,0 +1,172 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  bare metal harness for qemu mps2-an386: runs dsp core, built
+ *  as firmware is, over every input format, rate and boost setting
+ *  on fixed input; emu/kprof.c plugin counts what each stage
+ *  retires, cases are named to it through emu_label.
+ *  UNTESTED: neither this harness nor kprof.c has been run under
+ *  qemu yet, only built for syntax; there are no expected counts
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "ctl.h"
+#include "prof.h"
+#include "tables.h"
+#include "tools/host.h"
+
+#define WARMUP		8
+#define BLOCKS		32
+#define MAX_PACKET	(96 * 3 * 4)
+
+/*
+ * store to emu_label[c] appends c to case name, to emu_label[0]
+ * reports blocks run since previous one under that name; nameless
+ * report just drops them
+ */
+volatile uint8_t emu_label[256];
+
+static void label(const char *name)
+{
+	do emu_label[(uint8_t)*name] = 1; while (*name++);
+}
+
+static const struct {
+	sample_fmt fmt;
+	const char *name;
+	bool dr;		/* 88.2/96k too */
+} formats[] = {
+	{ SAMPLE_FORMAT_S16,	"s16",		true },
+	{ SAMPLE_FORMAT_S24,	"s24",		true },
+	{ SAMPLE_FORMAT_S32,	"s32",		false },
+	{ SAMPLE_FORMAT_F32,	"f32",		false },
+	{ SAMPLE_FORMAT_S16_LFE, "s16lfe",	false },
+	{ SAMPLE_FORMAT_S24_LFE, "s24lfe",	false }
+};
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_48000,
+	SAMPLE_RATE_96000
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+
+/*
+ * 1ms packet of 1kHz sine at -6dBFS, every channel, as host-bench
+ */
+static uint16_t packet(uint8_t *dst, sample_fmt fmt, sample_rate rate)
+{
+	unsigned nframes = rate / 1000, nch = nchannels(fmt);
+	unsigned width = framesize(fmt) / nch;
+	uint8_t *p = dst;
+
+	for (unsigned i = 0; i < nframes; i++) {
+		float x = .5f * sinf(2 * (float)M_PI * 1000 * i / rate);
+		for (unsigned k = 0; k < nch; k++, p += width) {
+			int32_t v = x * (fmt == SAMPLE_FORMAT_S32 ? INT32_MAX :
+					 (1 << (8 * width - 1)) - 1);
+			if (fmt == SAMPLE_FORMAT_F32)
+				memcpy(p, &x, 4);
+			else
+				memcpy(p, &v, width);
+		}
+	}
+
+	return p - dst;
+}
+
+static void run(const char *name, sample_fmt fmt, sample_rate rate)
+{
+	static uint8_t buf[MAX_PACKET];
+	uint16_t len = packet(buf, fmt, rate);
+	unsigned blocks = 0;
+
+	rb_setup(fmt, rate > SAMPLE_RATE_48000);
+	while (blocks < WARMUP) {
+		rb_put(buf, len);
+		while (pump()) blocks++;
+	}
+
+	label("");
+	while (blocks < WARMUP + BLOCKS) {
+		rb_put(buf, len);
+		while (pump()) blocks++;
+	}
+	label(name);
+}
+
+int main(void)
+{
+	char name[32];
+
+	for (unsigned i = 0; i < NELEM(formats); i++)
+	for (unsigned k = 0; k < NELEM(rates); k++)
+	for (unsigned b = 0; b < 2; b++) {
+		bool dr = rates[k] > SAMPLE_RATE_48000;
+
+		if ((dr && !formats[i].dr) || (b && nchannels(formats[i].fmt) > 2))
+			continue;
+
+		cstate.on[boost] = b;
+		cstate.format = formats[i].fmt;
+		cstate.rate = rates[k];
+		ctl_publish();
+		strcpy(name, formats[i].name);
+		strcat(name, dr ? "/96000" : "/48000");
+		if (b) strcat(name, "/boost");
+		run(name, formats[i].fmt, rates[k]);
+	}
+
+	return 0;
+}
+
+/*
+ * semihosting: qemu exits with 0 for application exit, 1 otherwise
+ */
+#define SYS_EXIT		0x18
+#define ADP_APPLICATION_EXIT	0x20026
+#define ADP_RUNTIME_ERROR	0x20023
+
+static void __attribute__((noreturn)) semihost_exit(uint32_t reason)
+{
+	register uint32_t r0 __asm__("r0") = SYS_EXIT;
+	register uint32_t r1 __asm__("r1") = reason;
+
+	__asm__ volatile ("bkpt 0xab" : : "r" (r0), "r" (r1) : "memory");
+	for (;;);
+}
+
+static void fault(void)
+{
+	semihost_exit(ADP_RUNTIME_ERROR);
+}
+
+extern uint32_t _bss, _ebss, _stack;
+
+#define SCB_CPACR	(*(volatile uint32_t *)0xe000ed88)
+
+static void reset_handler(void)
+{
+	for (uint32_t *p = &_bss; p < &_ebss; p++)
+		*p = 0;
+
+	SCB_CPACR |= 0xf << 20;		/* cp10, cp11 full access */
+	__asm__ volatile ("dsb\n\tisb");
+
+	semihost_exit(main() ? ADP_RUNTIME_ERROR : ADP_APPLICATION_EXIT);
+}
+
+__attribute__((section(".vectors"), used))
+static void (*const vectors[])(void) = {
+	(void (*)(void))&_stack,
+	reset_handler,
+	fault,			/* nmi */
+	fault,			/* hard fault */
+	fault,			/* memmanage */
+	fault,			/* bus fault */
+	fault			/* usage fault */
+};
@@ -0,0 +1,53 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# kpcmp.py [-t percent] base.csv new.csv: compares per stage counts
+# of two emu-prof runs, case by case; rows where instructions grew
+# by more than -t percent (default 2) are marked and make it exit 1.
+# Only run on hand made CSVs: emu-prof itself is untested, see
+# emu/kernels.c
+
+import argparse
+import csv
+import sys
+
+METRICS = ("insns", "loads", "stores", "fpu")
+
+
+def load(path):
+    with open(path, newline="") as f:
+        return {(r["case"], r["stage"]): r for r in csv.DictReader(f)}
+
+
+def delta(a, b):
+    a, b = float(a), float(b)
+    return (b - a) / a * 100 if a else 0.0
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("-t", "--threshold", type=float, default=2.0)
+    ap.add_argument("base")
+    ap.add_argument("new")
+    a = ap.parse_args()
+
+    base, new = load(a.base), load(a.new)
+    worse = 0
+
+    print("%-18s %-10s %9s %9s %7s %7s %7s %7s" % (
+        "case", "stage", "insns", "new", "insns%", "loads%", "stores%", "fpu%"))
+    for k in base:
+        if k not in new:
+            continue
+        b, n = base[k], new[k]
+        d = [delta(b[m], n[m]) for m in METRICS]
+        mark = d[0] > a.threshold
+        worse += mark
+        print("%-18s %-10s %9s %9s %+7.1f %+7.1f %+7.1f %+7.1f%s" % (
+            k + (b["insns"], n["insns"]) + tuple(d) + (" !" if mark else "",)))
+
+    return 1 if worse else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
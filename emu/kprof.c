@@ -0,0 +1,191 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  qemu tcg plugin, -plugin libkprof.so,mark=addr,label=addr:
+ *  counts retired instructions, loads, stores and fpu ops (cp10/11
+ *  encodings, vldr/vstr/vmov included) per dsp stage of emu/kernels.c
+ *  run, as marked by stores to prof_mark and emu_label at given
+ *  addresses; marking stores aren't counted as such, what's left of
+ *  marking is a handful of instructions per stage.
+ *  Prints CSV to qemu log (-d plugin -D file), per stage run.
+ *  UNTESTED: never loaded into qemu, nor built against its
+ *  qemu-plugin.h; first run is likely to need fixing up
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <qemu-plugin.h>
+
+#define EMU
+#include "common.h"
+#include "prof.h"
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+#define MARK_SIZE	sizeof(prof_mark)
+#define LABEL_SIZE	256		/* emu_label, emu/kernels.c */
+
+static const char * const names[] = {
+	[PROF_REFRAME]		= "reframe",
+	[PROF_RMS]		= "rms",
+	[PROF_CONV]		= "conv",
+	[PROF_FILTER]		= "filter",
+	[PROF_UPSAMPLE]		= "upsample",
+	[PROF_SIGMADELTA]	= "sigmadelta",
+	[PROF_PUMP]		= "pump",
+	[PROF_IDLE]		= "idle"
+};
+
+typedef struct {
+	uint64_t insns;
+	uint64_t loads;
+	uint64_t stores;
+	uint64_t fpu;
+} count_t;
+
+static count_t now;
+static count_t start[PROF_MARK_SLOTS];
+static struct {
+	uint64_t n;
+	count_t c;
+} stage[PROF_NUM];
+
+static uint64_t mark, label;
+static char name[64];
+static unsigned namelen;
+
+static void report(void)
+{
+	GString *s = g_string_new(NULL);
+
+	for (unsigned i = 0; i < PROF_NUM; i++) {
+		double n = stage[i].n;
+
+		if (!n) continue;
+		g_string_append_printf(s, "%s,%s,%" PRIu64 ",%.1f,%.1f,%.1f,%.1f\n",
+				       name, names[i], stage[i].n,
+				       stage[i].c.insns / n, stage[i].c.loads / n,
+				       stage[i].c.stores / n, stage[i].c.fpu / n);
+	}
+	qemu_plugin_outs(s->str);
+	g_string_free(s, true);
+}
+
+static void marked(uint64_t off)
+{
+	unsigned slot = off / (PROF_NUM + 1), s = off % (PROF_NUM + 1);
+
+	if (s == PROF_NUM) {
+		start[slot] = now;
+		return;
+	}
+
+	stage[s].n++;
+	stage[s].c.insns += now.insns - start[slot].insns;
+	stage[s].c.loads += now.loads - start[slot].loads;
+	stage[s].c.stores += now.stores - start[slot].stores;
+	stage[s].c.fpu += now.fpu - start[slot].fpu;
+}
+
+static void labelled(uint64_t c)
+{
+	if (c) {
+		if (namelen < sizeof(name) - 1)
+			name[namelen++] = c;
+		return;
+	}
+
+	name[namelen] = 0;
+	if (namelen)
+		report();
+	memset(stage, 0, sizeof(stage));
+	namelen = 0;
+}
+
+static void mem(unsigned int vcpu, qemu_plugin_meminfo_t info,
+		uint64_t vaddr, void *udata)
+{
+	(void)vcpu;
+	(void)udata;
+
+	if (!qemu_plugin_mem_is_store(info)) {
+		now.loads++;
+	} else if (vaddr - mark < MARK_SIZE) {
+		marked(vaddr - mark);
+	} else if (vaddr - label < LABEL_SIZE) {
+		labelled(vaddr - label);
+	} else {
+		now.stores++;
+	}
+}
+
+static void exec(unsigned int vcpu, void *udata)
+{
+	(void)vcpu;
+
+	now.insns++;
+	now.fpu += (uintptr_t)udata;
+}
+
+/*
+ * thumb-2 coprocessor space, 111x 11xx xxxx xxxx : xxxx 101x xxxx xxxx,
+ * is all fpu on armv7e-m
+ */
+static bool fpu(struct qemu_plugin_insn *insn)
+{
+	uint8_t b[4] = { 0 };
+	uint16_t hw1, hw2;
+
+	if (qemu_plugin_insn_size(insn) != 4)
+		return false;
+#if QEMU_PLUGIN_VERSION >= 2
+	qemu_plugin_insn_data(insn, b, sizeof(b));
+#else
+	memcpy(b, qemu_plugin_insn_data(insn), sizeof(b));
+#endif
+	hw1 = b[0] | b[1] << 8;
+	hw2 = b[2] | b[3] << 8;
+
+	return (hw1 & 0xec00) == 0xec00 && (hw2 & 0x0e00) == 0x0a00;
+}
+
+static void tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+	(void)id;
+
+	for (size_t i = 0; i < qemu_plugin_tb_n_insns(tb); i++) {
+		struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+		qemu_plugin_register_vcpu_insn_exec_cb(insn, exec,
+			QEMU_PLUGIN_CB_NO_REGS, (void *)(uintptr_t)fpu(insn));
+		qemu_plugin_register_vcpu_mem_cb(insn, mem,
+			QEMU_PLUGIN_CB_NO_REGS, QEMU_PLUGIN_MEM_RW, NULL);
+	}
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+					   const qemu_info_t *info,
+					   int argc, char **argv)
+{
+	(void)info;
+
+	for (int i = 0; i < argc; i++) {
+		if (!strncmp(argv[i], "mark=", 5))
+			mark = strtoull(argv[i] + 5, NULL, 0);
+		else if (!strncmp(argv[i], "label=", 6))
+			label = strtoull(argv[i] + 6, NULL, 0);
+		else
+			return -1;
+	}
+	if (!mark || !label)
+		return -1;
+
+	qemu_plugin_outs("case,stage,n,insns,loads,stores,fpu\n");
+	qemu_plugin_register_vcpu_tb_trans_cb(id, tb_trans);
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * isr -> dsp event queue.
+ * Single producer/single consumer: all producers must run
+ * at the same interrupt priority, consumer is PendSV.
+ * Events lost on overflow still take a sequence number,
+ * so consumer sees the gap.
+ */
+#define EVQ_SHIFT	3
+#define EVQ_SIZE	(1 << EVQ_SHIFT)
+
+typedef enum {
+	EV_FILL = 1,		/* ring prefilled, start playback */
+	EV_BLOCK,		/* dma half/complete, blocks to render */
+	EV_DRAIN		/* pwm stopped */
+} ev_id;
+
+typedef struct {
+	uint16_t seq;
+	uint8_t id;
+	uint8_t arg;
+	uint32_t stamp;		/* pwm_position() at post */
+} event_t;
+
+typedef struct {
+	volatile uint16_t head;
+	volatile uint16_t tail;
+	uint16_t seq;
+	event_t ev[EVQ_SIZE];
+} evq_t;
+
+static inline void ev_put(volatile evq_t *q, ev_id id, uint8_t arg, uint32_t stamp)
+{
+	uint16_t head = q->head;
+	uint16_t seq = q->seq++;
+
+	if (((head - q->tail) & 0xffff) >= EVQ_SIZE) return;
+
+	q->ev[head & (EVQ_SIZE - 1)] = (event_t) {
+		.seq = seq,
+		.id = id,
+		.arg = arg,
+		.stamp = stamp
+	};
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	q->head = head + 1;
+}
+
+static inline bool ev_get(volatile evq_t *q, event_t *ev)
+{
+	uint16_t tail = q->tail;
+
+	if (tail == q->head) return false;
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	*ev = q->ev[tail & (EVQ_SIZE - 1)];
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	q->tail = tail + 1;
+	return true;
+}
+
+/*
+ * events lost ahead of ev, consumer side; *seq is one
+ * expected next, as of event got before
+ */
+static inline uint16_t ev_gap(uint16_t *seq, const event_t *ev)
+{
+	uint16_t gap = ev->seq - *seq;
+
+	*seq = ev->seq + 1;
+	return gap;
+}
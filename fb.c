@@ -0,0 +1,94 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include "common.h"
+#include "fb.h"
+#include "tables.h"
+
+const fb_fill_t fb_fill[] = {
+#ifdef LOWLATENCY
+	[SAMPLE_FORMAT_S16] = { .prefill = 120, .target = 96 },
+	[SAMPLE_FORMAT_S24] = { .prefill = 120, .target = 96 },
+	[SAMPLE_FORMAT_S32] = { .prefill = 120, .target = 96 },
+	[SAMPLE_FORMAT_F32] = { .prefill = 120, .target = 96 },
+	[SAMPLE_FORMAT_S16_LFE] = { .prefill = 120, .target = 96 },
+	[SAMPLE_FORMAT_S24_LFE] = { .prefill = 120, .target = 96 }
+#else
+	[SAMPLE_FORMAT_S16] = { .prefill = 448, .target = 320 },
+	[SAMPLE_FORMAT_S24] = { .prefill = 288, .target = 224 },
+	[SAMPLE_FORMAT_S32] = { .prefill = 448, .target = 320 },
+	[SAMPLE_FORMAT_F32] = { .prefill = 448, .target = 320 },
+	[SAMPLE_FORMAT_S16_LFE] = { .prefill = 448, .target = 320 },
+	[SAMPLE_FORMAT_S24_LFE] = { .prefill = 288, .target = 224 }
+#endif
+};
+
+/*
+ * device rate, in Q10.14 input frames per ms, from pwm dma progress
+ * over last (1 << SOF_SHIFT) SOFs; 0 until settled
+ */
+#if (FEEDBACK_SHIFT - SOF_SHIFT) < UPSAMPLE_SHIFT_SR
+#error FEEDBACK_SHIFT too small
+#endif
+uint32_t fb_measure(fb_meter_t *m, uint32_t pos, sample_rate rate,
+		    bool running)
+{
+	uint32_t val = (pos - m->pos) << (FEEDBACK_SHIFT - SOF_SHIFT) >>
+		(doubleratep(rate) ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR);
+
+	m->pos = pos;
+
+	if (!running) {
+		m->n = 0;
+		return 0;
+	}
+
+	switch (m->n) {
+	case 0:				/* partial window, skip */
+		m->n++;
+		return 0;
+	case 1:
+		m->n++;
+		m->est = val;
+		break;
+	default:
+		m->est += (int32_t)(val - m->est) >> FB_METER_SHIFT;
+	}
+
+	trace(4, val);
+	return m->est;
+}
+
+/*
+ * measured rate plus PI trim on averaged ring fill vs target
+ */
+uint32_t fb_update(fb_pi_t *pi, uint32_t measured, sample_fmt fmt,
+		   sample_rate rate, uint16_t framelen, bool filling)
+{
+	uint32_t nominal = FEEDBACK(rate);
+	int32_t err, val, range = nominal >> FB_RANGE_SHIFT;
+
+	if (filling || !pi->npkts) {
+		pi->integ = 0;
+		goto out;
+	}
+
+	err = (int32_t)(((pi->fillsum << 4) / pi->npkts) / framelen) -
+		(fb_fill[fmt].target << (4 + doubleratep(rate)));
+	val = (int32_t)(measured ? measured : nominal) -
+		(err << FB_KP_SHIFT) - (pi->integ >> FB_KI_SHIFT);
+
+	if (val > (int32_t)nominal + range)
+		val = nominal + range;
+	else if (val < (int32_t)nominal - range)
+		val = nominal - range;
+	else
+		pi->integ += err;	/* no windup while clamped */
+
+	nominal = val;
+out:
+	pi->fillsum = pi->npkts = 0;
+	return nominal;
+}
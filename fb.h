@@ -0,0 +1,38 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * async feedback loop math, see FB_* in common.h. Kept apart from
+ * usbd.c, which owns its state and feeds it pwm_position() and ring
+ * fill, so the very same loop can be closed on host, tools/feedback.c.
+ * Fill is in input frames at single rate, doubled for 88.2/96k:
+ * prefill is what we wait for before starting playback, target is
+ * the level feedback loop settles to, and what mostly defines
+ * end-to-end latency. Both, in bytes, plus a full packet must fit
+ * in RBSIZE.
+ */
+typedef struct {
+	uint16_t prefill;
+	uint16_t target;
+} fb_fill_t;
+
+typedef struct {
+	uint32_t pos;		/* pwm_position() at last update */
+	uint32_t est;
+	unsigned n;
+} fb_meter_t;
+
+typedef struct {
+	uint32_t fillsum;	/* ring bytes, summed per packet */
+	uint16_t npkts;
+	int32_t integ;
+} fb_pi_t;
+
+extern const fb_fill_t fb_fill[];
+
+uint32_t fb_measure(fb_meter_t *m, uint32_t pos, sample_rate rate,
+		    bool running);
+uint32_t fb_update(fb_pi_t *pi, uint32_t measured, sample_fmt fmt,
+		   sample_rate rate, uint16_t framelen, bool filling);
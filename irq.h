@@ -0,0 +1,42 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scb.h>
+
+/*
+ * worst case isr latency and run time, per source, in cpu cycles.
+ * Latency is since the event, as far as hardware tells:
+ * pwm dma from transfer position and TIM1 count, display from TIM4
+ * count, dsp from the time it was first pended; usb has none.
+ */
+extern volatile stats_t stats;
+extern volatile uint32_t dsp_pended;
+
+static inline uint32_t irq_enter(irq_src src, uint32_t lat)
+{
+	if (lat > stats.irqlat[src])
+		stats.irqlat[src] = lat;
+
+	return DWT_CYCCNT;
+}
+
+static inline void irq_exit(irq_src src, uint32_t t0)
+{
+	uint32_t run = DWT_CYCCNT - t0;
+
+	if (run > stats.irqrun[src])
+		stats.irqrun[src] = run;
+}
+
+/*
+ * have pump() run at dsp priority
+ */
+static inline void dsp_pend(void)
+{
+	if (!(SCB_ICSR & SCB_ICSR_PENDSVSET))
+		dsp_pended = DWT_CYCCNT;
+	SCB_ICSR = SCB_ICSR_PENDSVSET;
+}
@@ -0,0 +1,87 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include "common.h"
+#include "lat.h"
+#include "tables.h"
+
+volatile lat_t lat;
+
+/*
+ * packets since lat_reset(), written at usb isr priority,
+ * read by dsp; in is ring bytes in through the packet
+ */
+static struct {
+	uint32_t in;
+	uint32_t pos;
+	uint16_t sof;
+} pkts[LAT_LOG];
+
+static volatile uint32_t head;
+static volatile uint16_t sofs;
+
+void lat_arm(bool on)
+{
+	lat_reset();
+	lat.seq = 0;
+	lat.armed = on;
+}
+
+/*
+ * ring restarts, byte counts with it
+ */
+void lat_reset(void)
+{
+	head = 0;
+}
+
+void lat_sof(void)
+{
+	sofs++;
+}
+
+void lat_rx(uint32_t in, uint32_t pos)
+{
+	uint32_t h = head;
+
+	pkts[h % LAT_LOG].in = in;
+	pkts[h % LAT_LOG].pos = pos;
+	pkts[h % LAT_LOG].sof = sofs;
+	head = h + 1;
+}
+
+/*
+ * marker at ring byte at, rendered at pos to play at peak: it came
+ * in packet logged first past at, with one before it logged too;
+ * first packet after arming can't be told from an unlogged one
+ */
+void lat_found(uint32_t at, uint32_t peak, uint32_t pos)
+{
+	uint32_t h = head, n = MIN(h, LAT_LOG);
+	unsigned hit = LAT_LOG;
+
+	for (unsigned i = 1; i <= n; i++) {
+		unsigned k = (h - i) % LAT_LOG;
+
+		if ((int32_t)(pkts[k].in - at) <= 0) {
+			if (hit == LAT_LOG) return;
+			lat.sof = pkts[hit].sof;
+			lat.rx = pkts[hit].pos;
+			lat.render = pos;
+			lat.peak = peak;
+			lat.seq++;
+			return;
+		}
+		hit = k;
+	}
+}
+
+uint32_t lat_us(uint32_t frames, sample_rate rate)
+{
+	unsigned shift = rate > SAMPLE_RATE_48000 ?
+		UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+
+	return rate ? 1e6f * frames / ((uint32_t)rate << shift) : 0;
+}
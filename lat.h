@@ -0,0 +1,34 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * end-to-end latency, usb to pwm, measured on a marker: input frame
+ * with l at positive and r at negative full scale, bit exact, as
+ * host plays it. While armed, every packet put in ring is logged
+ * with SOF count and pwm_position() at arrival; reframe() spots
+ * the marker, so it's known which packet brought it, and pump()
+ * where its shaped peak lands in pwm buffer. All is in output
+ * frames, pwm_position() ones: (rate << upsample shift) a second.
+ * Meaningful while running, pwm_position() stands still otherwise.
+ */
+#define LAT_LOG		32	/* packets, 2^N, more than ring holds */
+
+typedef struct {
+	bool armed;
+	uint32_t seq;		/* markers found since armed */
+	uint16_t sof;		/* SOF count marker packet came after */
+	uint32_t rx;		/* pwm_position() when it came */
+	uint32_t render;	/* ... when it was rendered */
+	uint32_t peak;		/* ... its peak plays at */
+} lat_t;
+
+extern volatile lat_t lat;
+
+void lat_arm(bool on);
+void lat_reset(void);
+void lat_sof(void);
+void lat_rx(uint32_t in, uint32_t pos);
+void lat_found(uint32_t at, uint32_t peak, uint32_t pos);
+uint32_t lat_us(uint32_t frames, sample_rate rate);
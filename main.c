@@ -3,6 +3,7 @@
  *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
  */
 
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/cm3/nvic.h>
 #include <libopencm3/cm3/systick.h>
 #include <libopencm3/stm32/crs.h>
@@ -10,6 +11,10 @@
 #include <libopencm3/stm32/rcc.h>
 
 #include "common.h"
+#include "ctl.h"
+#include "evq.h"
+#include "irq.h"
+#include "prof.h"
 
 const struct rcc_clock_scale rcc_hse_custom[] = {
 	{ /* 61=>47656.25 */
@@ -41,10 +46,15 @@ static const struct rcc_clock_scale *clock = rcc_hse_custom;
 volatile uint32_t systicks;
 
 volatile ev_t e = {
-	.seen = true,
 	.state = STATE_CLOSED
 };
 
+volatile evq_t evq;
+
+volatile stats_t stats;
+
+volatile uint32_t dsp_pended;
+
 volatile cs_t cstate = {
 	.on[muted] = true,
 	.on[spmuted] = true,
@@ -53,9 +63,11 @@ volatile cs_t cstate = {
 };
 
 void disp();
-void pump(page_t);
+bool pump(void);
+void dsp_sync(void);
 void pwm();
 void pwm_enable();
+uint32_t pwm_position(void);
 void usbd(void);
 
 void sys_tick_handler(void)
@@ -91,6 +103,67 @@ void pll_setup(sample_rate rate)
 static void poll()
 {
 	gpio_toggle(GPIOC, GPIO13);
+	cstate.load = prof_load();
+}
+
+/*
+ * sleep till next interrupt, accounting idle time:
+ * wfi wakes on pending one even if masked, it's taken
+ * once we've got the stamp
+ */
+static void idle(void)
+{
+	uint32_t t;
+
+	cm_disable_interrupts();
+	t = prof_time();
+	__asm("wfi");
+	prof_end(PROF_IDLE, t);
+	cm_enable_interrupts();
+}
+
+/*
+ * dsp: consumes isr events, renders pwm blocks
+ */
+void __fastcode pend_sv_handler(void)
+{
+	static uint16_t seq;
+	uint32_t t0, late;
+	event_t ev;
+
+	t0 = irq_enter(IRQ_DSP, DWT_CYCCNT - dsp_pended);
+	dsp_sync();		/* reset usb asked for, even with no block due */
+
+	while (ev_get(&evq, &ev)) {
+		stats.missed += ev_gap(&seq, &ev);
+
+		switch (ev.id) {
+
+		case EV_FILL:
+			if (e.state != STATE_FILL) break;
+			while (pump());
+			e.state = STATE_RUNNING;
+			pwm_enable();
+			break;
+
+		case EV_BLOCK:
+			/* deadline: one block past the interrupt */
+			late = pwm_position() - ev.stamp;
+			if (late > stats.evlate) stats.evlate = late;
+			if (late > BFRAMES) stats.missed++;
+			break;
+
+		case EV_DRAIN:
+			if (e.state == STATE_DRAIN)
+				e.state = STATE_CLOSED;
+			break;
+		}
+	}
+
+	if (e.state == STATE_RUNNING)
+		while (pump());
+
+	irq_exit(IRQ_DSP, t0);
 }
 
 int main() {
@@ -113,6 +186,9 @@ int main() {
 	rcc_periph_clock_enable(RCC_TIM2);
 	rcc_periph_clock_enable(RCC_TIM3);
 	rcc_periph_clock_enable(RCC_TIM4);
+#ifdef CHASE
+	rcc_periph_clock_enable(RCC_TIM8);
+#endif
 	rcc_set_hsi_div(RCC_CFGR3_HSIDIV_NODIV);
 	rcc_set_hsi_sclk(RCC_CFGR5_HSI_SCLK_HSIDIV);
 	rcc_set_usb_clock_source(RCC_HSI);
@@ -127,6 +203,12 @@ int main() {
 	systick_set_reload(rcc_ahb_frequency / 1000);
 	systick_interrupt_enable();
 	systick_counter_enable();
+/*
+ * irq priorities, see common.h; peripherals set their own
+ */
+	nvic_set_priority(NVIC_SYSTICK_IRQ, IRQ_PRIO_DISP);
+	nvic_set_priority(NVIC_PENDSV_IRQ, IRQ_PRIO_DSP);
+	dwt_enable_cycle_counter();
 /*
  * gpios
  */
@@ -169,6 +251,7 @@ int main() {
 
 	cstate.on[spmuted] = (gpio_get(GPIOA, GPIO3) != 0);
 	cstate.on[boost] = !cstate.on[spmuted];
+	ctl_publish();
 /*
  *
  */
@@ -180,32 +263,9 @@ mainloop:
 	wake = systicks + 500;
 
 sleep:
-	__asm("wfe");
-
-	if (e.seen) goto poll;
-	e.seen = true;
-
-	switch (e.state) {
-
-	case STATE_FILL:
-		pump(BUSY_PAGE);
-		pump(FREE_PAGE);
-		e.state = STATE_RUNNING;
-		pwm_enable();
-		break;
-
-	case STATE_RUNNING:
-		pump(FREE_PAGE);
-		break;
-
-	case STATE_DRAIN:
-		e.state = STATE_CLOSED;
-
-	case STATE_CLOSED:
-		break;
-	};
+	dbg_drain();
+	idle();
 
-poll:
 	if (wake > systicks)
 		goto sleep;
 
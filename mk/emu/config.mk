@@ -0,0 +1,28 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+QEMU_ARM	?= qemu-system-arm
+EMU_ELF		= emu/kernels.elf
+EMU_PLUGIN	= emu/libkprof.so
+EMU_SRCS	= emu/kernels.c dsp.c conv.c lat.c cap.c ctl.c prof.c tables.c \
+		  tools/host.c
+EMU_DEPS	= $(EMU_SRCS) $(TABLES) common.h dsp.h conv.h lat.h cap.h \
+		  ctl.h prof.h tools/host.h emu/mps2.ld emu/cflags
+
+# dsp core as firmware has it, flags and all, on mps2-an386
+# cortex-m4f; e.g. EMU_CFLAGS=-DDSP_OS for kernels at -Os too
+EMU_CFLAGS	?=
+EMU_DEFS	= -DEMU $(filter -DLOWLATENCY -DCHASE,$(CPPFLAGS))
+EMU_LDFLAGS	= -nostartfiles -Temu/mps2.ld --specs=nano.specs \
+		  -Wl,--gc-sections
+EMU_LDLIBS	= -lm -Wl,--start-group -lc -lgcc -lnosys -Wl,--end-group
+
+# where qemu-plugin.h is: installed headers or qemu source include/
+QEMU_PLUGIN_INC	?= /usr/include/qemu
+EMU_PLUGIN_CFLAGS = -fPIC -shared -I$(QEMU_PLUGIN_INC) -I. \
+		  $(shell pkg-config --cflags glib-2.0)
+
+# per stage counts, CSV; emu-cmp compares EMU_OUT against EMU_BASE
+EMU_OUT		?= emu/kprof.csv
+EMU_BASE	?= emu/kprof-base.csv
+EMU_CMP_ARGS	?=
+
+emu_sym		= 0x$$($(NM) $(EMU_ELF) | awk '$$3 == "$(1)" { print $$1 }')
@@ -0,0 +1,31 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+emu:		$(EMU_ELF) $(EMU_PLUGIN)
+
+# untested, see emu/kernels.c; not part of any other target.
+# e.g. make emu-prof EMU_OUT=emu/kprof-base.csv, then
+# make emu-prof emu-cmp EMU_CFLAGS=-DDSP_OS
+emu-prof:	$(EMU_ELF) $(EMU_PLUGIN)
+	@printf "  QEMU    $(EMU_OUT)\n"
+	$(Q)$(QEMU_ARM) -M mps2-an386 -nographic -semihosting \
+		-kernel $(EMU_ELF) -d plugin -D $(EMU_OUT) \
+		-plugin $(EMU_PLUGIN),mark=$(call emu_sym,prof_mark),label=$(call emu_sym,emu_label)
+
+emu-cmp:
+	$(Q)emu/kpcmp.py $(EMU_CMP_ARGS) $(EMU_BASE) $(EMU_OUT)
+
+# relink when flags change
+emu/cflags:	FORCE
+	$(Q)echo '$(CFLAGS) $(ARCH_FLAGS) $(EMU_CFLAGS) $(EMU_DEFS)' | \
+		cmp -s - $@ || \
+		echo '$(CFLAGS) $(ARCH_FLAGS) $(EMU_CFLAGS) $(EMU_DEFS)' > $@
+
+$(EMU_ELF):	$(EMU_DEPS)
+	@printf "  CC      $@\n"
+	$(Q)$(CC) $(CFLAGS) $(ARCH_FLAGS) $(EMU_CFLAGS) $(EMU_DEFS) -I. \
+		$(EMU_SRCS) -o $@ $(EMU_LDFLAGS) $(EMU_LDLIBS)
+
+$(EMU_PLUGIN):	emu/kprof.c common.h prof.h
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(EMU_PLUGIN_CFLAGS) $< -o $@
+
+.PHONY:		emu emu-prof emu-cmp FORCE
@@ -0,0 +1,48 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+HOSTCC		?= cc
+HOSTCFLAGS	?= -O2 -Wall -Wextra
+HOST_BENCH	= tools/host-bench
+HOST_RENDER	= tools/wavrender
+HOST_LATENCY	= tools/host-latency
+HOST_CAPTURE	= tools/host-capture
+HOST_CONV	= tools/host-conv
+HOST_STRESS	= tools/host-stress
+HOST_FEEDBACK	= tools/host-feedback
+HOST_PFRAME	= tools/host-pframe
+HOST_XRUN	= tools/host-xrun
+HOST_EVQ	= tools/host-evq
+HOST_DMABUF	= tools/host-dmabuf
+HOST_REFRAME	= tools/host-reframe
+HOST_TELEMETRY	= tools/host-telemetry
+HOST_DEBUG	= tools/host-debug
+HOST_SCREEN	= tools/host-screen
+HOST_TOOLS	= $(HOST_BENCH) $(HOST_RENDER) $(HOST_LATENCY) \
+		  $(HOST_CAPTURE) $(HOST_CONV) $(HOST_STRESS) $(HOST_FEEDBACK) \
+		  $(HOST_PFRAME) $(HOST_XRUN) $(HOST_EVQ) $(HOST_DMABUF) \
+		  $(HOST_REFRAME) $(HOST_TELEMETRY) $(HOST_DEBUG) $(HOST_SCREEN)
+HOST_SRCS	= dsp.c conv.c lat.c cap.c ctl.c prof.c tables.c tools/host.c
+HOST_DEPS	= $(HOST_SRCS) $(TABLES) common.h dsp.h conv.h lat.h cap.h \
+		  ctl.h prof.h tools/host.h
+
+# pwm.c against mock hal, in place of tools/host.c
+PWM_HOST_SRCS	= pwm.c tools/pwmhal.c
+PWM_HOST_DEPS	= $(PWM_HOST_SRCS) common.h evq.h irq.h sim/hal.h tools/pwmhal.h
+
+# same pipeline geometry as target build
+HOST_DEFS	= -DHOST $(filter -DLOWLATENCY -DCHASE,$(CPPFLAGS))
+
+# synthetic DEBUG build SWO capture, tools/timeline/mksample.py
+# builds it, and timeline.py output expected off it
+TIMELINE_SAMPLE	= tools/timeline/sample
+
+# e.g. HOST_FEEDBACK_ARGS="-f s24 -p 100 -d -50"
+HOST_FEEDBACK_ARGS ?=
+
+# e.g. HOST_SCREEN_ARGS="-o /tmp", pbm of every snapshot
+HOST_SCREEN_ARGS ?=
+
+# e.g. HOST_BENCH_ARGS=-c > bench.csv
+HOST_BENCH_ARGS	?=
+
+# e.g. HOST_EXPLORE_ARGS="--all --cost time" > explore.csv
+HOST_EXPLORE_ARGS ?=
@@ -0,0 +1,158 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+host:		$(HOST_TOOLS)
+
+host-bench:	$(HOST_BENCH)
+	$(Q)./$(HOST_BENCH) $(HOST_BENCH_ARGS)
+
+# latency marker accounting on synthetic streams, exits 1 if off
+host-latency:	$(HOST_LATENCY)
+	$(Q)./$(HOST_LATENCY)
+
+# loopback capture against pipeline state, exits 1 if off
+host-capture:	$(HOST_CAPTURE)
+	$(Q)./$(HOST_CAPTURE)
+
+# correction FIR against direct convolution, then its cost over
+# tap counts; exits 1 if off
+host-conv:	$(HOST_CONV)
+	$(Q)./$(HOST_CONV)
+
+# control state hammered while streaming, exits 1 on torn state
+host-stress:	$(HOST_STRESS)
+	$(Q)./$(HOST_STRESS)
+
+# feedback loop closed over host clock drift, every rate; exits 1
+# on xrun or fill not settling to target
+host-feedback:	$(HOST_FEEDBACK)
+	$(Q)./$(HOST_FEEDBACK) $(HOST_FEEDBACK_ARGS)
+
+# pwm block bookkeeping against synthetic dma, exits 1 if off;
+# geometry as built, LOWLATENCY=1 or CHASE=1 for others
+host-pframe:	$(HOST_PFRAME)
+	$(Q)./$(HOST_PFRAME)
+
+# starved, flooded and ragged packets, exits 1 on click or
+# xrun counts off
+host-xrun:	$(HOST_XRUN)
+	$(Q)./$(HOST_XRUN)
+
+# isr -> dsp event queue under timer signal, exits 1 on event
+# torn, out of order, or lost ones miscounted
+host-evq:	$(HOST_EVQ)
+	$(Q)./$(HOST_EVQ)
+
+# dmabuf layout against pwm dma bursts, exits 1 if a channel
+# lands off its CCR
+host-dmabuf:	$(HOST_DMABUF)
+	$(Q)./$(HOST_DMABUF)
+
+# every input format, 2.1 included, into its channels, exits 1
+# if a channel's level is off
+host-reframe:	$(HOST_REFRAME)
+	$(Q)./$(HOST_REFRAME)
+
+# counters packed as firmware does, decoded as f4uacstat does,
+# exits 1 if any is off
+host-telemetry:	$(HOST_TELEMETRY)
+	$(Q)./$(HOST_TELEMETRY)
+
+# DEBUG log ring under producer threads, exits 1 on record torn,
+# out of order, or neither drained nor counted dropped
+host-debug:	$(HOST_DEBUG)
+	$(Q)./$(HOST_DEBUG)
+
+# screen snapshots, one to another, exits 1 on a page left stale
+# by screen_dirty(); HOST_SCREEN_ARGS="-o dir" dumps them as pbm
+host-screen:	$(HOST_SCREEN)
+	$(Q)./$(HOST_SCREEN) $(HOST_SCREEN_ARGS)
+
+# timeline.py over sample capture, exits 1 if capture doesn't come
+# out of mksample.py as committed, or JSON or CSV differ from expected
+host-timeline:
+	$(Q)t=$$(mktemp) && \
+	tools/timeline/mksample.py | cmp - $(TIMELINE_SAMPLE).swo && \
+	tools/timeline.py --csv $$t $(TIMELINE_SAMPLE).swo | \
+		cmp - $(TIMELINE_SAMPLE).json && \
+	cmp $$t $(TIMELINE_SAMPLE).csv && echo "timeline: ok"; \
+	r=$$?; rm -f $$t; exit $$r
+
+# tables per design point come from tables.m, so octave is needed
+host-explore:
+	$(Q)tools/explore.py --cc "$(HOSTCC)" \
+		--cflags "$(HOSTCFLAGS) $(HOST_DEFS)" \
+		--octave "$(OCTAVE)" $(HOST_EXPLORE_ARGS)
+
+$(HOST_BENCH):	tools/bench.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_RENDER):	tools/wavrender.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_LATENCY): tools/latency.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_CAPTURE): tools/capture.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_CONV):	tools/conv.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_STRESS):	tools/stress.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_FEEDBACK): tools/feedback.c fb.c fb.h common.h $(TABLES)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. fb.c $< -o $@ -lm
+
+$(HOST_XRUN):	tools/xrun.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_REFRAME): tools/reframe.c $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) $< -o $@ -lm
+
+$(HOST_TELEMETRY): tools/telemetry.c tools/tmdecode.c $(HOST_DEPS) \
+		  telemetry.h tools/tmdecode.h
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $(HOST_SRCS) \
+		tools/tmdecode.c $< -o $@ -lm
+
+$(HOST_EVQ):	tools/evq.c evq.h common.h
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. $< -o $@
+
+# debug.c as is, words off ITM taken by the tool
+$(HOST_DEBUG):	tools/debug.c debug.c debug.h common.h sim/hal.h
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(SIM_CFLAGS) -Wno-int-to-pointer-cast \
+		$(HOST_DEFS) -DSIM -DDEBUG -Isim/include -I. debug.c $< -o $@ \
+		-pthread
+
+$(HOST_SCREEN):	tools/screen.c screen.c screen.h font.h icons.c icons.h \
+		  common.h $(addsuffix .xbm,$(ICONS))
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(HOST_DEFS) -I. screen.c icons.c $< -o $@
+
+# pwm.c as is, against mock hal
+$(HOST_PFRAME):	tools/pframe.c $(PWM_HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(SIM_CFLAGS) $(HOST_DEFS) -DSIM \
+		-Isim/include -I. $(PWM_HOST_SRCS) $< -o $@
+
+$(HOST_DMABUF):	tools/dmabuf.c $(PWM_HOST_DEPS) $(HOST_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(SIM_CFLAGS) $(HOST_DEFS) -DSIM \
+		-Isim/include -I. $(filter-out tools/host.c,$(HOST_SRCS)) \
+		$(PWM_HOST_SRCS) $< -o $@ -Wl,--wrap=pframe -lm
+
+.PHONY:		host host-bench host-latency host-capture host-conv host-stress \
+		host-feedback host-pframe host-xrun host-evq host-dmabuf \
+		host-reframe host-telemetry host-debug host-screen \
+		host-timeline host-explore
@@ -0,0 +1,19 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+NM		?= $(PREFIX)nm
+SIZE		?= $(PREFIX)size
+
+# biggest ram consumers listed, bytes
+RAM_REPORT_MIN	?= 256
+
+# hot path symbols, see __fastcode/__fastentry/__fastdata in common.h;
+# build fails if any of them is missing or lands outside fast regions,
+# zero wait flash (256K on at32f403a) or sram, [start end).
+# HOT_INLINE ones are static, or global with a caller or two,
+# -flto may fold them into callers; checked only if left out of line
+HOT_SYMS	?= pump conv_run pframe pframe_due pwm_position \
+		   dma1_channel1_isr pend_sv_handler \
+		   hc_sr hc_dr abg lowpass highpass
+HOT_INLINE	?= resample upsample sigmadelta ns rms filter fir reframe fade \
+		   conceal pwm_disable dsp_sync ctl_take ctl_due
+FAST_ROM	?= 08000000 08040000
+FAST_RAM	?= 20000000 20018000
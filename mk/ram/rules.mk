@@ -0,0 +1,26 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+ram:		$(BINARY).elf
+	@printf "  RAM     $<\n"
+	$(Q)$(SIZE) -A $< | awk '\
+		/^\.(data|bss|noinit|stack)/ { printf "%12s %8d\n", $$1, $$2; t += $$2 } \
+		END { printf "%12s %8d\n", "total", t }'
+	$(Q)$(NM) -S --size-sort -t d $< | awk '\
+		$$3 ~ /^[bBdD]$$/ && $$2 + 0 >= $(RAM_REPORT_MIN) \
+		{ printf "%12d %s\n", $$2, $$4 }'
+	@printf "  HOT     $<\n"
+	$(Q)$(NM) $< | awk -v hot="$(HOT_SYMS)" -v inl="$(HOT_INLINE)" \
+		-v rom="$(FAST_ROM)" -v ram="$(FAST_RAM)" '\
+		BEGIN { split(hot, h); for (i in h) want[h[i]] = need[h[i]] = 1; \
+			split(inl, h); for (i in h) want[h[i]] = 1; \
+			split(rom, f); split(ram, r) } \
+		{ name = $$3; sub(/\..*/, "", name); a = tolower($$1) } \
+		!(name in want) { next } \
+		{ seen[name] = 1 } \
+		a >= r[1] "" && a < r[2] "" { printf "%12s %s sram\n", a, $$3; next } \
+		a >= f[1] "" && a < f[2] "" { printf "%12s %s flash\n", a, $$3; next } \
+		{ printf "%12s %s SLOW\n", a, $$3; slow = 1 } \
+		END { for (n in need) if (!(n in seen)) { \
+			printf "%12s %s MISSING\n", "-", n; slow = 1 }; \
+		      exit slow }'
+
+.PHONY:		ram
@@ -0,0 +1,23 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+SIM		= sim/f4uac-sim
+SIM_SRCS	= main.c usbd.c fb.c pwm.c dsp.c conv.c lat.c cap.c ctl.c disp.c \
+		  screen.c icons.c prof.c tables.c sim/hal.c sim/usb.c sim/sim.c
+SIM_DEPS	= $(SIM_SRCS) $(TABLES) icons.h sim/hal.h sim/sim.h \
+		  $(addsuffix .xbm,$(ICONS))
+
+# mock hal first, usb headers are real ones
+SIM_DEFS	= -DHOST -DSIM -Dmain=fw_main \
+		  $(filter -DLOWLATENCY -DCHASE,$(CPPFLAGS))
+SIM_INCS	= -Isim/include -I. -I$(OPENCM3_DIR)/include
+SIM_CFLAGS	= -Wno-pointer-to-int-cast
+SIM_LDFLAGS	= -Wl,--wrap=pump -Wl,--wrap=rb_put
+
+# e.g. SIM_ARGS="-t 3600 -x" for an hour of streaming
+SIM_ARGS	?=
+
+# feedback loop over every rate, per host profile
+SIM_FB_ARGS	?= -t 60 -p 100 -d -50 -J 100
+SIM_PROFILES	= linux windows macos
+
+# e.g. SIM_DL_ARGS="-j 0.3 -x" to fail on late events too
+SIM_DL_ARGS	?= -t 10
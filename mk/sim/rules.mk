@@ -0,0 +1,21 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+sim:		$(SIM)
+
+sim-run:	$(SIM)
+	$(Q)./$(SIM) $(SIM_ARGS)
+
+sim-fb:		$(SIM)
+	$(Q)for h in $(SIM_PROFILES); do \
+		./$(SIM) -r 0 -H $$h $(SIM_FB_ARGS) || exit 1; \
+	done
+
+# dsp slack against response time bound, load by usb isr cost
+sim-deadline:	$(SIM)
+	$(Q)./$(SIM) -D $(SIM_DL_ARGS)
+
+$(SIM):		$(SIM_DEPS)
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) $(SIM_CFLAGS) $(SIM_DEFS) $(SIM_INCS) \
+		$(SIM_SRCS) -o $@ $(SIM_LDFLAGS) -lm
+
+.PHONY:		sim sim-run sim-fb sim-deadline
@@ -0,0 +1,4 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+HOSTCC		?= cc
+HOSTCFLAGS	?= -O2 -Wall -Wextra
+TOOLS		= tools/f4uacstat
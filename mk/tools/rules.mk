@@ -0,0 +1,10 @@
+#------------------------------------------ -*- tab-width: 8 -*-
+tools:		$(TOOLS)
+
+tools/f4uacstat: tools/f4uacstat.c tools/tmdecode.c telemetry.h \
+		 tools/tmdecode.h
+	@printf "  HOSTCC  $@\n"
+	$(Q)$(HOSTCC) $(HOSTCFLAGS) -I. $< tools/tmdecode.c -o $@ \
+		$(shell pkg-config --cflags --libs libusb-1.0)
+
+.PHONY:		tools
@@ -0,0 +1,80 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include "common.h"
+#include "prof.h"
+#include "telemetry.h"
+
+extern volatile stats_t stats;
+
+volatile prof_t prof[PROF_NUM];
+
+#ifdef EMU
+volatile uint8_t prof_mark[PROF_MARK_SLOTS][PROF_NUM + 1];
+uint32_t prof_seq;
+#endif
+
+/*
+ * share of time not spent idle since last call;
+ * call from main loop, which is what accounts idle time
+ */
+float prof_load(void)
+{
+	static uint32_t last;
+	uint32_t now = prof_time();
+	uint32_t idle = prof[PROF_IDLE].acc;
+	float load;
+
+	prof[PROF_IDLE].acc = 0;
+	load = 1.0f - (float)idle / (now - last);
+	last = now;
+
+	return MAX(load, 0.0f);
+}
+
+/*
+ * telemetry counters: xrun stats and pump() profile, as they are;
+ * rest of block is usb side's to fill
+ */
+void prof_telemetry(telemetry_t *t)
+{
+	t->opens = stats.opens;
+	t->late = stats.late;
+	t->underrun = stats.underrun;
+	t->overrun = stats.overrun;
+	t->partial = stats.partial;
+	t->missed = stats.missed;
+	t->evlate = stats.evlate;
+	for (unsigned i = 0; i < sizeof(t->clip) / sizeof(t->clip[0]); i++)
+		t->clip[i] = stats.clip[i];
+	t->pump_avg = prof[PROF_PUMP].avg;
+	t->pump_max = prof[PROF_PUMP].max;
+}
+
+#ifdef HOST
+#include <stdio.h>
+
+static const char * const prof_names[] = {
+	[PROF_REFRAME]		= "reframe",
+	[PROF_RMS]		= "rms",
+	[PROF_CONV]		= "conv",
+	[PROF_FILTER]		= "filter",
+	[PROF_UPSAMPLE]		= "upsample",
+	[PROF_SIGMADELTA]	= "sigmadelta",
+	[PROF_PUMP]		= "pump",
+	[PROF_IDLE]		= "idle"
+};
+
+void prof_report(void)
+{
+	printf("%-12s %10s %10s %10s %10s\n",
+	       "stage", "n", "min", "avg", "max");
+	for (unsigned i = 0; i < PROF_NUM; i++) {
+		if (!prof[i].n) continue;
+		printf("%-12s %10u %10u %10u %10u\n", prof_names[i],
+		       prof[i].n, prof[i].min, prof[i].avg, prof[i].max);
+	}
+}
+#endif
@@ -0,0 +1,99 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * per stage profiler: min/avg/max of each pump() stage, pump()
+ * as a whole, and main loop idle stretches. Counts are cpu cycles
+ * off DWT on target, nanoseconds off clock_gettime() in host builds;
+ * simulator has its own DWT, counting virtual cycles. Emulated
+ * builds count nothing themselves, see below.
+ */
+#if defined(HOST) && !defined(SIM)
+#include <time.h>
+#elif !defined(EMU)
+#include <libopencm3/cm3/dwt.h>
+#endif
+
+#define PROF_AVG_SHIFT	4
+
+typedef enum {
+	PROF_REFRAME,
+	PROF_RMS,
+	PROF_CONV,
+	PROF_FILTER,
+	PROF_UPSAMPLE,
+	PROF_SIGMADELTA,
+	PROF_PUMP,
+	PROF_IDLE,
+	PROF_NUM
+} prof_stage;
+
+typedef struct {
+	uint32_t min;
+	uint32_t max;
+	uint32_t avg;		/* EWMA, 1/(1 << PROF_AVG_SHIFT) */
+	uint32_t n;
+	uint64_t acc;		/* idle: since prof_load(), rest: since reset */
+} prof_t;
+
+extern volatile prof_t prof[PROF_NUM];
+
+#ifdef EMU
+/*
+ * stage marks for emu/kprof.c qemu plugin, which watches stores
+ * here: [slot][PROF_NUM] starts, [slot][stage] ends a stage
+ * started in that slot; slot is picked off prof_time() result
+ */
+#define PROF_MARK_SLOTS	16
+
+extern volatile uint8_t prof_mark[PROF_MARK_SLOTS][PROF_NUM + 1];
+extern uint32_t prof_seq;
+#endif
+
+float prof_load(void);
+#ifdef HOST
+void prof_report(void);
+#endif
+
+static inline uint32_t prof_time(void)
+{
+#if defined(HOST) && !defined(SIM)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000u + ts.tv_nsec;
+#elif defined(EMU)
+	prof_mark[++prof_seq % PROF_MARK_SLOTS][PROF_NUM] = 1;
+	return prof_seq;
+#else
+	return DWT_CYCCNT;
+#endif
+}
+
+/*
+ * accounts stage started at t0, returns now, so next one can follow
+ */
+static inline uint32_t prof_end(prof_stage s, uint32_t t0)
+{
+#ifdef EMU
+	prof_mark[t0 % PROF_MARK_SLOTS][s] = 1;
+	return prof_time();
+#else
+	volatile prof_t *p = &prof[s];
+	uint32_t now = prof_time();
+	uint32_t t = now - t0;
+
+	if (!p->n++) {
+		p->min = p->max = p->avg = t;
+	} else {
+		if (t < p->min) p->min = t;
+		if (t > p->max) p->max = t;
+		p->avg += (int32_t)(t - p->avg) >> PROF_AVG_SHIFT;
+	}
+	p->acc += t;
+
+	return now;
+#endif
+}
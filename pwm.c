@@ -9,30 +9,93 @@
 #include <libopencm3/cm3/nvic.h>
 
 #include "common.h"
+#include "evq.h"
+#include "irq.h"
 
 #define PWM_DEADTIME 4
-#define DMABUFSZ (NCHANNELS * NFRAMES)
+#define BLOCKSZ (NCHANNELS * BFRAMES)
+#define DMABUFSZ (NBLOCKS * BLOCKSZ)
 
-static uint16_t dmabuf[2 * DMABUFSZ] __attribute__((aligned(4)));
+/*
+ * duty values are bytes, dma widens them to CCRx halfwords
+ */
+static uint8_t dmabuf[DMABUFSZ] __attribute__((aligned(4)));
 
 #define __DMA DMA1
 #define __DMA_STREAM DMA_CHANNEL1
 #define __DMA_IRQ NVIC_DMA1_CHANNEL1_IRQ
 #define __DMA_PRIO DMA_CCR_PL_VERY_HIGH
-#define __DMA_MSIZE DMA_CCR_MSIZE_16BIT
+#define __DMA_MSIZE DMA_CCR_MSIZE_8BIT
 #define __DMA_PSIZE DMA_CCR_PSIZE_16BIT
 #define __dma_isr dma1_channel1_isr
 
 extern volatile ev_t e;
 extern volatile cs_t cstate;
+extern volatile stats_t stats;
+extern volatile evq_t evq;
+
+static volatile uint32_t wraps;
+static volatile bool running;
+static uint32_t wblock;			/* next block to be rendered */
+
+/*
+ * output frames played so far; safe to call from isr at dma
+ * interrupt priority, when transfer complete may be left pending
+ */
+uint32_t __fastentry pwm_position(void)
+{
+	uint32_t w, w0;
+	uint16_t n;
+
+	do {
+		w = w0 = wraps;
+		n = dma_get_number_of_data(__DMA, __DMA_STREAM);
+		if (n > DMABUFSZ / 2 &&
+		    dma_get_interrupt_flag(__DMA, __DMA_STREAM, DMA_TCIF))
+			w++;
+	} while (w0 != wraps);
+
+	return w * NPAGES * NFRAMES + (DMABUFSZ - n) / NCHANNELS;
+}
 
-static volatile uint32_t dma_target;
-#define dma_get_target(x, y) (dma_target)
+/*
+ * next block to be rendered, or NULL if we're BLOCKS_AHEAD of the
+ * one being played already; blocks played before we got to them
+ * are counted as late and skipped
+ */
+uint8_t __fastentry *pframe(void)
+{
+	uint32_t rblock = pwm_position() / BFRAMES;
+
+	if (running && (int32_t)(wblock - rblock) <= 0) {
+		stats.late += rblock + 1 - wblock;
+		trace(5, rblock + 1 - wblock);
+		wblock = rblock + 1;
+	}
+
+	if (wblock - rblock > BLOCKS_AHEAD)
+		return NULL;
+
+	return &dmabuf[(wblock++ % NBLOCKS) * BLOCKSZ];
+}
+
+/*
+ * output frame block pframe() handed out last starts at,
+ * pwm_position() wise
+ */
+uint32_t pframe_pos(void)
+{
+	return (wblock - 1) * BFRAMES;
+}
 
-uint16_t *pframe(page_t page)
+/*
+ * nothing queued beyond the block being played,
+ * i.e. next one is due right now
+ */
+bool __fastentry pframe_due(void)
 {
-	return (page == dma_get_target(__DMA, __DMA_STREAM)) ?
-		dmabuf: &dmabuf[DMABUFSZ];
+	return running &&
+		(int32_t)(wblock - pwm_position() / BFRAMES) <= 1;
 }
 
 static void timer_tim1_setup_ocs(enum tim_oc_id oc, enum tim_oc_id ocn)
@@ -52,6 +115,32 @@ static void timer_tim1_setup_ocs(enum tim_oc_id oc, enum tim_oc_id ocn)
 	timer_enable_oc_output(TIM1, ocn);
 }
 
+#ifdef CHASE
+/*
+ * TIM8 counts TIM1 updates, i.e. output frames, off ITR0 and
+ * interrupts on every block boundary, so dsp chases dma read
+ * position a block at a time, with main loop left asleep
+ */
+static void pwm_blocks(void)
+{
+	timer_set_master_mode(TIM1, TIM_CR2_MMS_UPDATE);
+	timer_slave_set_mode(TIM8, TIM_SMCR_SMS_ECM1);
+	timer_slave_set_trigger(TIM8, TIM_SMCR_TS_ITR0);	/* TIM1 */
+	timer_set_period(TIM8, BFRAMES - 1);
+	timer_enable_irq(TIM8, TIM_DIER_UIE);
+	nvic_set_priority(NVIC_TIM8_UP_IRQ, IRQ_PRIO_PWM);
+	nvic_enable_irq(NVIC_TIM8_UP_IRQ);
+	timer_enable_counter(TIM8);
+}
+
+void __fastcode tim8_up_isr(void)
+{
+	timer_clear_flag(TIM8, TIM_SR_UIF);
+	if (e.state == STATE_RUNNING)
+		dsp_pend();
+}
+#endif
+
 void pwm()
 {
 	dma_enable_flex_mode(__DMA);
@@ -63,12 +152,13 @@ void pwm()
 	dma_enable_memory_increment_mode(__DMA, __DMA_STREAM);
 	dma_enable_circular_mode(__DMA, __DMA_STREAM);
 	dma_set_read_from_memory(__DMA, __DMA_STREAM);
-	dma_set_number_of_data(__DMA, __DMA_STREAM, 2 * DMABUFSZ);
+	dma_set_number_of_data(__DMA, __DMA_STREAM, DMABUFSZ);
 	dma_set_peripheral_address(__DMA, __DMA_STREAM, (uint32_t)&TIM_DMAR(TIM1));
 	dma_set_memory_address(__DMA, __DMA_STREAM, (uint32_t)dmabuf);
 	dma_enable_half_transfer_interrupt(__DMA, __DMA_STREAM);
 	dma_enable_transfer_complete_interrupt(__DMA, __DMA_STREAM);
 	dma_enable_channel(__DMA, __DMA_STREAM);
+	nvic_set_priority(__DMA_IRQ, IRQ_PRIO_PWM);
 	nvic_enable_irq(__DMA_IRQ);
 
 	timer_set_period(TIM1, PWM_PERIOD);
@@ -84,6 +174,9 @@ void pwm()
 	/* to:CCR1/2/3: len: 3  off: 0x34>>4=0xd */
 	TIM_DCR(TIM1) |= 2<<8 | 0xd;
 	timer_generate_event(TIM1, TIM_EGR_UG);
+#ifdef CHASE
+	pwm_blocks();
+#endif
 	timer_enable_irq(TIM1, TIM_DIER_UDE);
 }
 
@@ -91,7 +184,7 @@ void speaker()
 {
 	if (e.state == STATE_RUNNING && !cstate.on[spmuted]) {
 		gpio_clear(GPIOB, GPIO12);
-		if (cstate.on[boost])
+		if (cstate.on[boost] || nchannels(cstate.format) > 2)
 			gpio_clear(GPIOA, GPIO15);
 		else
 			gpio_set(GPIOA, GPIO15);
@@ -103,30 +196,57 @@ void speaker()
 
 void pwm_enable(void)
 {
+	running = true;
 	timer_enable_break_main_output(TIM1);
 	timer_enable_counter(TIM1);
 	speaker();
 }
 
-static void pwm_disable(void)
+/*
+ * stop, and rewind dma to buffer start, so next start
+ * plays blocks from the one pframe() will give first
+ */
+static void __fastcode pwm_disable(void)
 {
 	speaker();
 	timer_disable_counter(TIM1);
 	timer_disable_break_main_output(TIM1);
+	dma_disable_channel(__DMA, __DMA_STREAM);
+	dma_clear_interrupt_flags(__DMA, __DMA_STREAM, DMA_GIF);
+	dma_set_number_of_data(__DMA, __DMA_STREAM, DMABUFSZ);
+	dma_enable_channel(__DMA, __DMA_STREAM);
+#ifdef CHASE
+	timer_set_counter(TIM8, 0);	/* block ticks as rewound */
+#endif
+	wblock = ++wraps * NBLOCKS;
+	running = false;
 }
 
-void __dma_isr(void)
+/*
+ * half/complete: frames played past buffer half, plus timer
+ * count into current one, is time since dma raised the flag
+ */
+void __fastcode __dma_isr(void)
 {
-	dma_target = dma_get_interrupt_flag(__DMA, __DMA_STREAM, DMA_HTIF);
+	uint32_t pos, t0;
+
+	if (dma_get_interrupt_flag(__DMA, __DMA_STREAM, DMA_TCIF))
+		wraps++;
 	dma_clear_interrupt_flags(__DMA, __DMA_STREAM, DMA_GIF);
+	pos = pwm_position();
+	t0 = irq_enter(IRQ_PWM, ((pos % (NPAGES * NFRAMES / 2)) * PWM_PERIOD +
+				 timer_get_counter(TIM1)) * PWM_PRESCALER);
 	switch (e.state) {
 	case STATE_RUNNING:
-		e.seen = false;
+		ev_put(&evq, EV_BLOCK, (pos / BFRAMES) % NBLOCKS, pos);
+		dsp_pend();
 		break;
 	case STATE_DRAIN:
 		pwm_disable();
-		e.seen = false;
+		ev_put(&evq, EV_DRAIN, 0, pos);
+		dsp_pend();
 	default:
 		break;
 	};
+	irq_exit(IRQ_PWM, t0);
 }
@@ -0,0 +1,246 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2023 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include <string.h>
+#include "common.h"
+#include "screen.h"
+#include "icons.h"
+#include "font.h"
+
+#define SICONSZ		24	/* 24x24 px */
+#define LICONSZ		40	/* 40x40 px */
+
+/*
+ *
+ */
+static const icon iconrow[] = {
+	[spmuted]	= icon_headphones_box,
+	[boost]		= icon_subwoofer,
+	[muted]		= icon_volume_mute,
+	[sine]		= icon_sine_wave,
+	[usb]		= icon_usb
+};
+
+#define NICONS (sizeof(iconrow)/sizeof(iconrow[0]))
+
+#define BAR_START	4
+#define BAR_LEN		(DISP_PAGE_SIZE - 2 * BAR_START)
+
+unsigned screen_barlen(float f)
+{
+	return MIN((unsigned)(BAR_LEN * f), BAR_LEN - 1);
+}
+
+static void disp_draw_bar(uint8_t *dst, uint8_t c, unsigned barlen)
+{
+	unsigned len = barlen / 2;
+	uint16_t *p = (uint16_t *)dst;
+	while (len--) *p++ = (uint16_t)c << 8;
+}
+
+static void disp_draw_icon(uint8_t *dst, icon ico, uint16_t page)
+{
+	const char *src = icons[ico].p + page;
+	unsigned iconsz = icons[ico].h;
+	for (unsigned i=0; i<iconsz; i++) {
+		*dst++ = *src;
+		src += iconsz / 8;
+	}
+}
+
+static void disp_draw_char(uint8_t *dst, uint16_t c, uint16_t page)
+{
+	const uint8_t *src = font_bits + font_height * c + font_width * (1 - page);
+	memcpy(dst, src, font_width);
+}
+
+static void disp_draw_string(uint8_t *dst, const char *s, uint16_t page)
+{
+	while (*s) {
+		disp_draw_char(dst, *s++, page);
+		dst += font_width;
+	}
+}
+
+static const char * const vol_strings[] = {
+	" 0 ", "-1 ", "-2 ", "-3 ", "-4 ", "-5 ", "-6 ", "-7 ",
+	"-8 ", "-9 ", "-10", "-11", "-12", "-13", "-14", "-15",
+	"-16", "-17", "-18", "-19", "-20", "-21", "-22", "-23",
+	"-24", "-25", "-26", "-27", "-28", "-29", "-30", "-31",
+	"-32", "-33", "-34", "-35", "-36", "-37", "-38", "-39",
+	"-40", "-41", "-42", "-43", "-44", "-45", "-46", "-47",
+	"-48", "-49", "-50", "-51", "-52", "-53", "-54", "-55",
+	"-56", "-57", "-58", "-59", "-60"
+};
+
+static const char * const fmt_strings[] = {
+	[SAMPLE_FORMAT_NONE]	= "-:-",
+	[SAMPLE_FORMAT_S16]	= "S16",
+	[SAMPLE_FORMAT_S24]	= "S24",
+	[SAMPLE_FORMAT_S32]	= "S32",
+	[SAMPLE_FORMAT_F32]	= "F32",
+	[SAMPLE_FORMAT_S16_LFE]	= "16S",
+	[SAMPLE_FORMAT_S24_LFE]	= "24S"
+};
+
+static const char * rate_strings(sample_rate rate)
+{
+	const struct {
+		sample_rate rate;
+		const char *s;
+	} strings[] = {
+		{ .rate = SAMPLE_RATE_44100, .s = "44k" },
+		{ .rate = SAMPLE_RATE_48000, .s = "48k" },
+		{ .rate = SAMPLE_RATE_88200, .s = "88k" },
+		{ .rate = SAMPLE_RATE_96000, .s = "96k" },
+		{ .rate = SAMPLE_RATE_NONE,  .s = "-:-" }
+	}, *rs = strings;
+
+	while (rs->rate && rs->rate != rate) rs++;
+	return rs->s;
+}
+
+/*
+ * latency in place of dB: label, 4 chars at most
+ */
+static void lat_string(char *dst, uint16_t lat)
+{
+	if (lat == SCREEN_LAT_NONE) {
+		strcpy(dst, "-.-");
+		return;
+	}
+	lat = MIN(lat, 999);
+	if (lat > 99)
+		*dst++ = '0' + lat / 100;
+	*dst++ = '0' + lat / 10 % 10;
+	*dst++ = '.';
+	*dst++ = '0' + lat % 10;
+	*dst = 0;
+}
+
+/*
+ * renders page of both displays' screen out of s alone
+ */
+void screen_page(uint8_t *dst, unsigned page, const screen_t *s)
+{
+	bzero(dst, DISP_PAGE_SIZE);
+
+	switch (page) {
+	case 0 ... 2:
+		for (unsigned i=0; i<NICONS; i++)
+			if (s->on[i])
+				disp_draw_icon(dst + i * (SICONSZ + 2),
+					       iconrow[i], page);
+		break;
+	case 3 ... 7:
+		disp_draw_icon(dst + LICONSZ,
+			       s->running ? icon_play : icon_pause,
+			       page - 3);
+		if (page > 5) {
+			char ms[5];
+
+			if (s->lat)
+				lat_string(ms, s->lat);
+			disp_draw_string(dst + 4, s->lat ? ms : "dB:", page - 6);
+			disp_draw_string(dst + 100,
+					 rate_strings(s->rate), page - 6);
+		}
+		else if (page > 3) {
+			disp_draw_string(dst + 4,
+					 vol_strings[s->attn], page - 4);
+			disp_draw_string(dst + 100,
+					 fmt_strings[s->format], page - 4);
+		}
+		break;
+	case 8:
+		disp_draw_bar(dst + BAR_START, 0x1c, s->load);
+		break;
+	case 9:
+		disp_draw_bar(dst + BAR_START, 0xff, s->rms[1]);
+		dst[BAR_START + s->peak[1]] = 0x55;
+		break;
+	case 10:
+		disp_draw_bar(dst + BAR_START, 0x7f, s->rms[1]);
+		dst[BAR_START + s->peak[1]] = 0x55;
+		break;
+	case 11:
+		disp_draw_bar(dst + BAR_START, 0x70, s->vol);
+		break;
+	case 12:
+		disp_draw_bar(dst + BAR_START, 0x0e, s->vol);
+		break;
+	case 13:
+		disp_draw_bar(dst + BAR_START, 0xfe, s->rms[0]);
+		dst[BAR_START + s->peak[0]] = 0xaa;
+		break;
+	case 14:
+		disp_draw_bar(dst + BAR_START, 0xff, s->rms[0]);
+		dst[BAR_START + s->peak[0]] = 0xaa;
+	default:
+		break;
+	}
+
+	switch (page) {
+	case 0:
+	case 8:
+		for (unsigned i=0; i<DISP_PAGE_SIZE; i++)
+			dst[i] |= 0x01;
+		break;
+	case 7:
+	case 15:
+		for (unsigned i=0; i<DISP_PAGE_SIZE; i++)
+			dst[i] |= 0x80;
+	default:
+		break;
+	}
+
+	dst[0] = dst[DISP_PAGE_SIZE - 1] = 0xff;
+}
+
+/*
+ * pages to redraw going from a to b, bit per page
+ */
+uint32_t screen_dirty(const screen_t *a, const screen_t *b)
+{
+	uint32_t dirty = 0;
+
+#define PAGES(from, to) (((1U << ((to) + 1)) - 1) & ~((1U << (from)) - 1))
+	if (memcmp(a->on, b->on, sizeof(a->on)))
+		dirty |= PAGES(0, 2);
+	if (a->running != b->running)
+		dirty |= PAGES(3, 7);
+	if (a->attn != b->attn || a->format != b->format)
+		dirty |= PAGES(4, 5);
+	if (a->rate != b->rate || a->lat != b->lat)
+		dirty |= PAGES(6, 7);
+	if (a->load != b->load)
+		dirty |= PAGES(8, 8);
+	if (a->rms[1] != b->rms[1] || a->peak[1] != b->peak[1])
+		dirty |= PAGES(9, 10);
+	if (a->vol != b->vol)
+		dirty |= PAGES(11, 12);
+	if (a->rms[0] != b->rms[0] || a->peak[0] != b->peak[0])
+		dirty |= PAGES(13, 14);
+#undef PAGES
+
+	return dirty;
+}
+
+#ifdef HOST
+/*
+ * plain pbm of one display, as the panel shows it:
+ * page byte is a column of 8 pixels, lsb on top
+ */
+void screen_pbm(FILE *f, uint8_t fb[][DISP_PAGE_SIZE], unsigned disp)
+{
+	fprintf(f, "P1\n%d %d\n", DISP_X, DISP_Y);
+	for (unsigned y = 0; y < DISP_Y; y++) {
+		const uint8_t *row = fb[disp * DISP_PAGE_NUM + y / 8];
+		for (unsigned x = 0; x < DISP_X; x++)
+			fputc(row[x] >> (y % 8) & 1 ? '1' : '0', f);
+		fputc('\n', f);
+	}
+}
+#endif
@@ -0,0 +1,38 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2023 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#define DISP_X		128
+#define DISP_Y		64
+#define DISP_PAGE_NUM	(DISP_Y / 8)
+#define DISP_PAGE_SIZE	(DISP_X)
+#define DISPNUM		2
+#define SCREEN_PAGES	(DISPNUM * DISP_PAGE_NUM)
+
+/*
+ * what's shown, bars are in pixels already, so that
+ * small changes of levels don't make pages dirty
+ */
+typedef struct {
+	bool on[sw_num];
+	bool running;
+	uint16_t attn;
+	sample_fmt format;
+	sample_rate rate;
+	uint8_t rms[2];
+	uint8_t peak[2];
+	uint8_t vol;
+	uint8_t load;
+	uint16_t lat;		/* 1/10 ms, SCREEN_LAT_NONE armed, 0 off */
+} screen_t;
+
+#define SCREEN_LAT_NONE	UINT16_MAX
+
+unsigned screen_barlen(float f);
+uint32_t screen_dirty(const screen_t *a, const screen_t *b);
+void screen_page(uint8_t *dst, unsigned page, const screen_t *s);
+#ifdef HOST
+#include <stdio.h>
+void screen_pbm(FILE *f, uint8_t fb[][DISP_PAGE_SIZE], unsigned disp);
+#endif
@@ -0,0 +1,494 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  peripheral models: just enough timer, dma, spi and gpio
+ *  behaviour for firmware to see the same timing it does on target
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim/hal.h"
+#include "sim/sim.h"
+
+volatile uint32_t sim_reg[SIM_NPERIPH][SIM_NREGS];
+
+uint32_t rcc_ahb_frequency = 8000000;
+double hal_xtal_ppm;
+
+/*
+ * what ahb clock really is, crystal error included
+ */
+double hal_hz(void)
+{
+	return rcc_ahb_frequency * (1 + hal_xtal_ppm * 1e-6);
+}
+
+/*
+ * spi4 runs off apb2 / 64, i.e. ahb / 128: 1024 cycles a byte
+ */
+#define SPI_BYTE_CYCLES	1024
+
+static struct {
+	uint32_t arr;
+	uint32_t psc;
+	uint32_t cnt;
+	uint32_t dier;
+	bool on;
+	double t0;		/* last update */
+} tim[SIM_NPERIPH];
+
+static struct {
+	uint16_t ndt;
+	uint32_t flags;
+	bool en;
+	bool htie;
+	bool tcie;
+} dma[2][SIM_NDMACH];
+
+#define DMA_CH(d, c)	(dma[(d) == DMA2][(c) - 1])
+
+static uint16_t gpio_level[SIM_NPERIPH];
+static uint32_t systick_reload;
+static bool systick_ie, systick_on;
+
+/*
+ * pwm: TIM1 update requests a DMA1 CH1 burst each frame, once both
+ * are on; frames counted since channel got its transfer count
+ */
+static struct {
+	bool running;
+	double f0;		/* frames done by t0 */
+	double t0;
+	uint64_t half;		/* next half buffer boundary */
+} pwm;
+
+static unsigned pwm_burst(void)
+{
+	return ((TIM_DCR(TIM1) >> 8) & 0x1f) + 1;
+}
+
+static double pwm_hz(void)
+{
+	return hal_hz() / hal_frame_cycles();
+}
+
+/*
+ * nudged up, so that boundary scheduled as a whole frame count
+ * is always past when it fires
+ */
+static double pwm_frames(void)
+{
+	return pwm.running ?
+		pwm.f0 + (sim_t - pwm.t0) * pwm_hz() + 1e-6 : pwm.f0;
+}
+
+static uint64_t pwm_transfers(void)
+{
+	return (uint64_t)pwm_frames() * pwm_burst();
+}
+
+uint32_t hal_frame_cycles(void)
+{
+	return tim[TIM1].arr * (tim[TIM1].psc + 1);
+}
+
+static void pwm_fire(void);
+static void blocks_schedule(void);
+
+/*
+ * next half buffer boundary
+ */
+static void pwm_schedule(void)
+{
+	uint32_t half = DMA_CH(DMA1, DMA_CHANNEL1).ndt / 2;
+	double frames;
+
+	if (!pwm.running || !half) {
+		sim_cancel(SRC_PWM);
+		return;
+	}
+
+	pwm.half = pwm_transfers() / half + 1;
+	frames = ceil((double)(pwm.half * half) / pwm_burst());
+	sim_at(SRC_PWM, pwm.t0 + (frames - pwm.f0) / pwm_hz(), pwm_fire);
+}
+
+static void pwm_fire(void)
+{
+	typeof(dma[0][0]) *ch = &DMA_CH(DMA1, DMA_CHANNEL1);
+
+	if (pwm.half & 1) {
+		ch->flags |= DMA_GIF | DMA_HTIF;
+		if (ch->htie) sim_pend(NVIC_DMA1_CHANNEL1_IRQ);
+	} else {
+		ch->flags |= DMA_GIF | DMA_TCIF;
+		if (ch->tcie) sim_pend(NVIC_DMA1_CHANNEL1_IRQ);
+	}
+	pwm_schedule();
+}
+
+/*
+ * re-evaluate after anything pwm depends on has changed
+ */
+static void pwm_update(void)
+{
+	bool run = tim[TIM1].on && (tim[TIM1].dier & TIM_DIER_UDE) &&
+		DMA_CH(DMA1, DMA_CHANNEL1).en;
+
+	pwm.f0 = pwm_frames();
+	pwm.t0 = sim_t;
+	pwm.running = run;
+	pwm_schedule();
+	blocks_schedule();
+}
+
+/*
+ * rcc, crs: clock switch keeps pwm position, rate changes after
+ */
+void rcc_clock_setup_pll(const struct rcc_clock_scale *clock)
+{
+	pwm_update();
+	rcc_ahb_frequency = clock->ahb_frequency;
+	pwm_update();
+}
+
+void rcc_periph_clock_enable(uint32_t clken) { (void)clken; }
+void rcc_periph_reset_pulse(uint32_t rst) { (void)rst; }
+void rcc_set_sysclk_source(uint32_t clk) { (void)clk; }
+void rcc_osc_off(uint32_t osc) { (void)osc; }
+bool rcc_is_osc_ready(uint32_t osc) { (void)osc; return false; }
+void rcc_set_hsi_div(uint32_t div) { (void)div; }
+void rcc_set_hsi_sclk(uint32_t sclk) { (void)sclk; }
+void rcc_set_usb_clock_source(uint32_t osc) { (void)osc; }
+void rcc_usb_alt_pma_enable(void) {}
+void rcc_usb_alt_isr_enable(void) {}
+void crs_autotrim_usb_enable(void) {}
+
+/*
+ * systick
+ */
+static void systick_fire(void)
+{
+	if (systick_ie) sim_pend(NVIC_SYSTICK_IRQ);
+	sim_at(SRC_SYSTICK, sim_t + systick_reload / hal_hz(),
+	       systick_fire);
+}
+
+void systick_set_clocksource(uint8_t clocksource) { (void)clocksource; }
+void systick_set_reload(uint32_t value) { systick_reload = value; }
+void systick_interrupt_enable(void) { systick_ie = true; }
+
+void systick_counter_enable(void)
+{
+	if (systick_on) return;
+	systick_on = true;
+	systick_fire();
+}
+
+/*
+ * gpio
+ */
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios)
+{
+	(void)gpioport; (void)mode; (void)cnf; (void)gpios;
+}
+
+void gpio_set_mux(uint32_t mux) { (void)mux; }
+void gpio_set(uint32_t gpioport, uint16_t gpios) { gpio_level[gpioport] |= gpios; }
+void gpio_clear(uint32_t gpioport, uint16_t gpios) { gpio_level[gpioport] &= ~gpios; }
+void gpio_toggle(uint32_t gpioport, uint16_t gpios) { gpio_level[gpioport] ^= gpios; }
+
+uint16_t gpio_get(uint32_t gpioport, uint16_t gpios)
+{
+	return gpio_level[gpioport] & gpios;
+}
+
+/*
+ * timers: TIM1 is pwm, TIM4 ticks display and clocks TIM3 as page
+ * counter, TIM2 is encoder and never moves; TIM8, CHASE builds,
+ * counts TIM1 updates, i.e. pwm frames, from where count was 0
+ */
+static double tim8_f0;
+
+static void blocks_fire(void);
+
+static void blocks_schedule(void)
+{
+	double per = tim[TIM8].arr + 1, f;
+
+	if (!tim[TIM8].on || !pwm.running) {
+		sim_cancel(SRC_BLOCK);
+		return;
+	}
+
+	f = tim8_f0 + (floor((pwm_frames() - tim8_f0) / per) + 1) * per;
+	sim_at(SRC_BLOCK, pwm.t0 + (f - pwm.f0) / pwm_hz(), blocks_fire);
+}
+
+static void blocks_fire(void)
+{
+	if (tim[TIM8].dier & TIM_DIER_UIE)
+		sim_pend(NVIC_TIM8_UP_IRQ);
+	blocks_schedule();
+}
+
+static double tim_period(uint32_t timer)
+{
+	return (double)tim[timer].arr * (tim[timer].psc + 1) / hal_hz();
+}
+
+static void disp_tick(void)
+{
+	tim[TIM4].t0 = sim_t;
+	if (tim[TIM4].dier & TIM_DIER_UIE)
+		sim_pend(NVIC_TIM4_IRQ);
+
+	if (tim[TIM3].on && ++tim[TIM3].cnt > tim[TIM3].arr) {
+		tim[TIM3].cnt = 0;
+		if (tim[TIM3].dier & TIM_DIER_UIE)
+			sim_pend(NVIC_TIM3_IRQ);
+	}
+
+	sim_at(SRC_DISP_TICK, sim_t + tim_period(TIM4), disp_tick);
+}
+
+void timer_set_period(uint32_t timer, uint32_t period) { tim[timer].arr = period; }
+void timer_set_prescaler(uint32_t timer, uint32_t value) { tim[timer].psc = value; }
+
+void timer_set_counter(uint32_t timer, uint32_t count)
+{
+	tim[timer].cnt = count;
+	if (timer == TIM8) {
+		tim8_f0 = pwm_frames() - count;
+		blocks_schedule();
+	}
+}
+
+uint32_t timer_get_counter(uint32_t timer)
+{
+	switch (timer) {
+	case TIM1:
+		return fmod(pwm_frames(), 1.0) * tim[TIM1].arr;
+	case TIM4:
+		return (sim_t - tim[TIM4].t0) * hal_hz() /
+			(tim[TIM4].psc + 1);
+	case TIM8:
+		return fmod(pwm_frames() - tim8_f0, tim[TIM8].arr + 1);
+	default:
+		return tim[timer].cnt;
+	}
+}
+
+void timer_enable_counter(uint32_t timer)
+{
+	if (tim[timer].on) return;
+	tim[timer].on = true;
+	tim[timer].t0 = sim_t;
+
+	if (timer == TIM1)
+		pwm_update();
+	else if (timer == TIM4)
+		sim_at(SRC_DISP_TICK, sim_t + tim_period(TIM4), disp_tick);
+	else if (timer == TIM8)
+		timer_set_counter(TIM8, tim[TIM8].cnt);
+}
+
+void timer_disable_counter(uint32_t timer)
+{
+	tim[timer].on = false;
+
+	if (timer == TIM1)
+		pwm_update();
+	else if (timer == TIM4)
+		sim_cancel(SRC_DISP_TICK);
+	else if (timer == TIM8)
+		blocks_schedule();
+}
+
+void timer_enable_irq(uint32_t timer, uint32_t irq)
+{
+	tim[timer].dier |= irq;
+	if (timer == TIM1) pwm_update();
+}
+
+void timer_clear_flag(uint32_t timer, uint32_t flag) { (void)timer; (void)flag; }
+void timer_generate_event(uint32_t timer, uint32_t event) { (void)timer; (void)event; }
+void timer_enable_preload(uint32_t timer) { (void)timer; }
+void timer_set_deadtime(uint32_t timer, uint32_t deadtime) { (void)timer; (void)deadtime; }
+void timer_set_enabled_off_state_in_idle_mode(uint32_t timer) { (void)timer; }
+void timer_set_enabled_off_state_in_run_mode(uint32_t timer) { (void)timer; }
+void timer_disable_break(uint32_t timer) { (void)timer; }
+void timer_enable_break_main_output(uint32_t timer) { (void)timer; }
+void timer_disable_break_main_output(uint32_t timer) { (void)timer; }
+void timer_set_master_mode(uint32_t timer, uint32_t mode) { (void)timer; (void)mode; }
+void timer_slave_set_mode(uint32_t timer, uint8_t mode) { (void)timer; (void)mode; }
+void timer_slave_set_trigger(uint32_t timer, uint8_t trigger) { (void)timer; (void)trigger; }
+void timer_slave_set_filter(uint32_t timer, uint8_t filter) { (void)timer; (void)filter; }
+void timer_disable_oc_clear(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+void timer_enable_oc_preload(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+void timer_set_oc_slow_mode(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+
+void timer_set_oc_mode(uint32_t timer, enum tim_oc_id oc_id, enum tim_oc_mode oc_mode)
+{
+	(void)timer; (void)oc_id; (void)oc_mode;
+}
+
+void timer_set_oc_polarity_high(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+void timer_set_oc_polarity_low(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+void timer_set_oc_idle_state_set(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+
+void timer_set_oc_value(uint32_t timer, enum tim_oc_id oc_id, uint32_t value)
+{
+	(void)timer; (void)oc_id; (void)value;
+}
+
+void timer_enable_oc_output(uint32_t timer, enum tim_oc_id oc_id) { (void)timer; (void)oc_id; }
+
+/*
+ * spi: polled bytes cost their wire time, dma ones complete after it
+ */
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+		    uint32_t dff, uint32_t lsbfirst)
+{
+	(void)spi; (void)br; (void)cpol; (void)cpha; (void)dff; (void)lsbfirst;
+	return 0;
+}
+
+void spi_set_bidirectional_transmit_only_mode(uint32_t spi) { (void)spi; }
+void spi_enable_software_slave_management(uint32_t spi) { (void)spi; }
+void spi_set_nss_high(uint32_t spi) { (void)spi; }
+void spi_enable(uint32_t spi) { (void)spi; }
+
+void spi_send(uint32_t spi, uint16_t data)
+{
+	SPI_DR(spi) = data;
+	sim_advance(SPI_BYTE_CYCLES);
+}
+
+static void spi_dma_fire(void)
+{
+	typeof(dma[0][0]) *ch = &DMA_CH(DMA2, DMA_CHANNEL1);
+
+	ch->flags |= DMA_GIF | DMA_TCIF;
+	ch->ndt = 0;
+	if (ch->tcie) sim_pend(NVIC_DMA2_CHANNEL1_IRQ);
+}
+
+void spi_enable_tx_dma(uint32_t spi)
+{
+	typeof(dma[0][0]) *ch = &DMA_CH(DMA2, DMA_CHANNEL1);
+
+	(void)spi;
+	if (ch->en)
+		sim_at(SRC_DISP_DMA, sim_t + ch->ndt * SPI_BYTE_CYCLES / hal_hz(),
+		       spi_dma_fire);
+}
+
+void spi_disable_tx_dma(uint32_t spi)
+{
+	(void)spi;
+}
+
+/*
+ * dma: DMA1 CH1 is pwm, DMA2 CH1 is display
+ */
+void dma_enable_flex_mode(uint32_t dma_) { (void)dma_; }
+
+void dma_channel_reset(uint32_t dma_, uint8_t channel)
+{
+	typeof(dma[0][0]) *ch = &DMA_CH(dma_, channel);
+
+	ch->ndt = ch->flags = 0;
+	ch->en = ch->htie = ch->tcie = false;
+}
+
+void dma_set_channel_request(uint32_t dma_, uint8_t channel, uint32_t request)
+{
+	(void)dma_; (void)channel; (void)request;
+}
+
+void dma_set_priority(uint32_t dma_, uint8_t channel, uint32_t prio)
+{
+	(void)dma_; (void)channel; (void)prio;
+}
+
+void dma_set_memory_size(uint32_t dma_, uint8_t channel, uint32_t mem_size)
+{
+	(void)dma_; (void)channel; (void)mem_size;
+}
+
+void dma_set_peripheral_size(uint32_t dma_, uint8_t channel, uint32_t peripheral_size)
+{
+	(void)dma_; (void)channel; (void)peripheral_size;
+}
+
+void dma_enable_memory_increment_mode(uint32_t dma_, uint8_t channel) { (void)dma_; (void)channel; }
+void dma_enable_circular_mode(uint32_t dma_, uint8_t channel) { (void)dma_; (void)channel; }
+void dma_set_read_from_memory(uint32_t dma_, uint8_t channel) { (void)dma_; (void)channel; }
+
+void dma_set_number_of_data(uint32_t dma_, uint8_t channel, uint16_t number)
+{
+	DMA_CH(dma_, channel).ndt = number;
+	if (dma_ == DMA1) {
+		pwm.f0 = 0;
+		pwm.t0 = sim_t;
+		pwm_schedule();
+		blocks_schedule();
+	}
+}
+
+uint16_t dma_get_number_of_data(uint32_t dma_, uint8_t channel)
+{
+	typeof(dma[0][0]) *ch = &DMA_CH(dma_, channel);
+
+	if (dma_ == DMA1 && ch->ndt)
+		return ch->ndt - pwm_transfers() % ch->ndt;
+	return ch->ndt;
+}
+
+void dma_set_peripheral_address(uint32_t dma_, uint8_t channel, uint32_t address)
+{
+	(void)dma_; (void)channel; (void)address;
+}
+
+void dma_set_memory_address(uint32_t dma_, uint8_t channel, uint32_t address)
+{
+	(void)dma_; (void)channel; (void)address;
+}
+
+void dma_enable_half_transfer_interrupt(uint32_t dma_, uint8_t channel)
+{
+	DMA_CH(dma_, channel).htie = true;
+}
+
+void dma_enable_transfer_complete_interrupt(uint32_t dma_, uint8_t channel)
+{
+	DMA_CH(dma_, channel).tcie = true;
+}
+
+void dma_enable_channel(uint32_t dma_, uint8_t channel)
+{
+	DMA_CH(dma_, channel).en = true;
+	if (dma_ == DMA1) pwm_update();
+}
+
+void dma_disable_channel(uint32_t dma_, uint8_t channel)
+{
+	DMA_CH(dma_, channel).en = false;
+	if (dma_ == DMA1) pwm_update();
+}
+
+bool dma_get_interrupt_flag(uint32_t dma_, uint8_t channel, uint32_t interrupts)
+{
+	return DMA_CH(dma_, channel).flags & interrupts;
+}
+
+void dma_clear_interrupt_flags(uint32_t dma_, uint8_t channel, uint32_t interrupts)
+{
+	if (interrupts & DMA_GIF)
+		interrupts = DMA_GIF | DMA_TCIF | DMA_HTIF;
+	DMA_CH(dma_, channel).flags &= ~interrupts;
+}
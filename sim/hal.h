@@ -0,0 +1,289 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * mock libopencm3 for the simulator: just what firmware uses,
+ * stm32/cm3 headers under sim/include all land here. Peripherals
+ * are small integers, registers firmware touches directly are
+ * plain variables; timing comes off the virtual clock in sim.c.
+ * usb headers are the real ones, see sim/usb.c
+ */
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * peripherals, registers
+ */
+enum {
+	SIM_NONE,
+	TIM1, TIM2, TIM3, TIM4, TIM8,
+	SPI4,
+	DMA1, DMA2,
+	GPIOA, GPIOB, GPIOC,
+	SIM_NPERIPH
+};
+
+enum { SIM_DCR, SIM_DMAR, SIM_CCER, SIM_DR, SIM_NREGS };
+extern volatile uint32_t sim_reg[SIM_NPERIPH][SIM_NREGS];
+
+#define TIM_DCR(t)		sim_reg[t][SIM_DCR]
+#define TIM_DMAR(t)		sim_reg[t][SIM_DMAR]
+#define TIM_CCER(t)		sim_reg[t][SIM_CCER]
+#define SPI_DR(s)		sim_reg[s][SIM_DR]
+#define SPI_SR(s)		(SPI_SR_TXE)	/* spi_send() is instant */
+
+/*
+ * cm3: cycle counter is virtual clock, PendSV is pended through
+ * ICSR as on target and picked up at next dispatch
+ */
+extern volatile uint32_t sim_icsr;
+uint32_t sim_cycles(void);
+void sim_wfi(void);
+
+#define DWT_CYCCNT		sim_cycles()
+#define SCB_ICSR		sim_icsr
+#define SCB_ICSR_PENDSVSET	(1 << 28)
+
+/*
+ * itm, DEBUG builds: trace enable bits are a plain variable,
+ * stimulus port words go to itm_send() host side provides
+ */
+extern volatile uint32_t sim_itm_ter[1];
+
+#define ITM_TER			sim_itm_ter
+
+void cm_disable_interrupts(void);
+void cm_enable_interrupts(void);
+uint32_t cm_mask_interrupts(uint32_t mask);
+bool dwt_enable_cycle_counter(void);
+
+/*
+ * nvic
+ */
+enum {
+	NVIC_DMA1_CHANNEL1_IRQ,
+	NVIC_DMA2_CHANNEL1_IRQ,
+	NVIC_TIM3_IRQ,
+	NVIC_TIM4_IRQ,
+	NVIC_USB_LP_IRQ,
+	NVIC_TIM8_UP_IRQ,
+	NVIC_SYSTICK_IRQ,
+	NVIC_PENDSV_IRQ,
+	SIM_NIRQ
+};
+
+void nvic_set_priority(uint8_t irqn, uint8_t priority);
+void nvic_enable_irq(uint8_t irqn);
+
+/*
+ * systick
+ */
+#define STK_CSR_CLKSOURCE_AHB	1
+
+void systick_set_clocksource(uint8_t clocksource);
+void systick_set_reload(uint32_t value);
+void systick_interrupt_enable(void);
+void systick_counter_enable(void);
+
+/*
+ * rcc, crs
+ */
+struct rcc_clock_scale {
+	uint32_t hse_xtpre;
+	uint32_t pll_mul;
+	uint32_t pll_source;
+	uint32_t hpre;
+	uint32_t ppre1;
+	uint32_t ppre2;
+	uint32_t ahb_frequency;
+	uint32_t apb1_frequency;
+	uint32_t apb2_frequency;
+};
+
+enum {
+	RCC_AFIO = 1, RCC_CRS, RCC_DMA1, RCC_DMA2, RCC_GPIOA, RCC_GPIOB,
+	RCC_GPIOC, RCC_SPI4, RCC_TIM1, RCC_TIM2, RCC_TIM3, RCC_TIM4,
+	RCC_TIM8, RCC_USB, RST_SPI4
+};
+enum { RCC_HSI = 1, RCC_PLL };
+
+#define RCC_CFGR_PLLXTPRE_HSE_CLK_PREDIV	0
+#define RCC_CFGR_PLLRANGE_HIGH			0
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL56		56
+#define RCC_CFGR_PLLMUL_PLL_CLK_MUL61		61
+#define RCC_CFGR_PLLSRC_HSE_CLK			0
+#define RCC_CFGR_HPRE_NODIV			0
+#define RCC_CFGR_PPRE_DIV2			0
+#define RCC_CFGR_SW_SYSCLKSEL_HSICLK		0
+#define RCC_CFGR3_HSIDIV_NODIV			0
+#define RCC_CFGR5_HSI_SCLK_HSIDIV		0
+
+extern uint32_t rcc_ahb_frequency;
+
+void rcc_clock_setup_pll(const struct rcc_clock_scale *clock);
+void rcc_periph_clock_enable(uint32_t clken);
+void rcc_periph_reset_pulse(uint32_t rst);
+void rcc_set_sysclk_source(uint32_t clk);
+void rcc_osc_off(uint32_t osc);
+bool rcc_is_osc_ready(uint32_t osc);
+void rcc_set_hsi_div(uint32_t div);
+void rcc_set_hsi_sclk(uint32_t sclk);
+void rcc_set_usb_clock_source(uint32_t osc);
+void rcc_usb_alt_pma_enable(void);
+void rcc_usb_alt_isr_enable(void);
+void crs_autotrim_usb_enable(void);
+
+/*
+ * gpio: one level per pin, what was set or cleared last
+ */
+#define GPIO0			(1 << 0)
+#define GPIO1			(1 << 1)
+#define GPIO2			(1 << 2)
+#define GPIO3			(1 << 3)
+#define GPIO4			(1 << 4)
+#define GPIO5			(1 << 5)
+#define GPIO6			(1 << 6)
+#define GPIO7			(1 << 7)
+#define GPIO8			(1 << 8)
+#define GPIO9			(1 << 9)
+#define GPIO10			(1 << 10)
+#define GPIO11			(1 << 11)
+#define GPIO12			(1 << 12)
+#define GPIO13			(1 << 13)
+#define GPIO14			(1 << 14)
+#define GPIO15			(1 << 15)
+
+#define GPIO_MODE_INPUT			0
+#define GPIO_MODE_OUTPUT_10_MHZ		1
+#define GPIO_MODE_OUTPUT_2_MHZ		2
+#define GPIO_MODE_OUTPUT_50_MHZ		3
+#define GPIO_CNF_INPUT_FLOAT		1
+#define GPIO_CNF_INPUT_PULL_UPDOWN	2
+#define GPIO_CNF_OUTPUT_PUSHPULL	0
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	2
+#define AFIO_GMUX_SWJ_NO_JTAG		1
+#define AFIO_GMUX_TIM3_B4		2
+#define AFIO_GMUX_SPI4_B6		3
+
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios);
+void gpio_set_mux(uint32_t mux);
+void gpio_set(uint32_t gpioport, uint16_t gpios);
+void gpio_clear(uint32_t gpioport, uint16_t gpios);
+void gpio_toggle(uint32_t gpioport, uint16_t gpios);
+uint16_t gpio_get(uint32_t gpioport, uint16_t gpios);
+
+/*
+ * timers
+ */
+enum tim_oc_id {
+	TIM_OC1, TIM_OC1N, TIM_OC2, TIM_OC2N, TIM_OC3, TIM_OC3N, TIM_OC4
+};
+enum tim_oc_mode { TIM_OCM_PWM1 = 6 };
+
+#define TIM_CCER_CC1P			(1 << 1)
+#define TIM_CCER_CC2P			(1 << 5)
+#define TIM_DIER_UIE			(1 << 0)
+#define TIM_DIER_UDE			(1 << 8)
+#define TIM_SR_UIF			(1 << 0)
+#define TIM_EGR_UG			(1 << 0)
+#define TIM_CR2_MMS_UPDATE		(2 << 4)
+#define TIM_CR2_MMS_COMPARE_OC1REF	(4 << 4)
+#define TIM_SMCR_SMS_EM1		1
+#define TIM_SMCR_SMS_ECM1		7
+#define TIM_SMCR_TS_ITR0		(0 << 4)
+#define TIM_SMCR_TS_ITR3		(3 << 4)
+
+void timer_set_period(uint32_t timer, uint32_t period);
+void timer_set_prescaler(uint32_t timer, uint32_t value);
+void timer_set_counter(uint32_t timer, uint32_t count);
+uint32_t timer_get_counter(uint32_t timer);
+void timer_enable_counter(uint32_t timer);
+void timer_disable_counter(uint32_t timer);
+void timer_enable_irq(uint32_t timer, uint32_t irq);
+void timer_clear_flag(uint32_t timer, uint32_t flag);
+void timer_generate_event(uint32_t timer, uint32_t event);
+void timer_enable_preload(uint32_t timer);
+void timer_set_deadtime(uint32_t timer, uint32_t deadtime);
+void timer_set_enabled_off_state_in_idle_mode(uint32_t timer);
+void timer_set_enabled_off_state_in_run_mode(uint32_t timer);
+void timer_disable_break(uint32_t timer);
+void timer_enable_break_main_output(uint32_t timer);
+void timer_disable_break_main_output(uint32_t timer);
+void timer_set_master_mode(uint32_t timer, uint32_t mode);
+void timer_slave_set_mode(uint32_t timer, uint8_t mode);
+void timer_slave_set_trigger(uint32_t timer, uint8_t trigger);
+void timer_slave_set_filter(uint32_t timer, uint8_t filter);
+void timer_disable_oc_clear(uint32_t timer, enum tim_oc_id oc_id);
+void timer_enable_oc_preload(uint32_t timer, enum tim_oc_id oc_id);
+void timer_set_oc_slow_mode(uint32_t timer, enum tim_oc_id oc_id);
+void timer_set_oc_mode(uint32_t timer, enum tim_oc_id oc_id, enum tim_oc_mode oc_mode);
+void timer_set_oc_polarity_high(uint32_t timer, enum tim_oc_id oc_id);
+void timer_set_oc_polarity_low(uint32_t timer, enum tim_oc_id oc_id);
+void timer_set_oc_idle_state_set(uint32_t timer, enum tim_oc_id oc_id);
+void timer_set_oc_value(uint32_t timer, enum tim_oc_id oc_id, uint32_t value);
+void timer_enable_oc_output(uint32_t timer, enum tim_oc_id oc_id);
+
+/*
+ * spi
+ */
+#define SPI_SR_TXE				(1 << 1)
+#define SPI_SR_BSY				(1 << 7)
+#define SPI_CR1_BAUDRATE_FPCLK_DIV_64		(5 << 3)
+#define SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE		0
+#define SPI_CR1_CPHA_CLK_TRANSITION_1		0
+#define SPI_CR1_DFF_8BIT			0
+#define SPI_CR1_MSBFIRST			0
+
+int spi_init_master(uint32_t spi, uint32_t br, uint32_t cpol, uint32_t cpha,
+		    uint32_t dff, uint32_t lsbfirst);
+void spi_set_bidirectional_transmit_only_mode(uint32_t spi);
+void spi_enable_software_slave_management(uint32_t spi);
+void spi_set_nss_high(uint32_t spi);
+void spi_enable(uint32_t spi);
+void spi_send(uint32_t spi, uint16_t data);
+void spi_enable_tx_dma(uint32_t spi);
+void spi_disable_tx_dma(uint32_t spi);
+
+/*
+ * dma
+ */
+enum { DMA_CHANNEL1 = 1, DMA_CHANNEL2, DMA_CHANNEL3, SIM_NDMACH };
+
+#define DMA_GIF				(1 << 0)
+#define DMA_TCIF			(1 << 1)
+#define DMA_HTIF			(1 << 2)
+#define DMA_CCR_MSIZE_8BIT		(0 << 10)
+#define DMA_CCR_PSIZE_8BIT		(0 << 8)
+#define DMA_CCR_PSIZE_16BIT		(1 << 8)
+#define DMA_CCR_PL_LOW			(0 << 12)
+#define DMA_CCR_PL_VERY_HIGH		(3 << 12)
+#define DMA_REQ_TIM1_UP			1
+#define DMA_REQ_SPI4_TX			2
+
+void dma_enable_flex_mode(uint32_t dma);
+void dma_channel_reset(uint32_t dma, uint8_t channel);
+void dma_set_channel_request(uint32_t dma, uint8_t channel, uint32_t request);
+void dma_set_priority(uint32_t dma, uint8_t channel, uint32_t prio);
+void dma_set_memory_size(uint32_t dma, uint8_t channel, uint32_t mem_size);
+void dma_set_peripheral_size(uint32_t dma, uint8_t channel, uint32_t peripheral_size);
+void dma_enable_memory_increment_mode(uint32_t dma, uint8_t channel);
+void dma_enable_circular_mode(uint32_t dma, uint8_t channel);
+void dma_set_read_from_memory(uint32_t dma, uint8_t channel);
+void dma_set_number_of_data(uint32_t dma, uint8_t channel, uint16_t number);
+uint16_t dma_get_number_of_data(uint32_t dma, uint8_t channel);
+void dma_set_peripheral_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_set_memory_address(uint32_t dma, uint8_t channel, uint32_t address);
+void dma_enable_half_transfer_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_transfer_complete_interrupt(uint32_t dma, uint8_t channel);
+void dma_enable_channel(uint32_t dma, uint8_t channel);
+void dma_disable_channel(uint32_t dma, uint8_t channel);
+bool dma_get_interrupt_flag(uint32_t dma, uint8_t channel, uint32_t interrupts);
+void dma_clear_interrupt_flags(uint32_t dma, uint8_t channel, uint32_t interrupts);
+
+#endif
@@ -0,0 +1,7 @@
+/* simulator stand-in, see sim/hal.h */
+#include "sim/hal.h"
+
+/*
+ * idle() is the only inline asm firmware has, and it's wfi
+ */
+#define __asm(insn)	sim_wfi()
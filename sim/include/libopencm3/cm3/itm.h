@@ -0,0 +1,2 @@
+/* simulator stand-in, see sim/hal.h */
+#include "sim/hal.h"
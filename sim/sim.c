@@ -0,0 +1,966 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  f4uac-sim [-f format] [-r rate] [-t seconds] [-p ppm] [-d ppm]
+ *            [-J us] [-H profile[,opts]] [-e frames] [-l load]
+ *            [-j jitter] [-u cycles] [-i ms] [-R seconds] [-s seed]
+ *            [-D] [-c] [-x]
+ *
+ *  whole firmware on virtual time: main loop and isrs run as on
+ *  target, scheduled off a discrete event clock, against modelled
+ *  pwm dma, display timers and a usb host streaming a sine.
+ *  Telemetry is polled every -i ms and logged, -c as CSV;
+ *  -x exits non-zero if any xrun was counted.
+ *  Host clock is -p ppm off, device crystal -d ppm, SOFs and
+ *  packets jitter by -J us, -H picks how host honours feedback.
+ *  Feedback loop is summed up at exit: settling time to within
+ *  -e frames (twice that at 88.2/96k) of ring fill target, steady
+ *  state error and feedback accuracy; -r 0 does that for every
+ *  rate, one line each.
+ *  -u adds cycles to every usb interrupt; -D sweeps dsp load by
+ *  that, one line each: least slack a block rendered had before
+ *  dma got to it, against bound response time analysis gives for
+ *  pendsv under pwm and usb preemption, late events and pages
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "common.h"
+#include "prof.h"
+#include "tables.h"
+#include "telemetry.h"
+#include "sim/hal.h"
+#include "sim/sim.h"
+
+#undef main
+
+extern volatile ev_t e;
+extern volatile stats_t stats;
+extern volatile cs_t cstate;
+
+int fw_main(void);
+bool __real_pump(void);
+uint32_t pwm_position(void);
+uint32_t pframe_pos(void);
+
+void dma1_channel1_isr(void);
+void dma2_channel1_isr(void);
+void tim3_isr(void);
+void tim4_isr(void);
+#ifdef CHASE
+void tim8_up_isr(void);
+#endif
+void usb_lp_isr(void);
+void sys_tick_handler(void);
+void pend_sv_handler(void);
+
+double sim_t;
+volatile uint32_t sim_icsr;
+
+static double cycles;		/* since reset */
+static double t_end = 10;
+
+/*
+ * nvic: irq numbers double as tie break, as on target;
+ * handler cost is entry plus rough fixed part of its body, charged
+ * ahead of it, so run times isrs account themselves leave it out;
+ * pump() blocks, spi bytes and such are charged where they run
+ */
+static const struct {
+	void (*handler)(void);
+	uint16_t cost;
+	const char *name;
+} vector[SIM_NIRQ] = {
+	[NVIC_DMA1_CHANNEL1_IRQ] = { dma1_channel1_isr,	120,	"pwm" },
+	[NVIC_DMA2_CHANNEL1_IRQ] = { dma2_channel1_isr,	40,	"dispdma" },
+	[NVIC_TIM3_IRQ]		= { tim3_isr,		40,	"tim3" },
+	[NVIC_TIM4_IRQ]		= { tim4_isr,		400,	"tim4" },
+	[NVIC_USB_LP_IRQ]	= { usb_lp_isr,		600,	"usb" },
+#ifdef CHASE
+	[NVIC_TIM8_UP_IRQ]	= { tim8_up_isr,	40,	"tim8" },
+#endif
+	[NVIC_SYSTICK_IRQ]	= { sys_tick_handler,	20,	"systick" },
+	[NVIC_PENDSV_IRQ]	= { pend_sv_handler,	60,	"pendsv" }
+};
+
+static uint8_t prio[SIM_NIRQ];
+static bool enabled[SIM_NIRQ] = {
+	[NVIC_SYSTICK_IRQ] = true,
+	[NVIC_PENDSV_IRQ] = true
+};
+static bool pending[SIM_NIRQ];
+static uint64_t taken[SIM_NIRQ];
+static bool primask;
+static unsigned level = 0x100;	/* thread */
+static unsigned depth, maxdepth;
+
+static struct {
+	double t;
+	void (*fire)(void);
+} src[SRC_NUM];
+
+/*
+ * how host stacks honour feedback, modelled roughly rather than
+ * measured: linux takes it in full and sizes packets of each urb
+ * when queueing it, windows as taking 10.10 only, over longer urbs,
+ * macos as smoothing what it reads. Knobs override: e.g.
+ * -H linux,urb=8,quant=10,smooth=2,round
+ */
+static const struct {
+	const char *name;
+	uint8_t quant;
+	uint8_t smooth;
+	uint8_t urb;
+} profiles[] = {
+	{ "linux",	FEEDBACK_SHIFT,		0,	2 },
+	{ "windows",	10,			0,	10 },
+	{ "macos",	FEEDBACK_SHIFT,		2,	1 }
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+
+static struct {
+	double load;		/* pump() per block, share of block time */
+	double jitter;
+	uint32_t usb;		/* extra cycles, every usb isr */
+	uint32_t seed;
+	double restart;
+	double interval;
+	double tol;		/* settled, frames, doubled at 88.2/96k */
+	const char *profile;
+	bool csv;
+	bool strict;
+	bool sweep;		/* one line per rate */
+	bool deadline;		/* one line per load */
+	host_cfg_t host;
+} opt = {
+	.load = 0.35,
+	.seed = 1,
+	.interval = 1,
+	.tol = 4,
+	.profile = "linux",
+	.host = {
+		.format = SAMPLE_FORMAT_S24,
+		.rate = SAMPLE_RATE_48000,
+		.quant = FEEDBACK_SHIFT,
+		.urb = 2
+	}
+};
+
+/*
+ * xorshift32
+ */
+double sim_rand(void)
+{
+	opt.seed ^= opt.seed << 13;
+	opt.seed ^= opt.seed >> 17;
+	opt.seed ^= opt.seed << 5;
+	return (double)opt.seed / UINT32_MAX;
+}
+
+/*
+ * virtual clock
+ */
+uint32_t sim_cycles(void)
+{
+	return (uint64_t)cycles;
+}
+
+static void tick(double dt)
+{
+	sim_t += dt;
+	cycles += dt * hal_hz();
+}
+
+void sim_at(sim_src s, double t, void (*fire)(void))
+{
+	src[s].t = t;
+	src[s].fire = fire;
+}
+
+void sim_cancel(sim_src s)
+{
+	src[s].fire = NULL;
+}
+
+static int next_src(void)
+{
+	int n = -1;
+
+	for (int i = 0; i < SRC_NUM; i++)
+		if (src[i].fire && (n < 0 || src[i].t < src[n].t))
+			n = i;
+	return n;
+}
+
+static void sim_done(void);
+
+/*
+ * run ends at whatever event comes at or past end time,
+ * be it from idle loop or busy one
+ */
+static void fire(int s)
+{
+	void (*f)(void) = src[s].fire;
+
+	if (src[s].t >= t_end) {
+		tick(t_end - sim_t);
+		sim_done();
+	}
+	if (src[s].t > sim_t) tick(src[s].t - sim_t);
+	src[s].fire = NULL;
+	f();
+}
+
+/*
+ * interrupts
+ */
+void nvic_set_priority(uint8_t irqn, uint8_t priority) { prio[irqn] = priority; }
+void nvic_enable_irq(uint8_t irqn) { enabled[irqn] = true; }
+void sim_pend(uint8_t irqn) { pending[irqn] = true; }
+
+bool dwt_enable_cycle_counter(void)
+{
+	return true;
+}
+
+/*
+ * PendSV is pended through ICSR, as on target
+ */
+bool sim_pending(uint8_t irqn)
+{
+	if (irqn == NVIC_PENDSV_IRQ)
+		return sim_icsr & SCB_ICSR_PENDSVSET;
+	return pending[irqn] && enabled[irqn];
+}
+
+static void dispatch(void)
+{
+	for (;;) {
+		unsigned saved = level;
+		int n = -1;
+
+		if (primask) return;
+
+		for (int i = 0; i < SIM_NIRQ; i++)
+			if (sim_pending(i) && prio[i] < level &&
+			    (n < 0 || prio[i] < prio[n]))
+				n = i;
+		if (n < 0) return;
+
+		if (n == NVIC_PENDSV_IRQ)
+			sim_icsr &= ~SCB_ICSR_PENDSVSET;
+		pending[n] = false;
+		taken[n]++;
+		level = prio[n];
+		if (++depth > maxdepth) maxdepth = depth;
+
+		sim_advance(vector[n].cost +
+			    (n == NVIC_USB_LP_IRQ ? opt.usb : 0));
+		vector[n].handler();
+
+		depth--;
+		level = saved;
+	}
+}
+
+/*
+ * whatever runs now takes cycles; sources due meanwhile fire and
+ * may preempt it, their run time isn't its own
+ */
+void sim_advance(uint32_t n)
+{
+	double left = n / hal_hz();
+	int s;
+
+	while ((s = next_src()) >= 0 && src[s].t <= sim_t + left) {
+		if (src[s].t > sim_t) left -= src[s].t - sim_t;
+		fire(s);
+		dispatch();
+	}
+	tick(left);
+}
+
+/*
+ * PendSV set from thread mode is taken right away on target, here
+ * it's picked up at latest before interrupts get masked again
+ */
+void cm_disable_interrupts(void)
+{
+	dispatch();
+	primask = true;
+}
+
+void cm_enable_interrupts(void)
+{
+	primask = false;
+	dispatch();
+}
+
+uint32_t cm_mask_interrupts(uint32_t mask)
+{
+	uint32_t old = primask;
+
+	primask = mask;
+	if (!mask) dispatch();
+	return old;
+}
+
+/*
+ * wfi: skip to whatever comes next till something is pending
+ */
+void sim_wfi(void)
+{
+	for (;;) {
+		int s;
+
+		for (int i = 0; i < SIM_NIRQ; i++)
+			if (sim_pending(i)) return;
+
+		if ((s = next_src()) < 0) {
+			fprintf(stderr, "nothing to wake up on at %.6f\n", sim_t);
+			exit(2);
+		}
+		fire(s);
+	}
+}
+
+/*
+ * least frames to spare, block rendered to dma getting to it
+ */
+static int32_t dsp_min = INT32_MAX;
+
+/*
+ * dsp cost: each rendered block takes its share of block time,
+ * in pwm frames at current clock, give or take jitter
+ */
+bool __wrap_pump(void)
+{
+	int32_t slack;
+	double c;
+
+	if (!__real_pump()) return false;
+
+	c = opt.load * BFRAMES * hal_frame_cycles() *
+		(1 + opt.jitter * (2 * sim_rand() - 1));
+	sim_advance(c > 0 ? c : 0);
+
+	slack = pframe_pos() - pwm_position();
+	if (e.state == STATE_RUNNING && slack < dsp_min)
+		dsp_min = slack;
+	return true;
+}
+
+/*
+ * feedback loop: ring fill after each packet, as usbd.c sees it,
+ * and feedback host goes by, averaged over windows of 8 feedback
+ * periods, so block-wise draining beating with packets evens out;
+ * target comes with telemetry
+ */
+#define FB_WINDOW	(8 << SOF_SHIFT)	/* packets */
+
+typedef struct {
+	float t;
+	float fill;		/* bytes */
+	float fb;		/* frames per ms */
+} fbwin_t;
+
+static struct {
+	double t0;
+	double fill;
+	double fb;
+	unsigned n;
+	double logfill;		/* since last log line */
+	unsigned logn;
+	fbwin_t *w;
+	size_t nw;
+	size_t size;
+	uint16_t target;	/* bytes */
+} loop;
+
+static void loop_reset(void)
+{
+	loop.t0 = sim_t;
+	loop.fill = loop.fb = loop.n = loop.nw = 0;
+}
+
+uint16_t __real_rb_put(void *p, uint16_t len);
+
+uint16_t __wrap_rb_put(void *p, uint16_t len)
+{
+	uint16_t space = __real_rb_put(p, len);
+	uint16_t fill = RBSIZE - 1 - space;
+
+	loop.logfill += fill;
+	loop.logn++;
+	loop.fill += fill;
+	loop.fb += host_feedback();
+
+	if (++loop.n < FB_WINDOW)
+		return space;
+
+	if (loop.nw == loop.size) {
+		loop.size = loop.size ? 2 * loop.size : 4096;
+		if (!(loop.w = realloc(loop.w, loop.size * sizeof(*loop.w)))) {
+			perror("realloc");
+			exit(2);
+		}
+	}
+	loop.w[loop.nw++] = (fbwin_t) {
+		.t = sim_t - loop.t0,
+		.fill = loop.fill / loop.n,
+		.fb = loop.fb / loop.n / (1 << FEEDBACK_SHIFT)
+	};
+	loop.fill = loop.fb = loop.n = 0;
+
+	return space;
+}
+
+typedef struct {
+	double target;		/* frames */
+	double settle;		/* seconds, < 0 if never */
+	double err;		/* steady state, mean and peak to peak */
+	double pp;
+	double fbppm;		/* feedback vs actual device rate */
+} loop_res_t;
+
+/*
+ * steady state is last quarter of the run; actual rate is what
+ * pwm consumes, counted in host milliseconds
+ */
+static loop_res_t loop_result(void)
+{
+	unsigned framelen = framesize(opt.host.format);
+	bool dr = opt.host.rate > SAMPLE_RATE_48000;
+	size_t from = loop.nw * 3 / 4;
+	double tol = dr ? 2 * opt.tol : opt.tol;
+	double lo = INFINITY, hi = -INFINITY, fb = 0, rate;
+	loop_res_t r = { .target = (double)loop.target / framelen };
+
+	r.settle = loop.nw ? 0 : -1;
+	for (size_t i = 0; i < loop.nw; i++) {
+		double err = loop.w[i].fill / framelen - r.target;
+
+		if (fabs(err) > tol)
+			r.settle = i + 1 < loop.nw ? loop.w[i + 1].t : -1;
+		if (i < from) continue;
+		r.err += err;
+		fb += loop.w[i].fb;
+		lo = MIN(lo, err);
+		hi = MAX(hi, err);
+	}
+
+	if (loop.nw > from) {
+		r.err /= loop.nw - from;
+		r.pp = hi - lo;
+		rate = hal_hz() / hal_frame_cycles() /
+			(1 << (dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR)) *
+			1e-3 / (1 + opt.host.ppm * 1e-6);
+		r.fbppm = (fb / (loop.nw - from) / rate - 1) * 1e6;
+	}
+
+	return r;
+}
+
+/*
+ * host script: configure, open stream, then poll telemetry;
+ * optionally close and reopen every -R seconds
+ */
+static host_req_t req, tmreq;
+static int step;
+
+static const char * const states[] = { "closed", "fill", "running", "drain" };
+
+static void host_step(void);
+
+static void host_done(host_req_t *r)
+{
+	if (!r->ok)
+		fprintf(stderr, "%.3f: request %02x:%02x failed\n",
+			sim_t, r->bmRequestType, r->bRequest);
+	sim_at(SRC_HOST, sim_t + 1e-3, host_step);
+}
+
+static void host_step(void)
+{
+	int s = step++;
+
+	memset(&req, 0, sizeof(req));
+	req.done = host_done;
+
+	switch (s) {
+	case 0:				/* SET_CONFIGURATION */
+		req.bRequest = 9;
+		req.wValue = 1;
+		break;
+	case 1:				/* SET_INTERFACE */
+		req.bmRequestType = 0x01;
+		req.bRequest = 11;
+		req.wIndex = 1;
+		req.wValue = opt.host.format;
+		break;
+	case 2:				/* SET_CUR sampling frequency */
+		req.bmRequestType = 0x22;
+		req.bRequest = 0x01;
+		req.wValue = 0x0100;
+		req.wIndex = 0x01;
+		req.wLength = 3;
+		req.data[0] = opt.host.rate;
+		req.data[1] = opt.host.rate >> 8;
+		req.data[2] = opt.host.rate >> 16;
+		break;
+	case 3:
+		host_stream(true);
+		loop_reset();
+		if (opt.restart > 0)
+			sim_at(SRC_HOST, sim_t + opt.restart, host_step);
+		return;
+	case 4:				/* close, reopen in a while */
+		host_stream(false);
+		req.bmRequestType = 0x01;
+		req.bRequest = 11;
+		req.wIndex = 1;
+		req.done = NULL;
+		break;
+	}
+
+	if (!host_control(&req)) {	/* telemetry in flight, retry */
+		step = s;
+		sim_at(SRC_HOST, sim_t + 1e-3, host_step);
+	} else if (s == 4) {
+		step = 1;
+		sim_at(SRC_HOST, sim_t + 50e-3, host_step);
+	}
+}
+
+/*
+ * fill and its error are means since previous line, in frames
+ */
+static void telemetry_log(host_req_t *r)
+{
+	unsigned framelen = framesize(opt.host.format);
+	double fill, err;
+	telemetry_t t;
+
+	if (!r->ok || r->wLength < sizeof(t)) return;
+	memcpy(&t, r->data, sizeof(t));
+	loop.target = t.rbtarget;
+
+	fill = loop.logn ? loop.logfill / loop.logn / framelen : 0;
+	err = loop.logn ? fill - (double)t.rbtarget / framelen : 0;
+	loop.logfill = loop.logn = 0;
+
+	if (opt.sweep || opt.deadline) return;
+
+	if (opt.csv)
+		printf("%.3f,%s,%u,%u,%.2f,%.2f,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+		       sim_t, states[t.state & 3], t.rbmin, t.rbmax, fill, err,
+		       t.feedback, t.late, t.underrun, t.overrun, t.partial,
+		       t.missed, t.evlate, t.load, t.pump_max);
+	else
+		printf("%9.3f %-8s %5u %5u %7.1f %6.1f %8.4f %6u %6u %6u "
+		       "%6u %6u %6u %4u%%\n",
+		       sim_t, states[t.state & 3], t.rbmin, t.rbmax, fill, err,
+		       t.feedback / (double)(1 << FEEDBACK_SHIFT), t.late,
+		       t.underrun, t.overrun, t.partial, t.missed, t.evlate,
+		       t.load);
+}
+
+static void telemetry_poll(void)
+{
+	memset(&tmreq, 0, sizeof(tmreq));
+	tmreq.bmRequestType = 0xc0;
+	tmreq.bRequest = TELEMETRY_GET;
+	tmreq.wLength = sizeof(telemetry_t);
+	tmreq.done = telemetry_log;
+
+	host_control(&tmreq);
+	sim_at(SRC_LOG, sim_t + opt.interval, telemetry_poll);
+}
+
+static struct timespec wall;
+
+/*
+ * response time analysis. Each dma half/complete frees half the
+ * buffer, NBLOCKS / 2 blocks, dsp renders them in turn, pump() at
+ * its worst jitter, after a block pendsv may be rendering already,
+ * chasing dma as usb pended it, preempted by every pwm and usb isr
+ * coming in meanwhile, at the rate they came and their worst run.
+ * k-th one is due when dma gets to it, half buffer and k - 1
+ * blocks past the interrupt. Least slack over blocks, frames
+ */
+static double dsp_slack(void)
+{
+	static const struct {
+		uint8_t irqn;
+		irq_src src;
+	} above[] = {
+		{ NVIC_DMA1_CHANNEL1_IRQ,	IRQ_PWM },
+		{ NVIC_USB_LP_IRQ,		IRQ_USB }
+	};
+	double frame = hal_frame_cycles();
+	double block = opt.load * (1 + opt.jitter) * BFRAMES * frame;
+	double slack = INFINITY;
+
+	for (unsigned k = 1; k <= NBLOCKS / 2; k++) {
+		double c = vector[NVIC_PENDSV_IRQ].cost + (k + 1) * block;
+		double due = (NBLOCKS / 2 + k - 1) * BFRAMES * frame;
+		double r, next = c;
+
+		do {
+			r = next;
+			next = c;
+			for (unsigned i = 0; i < NELEM(above); i++) {
+				uint8_t n = above[i].irqn;
+				double period, cost;
+
+				if (!taken[n]) continue;
+				period = sim_t * hal_hz() / taken[n];
+				cost = vector[n].cost +
+					stats.irqrun[above[i].src] +
+					(n == NVIC_USB_LP_IRQ ? opt.usb : 0);
+				next += ceil(r / period) * cost;
+			}
+		} while (next > r && next < 2 * due);
+
+		if ((due - next) / frame < slack)
+			slack = (due - next) / frame;
+	}
+
+	return slack;
+}
+
+/*
+ * pages late are ones dma got to before dsp did; fails on any, or
+ * on slack model promised and run didn't have. -x fails on late
+ * events, and on model giving no slack, as well
+ */
+static void deadline_done(void)
+{
+	double bound = dsp_slack();
+	uint32_t late = stats.late + stats.underrun;
+	bool fail = late || dsp_min < bound;
+	bool over = bound < 0 || stats.missed;
+
+	if (opt.csv)
+		printf("%.2f,%u,%d,%.1f,%u,%u,%u\n", opt.load, opt.usb,
+		       dsp_min, bound, stats.evlate, stats.missed, late);
+	else
+		printf("%5.2f %6u %8d %8.1f %6u %6u %6u %s\n", opt.load,
+		       opt.usb, dsp_min, bound, stats.evlate, stats.missed,
+		       late, fail ? "FAIL" : over ? "over" : "ok");
+	exit(fail || (opt.strict && over) ? 1 : 0);
+}
+
+static void sim_done(void)
+{
+	struct timespec now;
+	double secs;
+	uint32_t xruns = stats.late + stats.underrun + stats.overrun +
+		stats.partial + stats.missed;
+	loop_res_t r = loop_result();
+	char settle[16] = "-";
+
+	if (r.settle >= 0)
+		snprintf(settle, sizeof(settle), "%.2f", r.settle);
+
+	if (opt.sweep) {
+		printf(opt.csv ? "%s,%u,%.1f,%s,%.2f,%.2f,%.1f,%u\n" :
+		       "%-8s %6u %7.1f %7s %7.2f %7.2f %8.1f %6u\n",
+		       opt.profile, opt.host.rate, r.target, settle, r.err,
+		       r.pp, r.fbppm, xruns + host_dropped());
+		exit(opt.strict && (xruns || host_dropped()) ? 1 : 0);
+	}
+
+	if (opt.deadline)
+		deadline_done();
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	secs = now.tv_sec - wall.tv_sec + (now.tv_nsec - wall.tv_nsec) * 1e-9;
+
+	fflush(stdout);
+	fprintf(stderr, "%.3fs simulated in %.3fs, %.0fx real time\n",
+		sim_t, secs, sim_t / secs);
+	fprintf(stderr, "state %s opens %u late %u underrun %u overrun %u "
+		"partial %u missed %u evlate %u dropped %u\n",
+		states[e.state & 3], stats.opens, stats.late, stats.underrun,
+		stats.overrun, stats.partial, stats.missed, stats.evlate,
+		host_dropped());
+	fprintf(stderr, "%-8s %10s\n", "irq", "taken");
+	for (int i = 0; i < SIM_NIRQ; i++)
+		if (vector[i].handler)
+			fprintf(stderr, "%-8s %10llu\n", vector[i].name,
+				(unsigned long long)taken[i]);
+	fprintf(stderr, "nesting %u, worst latency/run, cycles: "
+		"pwm %u/%u usb %u/%u dsp %u/%u disp %u/%u\n", maxdepth,
+		stats.irqlat[IRQ_PWM], stats.irqrun[IRQ_PWM],
+		stats.irqlat[IRQ_USB], stats.irqrun[IRQ_USB],
+		stats.irqlat[IRQ_DSP], stats.irqrun[IRQ_DSP],
+		stats.irqlat[IRQ_DISP], stats.irqrun[IRQ_DISP]);
+	fprintf(stderr, "loop (%s): target %.1f frames, settled in %ss, "
+		"error %.2f p-p %.2f frames, feedback %+.1f ppm\n",
+		opt.profile, r.target, settle, r.err, r.pp, r.fbppm);
+
+	exit(opt.strict && (xruns || host_dropped()) ? 1 : 0);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-f format] [-r rate] [-t seconds] "
+		"[-p ppm] [-d ppm]\n"
+		"\t[-J us] [-H profile[,urb=n][,quant=n][,smooth=n][,round]] "
+		"[-e frames]\n"
+		"\t[-l load] [-j jitter] [-u cycles] [-i ms] [-R seconds] "
+		"[-s seed]\n"
+		"\t[-D] [-c] [-x]\n", name);
+	exit(1);
+}
+
+static void host_profile(char *arg, const char *name)
+{
+	enum { URB, QUANT, SMOOTH, ROUND };
+	char *const keys[] = {
+		[URB] = "urb", [QUANT] = "quant", [SMOOTH] = "smooth",
+		[ROUND] = "round", NULL
+	};
+	char *val, *p = strchr(arg, ',');
+	unsigned i;
+
+	if (p) *p++ = 0;
+	for (i = 0; i < NELEM(profiles); i++)
+		if (!strcmp(arg, profiles[i].name)) break;
+	if (i == NELEM(profiles))
+		usage(name);
+
+	opt.profile = profiles[i].name;
+	opt.host.quant = profiles[i].quant;
+	opt.host.smooth = profiles[i].smooth;
+	opt.host.urb = profiles[i].urb;
+
+	while (p && *p) {
+		switch (getsubopt(&p, keys, &val)) {
+		case URB:
+			if (!val || !(opt.host.urb = atoi(val))) usage(name);
+			break;
+		case QUANT:
+			if (!val) usage(name);
+			opt.host.quant = MIN(atoi(val), FEEDBACK_SHIFT);
+			break;
+		case SMOOTH:
+			if (!val) usage(name);
+			opt.host.smooth = MIN(atoi(val), 8);
+			break;
+		case ROUND:
+			opt.host.round = true;
+			break;
+		default:
+			usage(name);
+		}
+	}
+}
+
+/*
+ * each rate in a child of its own, firmware state being global;
+ * 88.2/96k only where there's a double rate alt setting
+ */
+static int sweep(void)
+{
+	static const sample_rate rates[] = {
+		SAMPLE_RATE_44100, SAMPLE_RATE_48000,
+		SAMPLE_RATE_88200, SAMPLE_RATE_96000
+	};
+	int status, ret = 0;
+
+	if (opt.csv)
+		printf("profile,rate,target,settle,error,pp,feedback_ppm,xruns\n");
+	else
+		printf("%-8s %6s %7s %7s %7s %7s %8s %6s\n", "profile", "rate",
+		       "target", "settle", "error", "p-p", "fb ppm", "xruns");
+	fflush(stdout);
+
+	for (unsigned i = 0; i < NELEM(rates); i++) {
+		pid_t pid;
+
+		if (rates[i] > SAMPLE_RATE_48000 &&
+		    opt.host.format != SAMPLE_FORMAT_S16 &&
+		    opt.host.format != SAMPLE_FORMAT_S24)
+			continue;
+
+		if ((pid = fork()) < 0) {
+			perror("fork");
+			return 2;
+		}
+		if (!pid) {
+			opt.host.rate = rates[i];
+			opt.sweep = true;
+			return -1;
+		}
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+	}
+
+	return ret;
+}
+
+/*
+ * dsp load against usb isr cost, one line each
+ */
+static int deadlines(void)
+{
+	static const double loads[] = { 0.2, 0.35, 0.5 };
+	static const uint32_t usb[] = { 0, 4000, 16000 };
+	int status, ret = 0;
+
+	if (opt.csv)
+		printf("load,usb,slack,bound,evlate,missed,late\n");
+	else
+		printf("%5s %6s %8s %8s %6s %6s %6s\n", "load", "usb",
+		       "slack", "bound", "evlate", "missed", "late");
+	fflush(stdout);
+
+	for (unsigned i = 0; i < NELEM(loads); i++) {
+		for (unsigned j = 0; j < NELEM(usb); j++) {
+			pid_t pid;
+
+			if ((pid = fork()) < 0) {
+				perror("fork");
+				return 2;
+			}
+			if (!pid) {
+				opt.load = loads[i];
+				opt.usb = usb[j];
+				opt.deadline = true;
+				return -1;
+			}
+			waitpid(pid, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status))
+				ret = 1;
+		}
+	}
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	bool dsweep = false;
+	int c, ret;
+
+	while ((c = getopt(argc, argv, "f:r:t:p:d:J:H:e:l:j:u:i:R:s:Dcx")) != -1) {
+		switch (c) {
+		case 'f':
+			opt.host.format = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opt.host.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			t_end = strtod(optarg, NULL);
+			break;
+		case 'p':
+			opt.host.ppm = strtod(optarg, NULL);
+			break;
+		case 'd':
+			hal_xtal_ppm = strtod(optarg, NULL);
+			break;
+		case 'J':
+			opt.host.jitter = strtod(optarg, NULL) * 1e-6;
+			break;
+		case 'H':
+			host_profile(optarg, argv[0]);
+			break;
+		case 'e':
+			opt.tol = strtod(optarg, NULL);
+			break;
+		case 'l':
+			opt.load = strtod(optarg, NULL);
+			break;
+		case 'j':
+			opt.jitter = strtod(optarg, NULL);
+			break;
+		case 'u':
+			opt.usb = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			opt.interval = strtod(optarg, NULL) * 1e-3;
+			break;
+		case 'R':
+			opt.restart = strtod(optarg, NULL);
+			break;
+		case 's':
+			opt.seed = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'D':
+			dsweep = true;
+			break;
+		case 'c':
+			opt.csv = true;
+			break;
+		case 'x':
+			opt.strict = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (opt.host.format < SAMPLE_FORMAT_S16 ||
+	    opt.host.format > SAMPLE_FORMAT_S24_LFE)
+		usage(argv[0]);
+
+	if (opt.host.jitter < 0 || opt.host.jitter >= 500e-6)
+		usage(argv[0]);
+
+	if (dsweep && !opt.host.rate)
+		usage(argv[0]);
+
+#ifdef CHASE
+	if (dsweep) {
+		fprintf(stderr, "%s: -D bounds blocks pended off dma "
+			"half/complete, not CHASE ones\n", argv[0]);
+		return 1;
+	}
+#endif
+
+	if (!opt.host.rate && (ret = sweep()) >= 0)
+		return ret;
+
+	if (dsweep && (ret = deadlines()) >= 0)
+		return ret;
+
+	switch (opt.host.rate) {
+	case SAMPLE_RATE_44100:
+	case SAMPLE_RATE_48000:
+	case SAMPLE_RATE_88200:
+	case SAMPLE_RATE_96000:
+		break;
+	default:
+		usage(argv[0]);
+	}
+
+	if (opt.sweep || opt.deadline)
+		;
+	else if (opt.csv)
+		printf("t,state,rbmin,rbmax,fill,error,feedback,late,underrun,"
+		       "overrun,partial,missed,evlate,load,pump_max\n");
+	else
+		printf("%9s %-8s %5s %5s %7s %6s %8s %6s %6s %6s %6s %6s %6s "
+		       "%5s\n", "t", "state", "rbmin", "rbmax", "fill", "error",
+		       "feedback", "late", "under", "over", "part", "missed",
+		       "evlate", "load");
+
+	clock_gettime(CLOCK_MONOTONIC, &wall);
+	host_start(&opt.host);
+	sim_at(SRC_HOST, 5e-3, host_step);
+	sim_at(SRC_LOG, opt.interval, telemetry_poll);
+
+	return fw_main();
+}
@@ -0,0 +1,95 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * simulator internals: virtual clock, event sources and interrupt
+ * dispatch (sim.c), peripheral models (hal.c), usb device and
+ * host (usb.c)
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * virtual time, seconds; cpu cycles follow current ahb clock
+ */
+extern double sim_t;
+
+/*
+ * timed sources: each fires at its time, if finite, and is
+ * rescheduled by its handler; firing usually pends an irq
+ */
+typedef enum {
+	SRC_SYSTICK,
+	SRC_PWM,
+	SRC_BLOCK,
+	SRC_DISP_TICK,
+	SRC_DISP_DMA,
+	SRC_SOF,
+	SRC_USB_RX,
+	SRC_HOST,
+	SRC_LOG,
+	SRC_NUM
+} sim_src;
+
+void sim_at(sim_src src, double t, void (*fire)(void));
+void sim_cancel(sim_src src);
+
+/*
+ * charge cycles to whatever runs now; sources due meanwhile fire,
+ * and irqs they pend preempt it if priority allows
+ */
+void sim_advance(uint32_t cycles);
+void sim_pend(uint8_t irqn);
+bool sim_pending(uint8_t irqn);
+
+/*
+ * hal.c: device crystal error, ppm, skews every clock derived
+ * from ahb, pwm included
+ */
+extern double hal_xtal_ppm;
+
+double hal_hz(void);
+uint32_t hal_frame_cycles(void);
+
+/*
+ * usb.c: host side. Device gets 1ms SOFs off host clock, skewed
+ * by ppm, each followed by an OUT packet sized by accumulated
+ * feedback; control requests are queued and served by usbd_poll()
+ */
+typedef struct host_req {
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+	uint8_t data[128];
+	bool ok;		/* set when served */
+	void (*done)(struct host_req *);
+} host_req_t;
+
+typedef struct {
+	double ppm;		/* host clock vs nominal */
+	double jitter;		/* SOF and packet timing, seconds */
+	uint8_t format;		/* alt setting */
+	uint32_t rate;
+	/*
+	 * how feedback is honoured, see profiles in sim.c
+	 */
+	uint8_t quant;		/* fraction bits taken, of FEEDBACK_SHIFT */
+	uint8_t smooth;		/* EWMA shift, 0 for none */
+	uint8_t urb;		/* packets sized at once */
+	bool round;		/* each packet rounded, nothing carried */
+} host_cfg_t;
+
+void host_start(const host_cfg_t *cfg);
+bool host_control(host_req_t *req);	/* false if one in progress */
+void host_stream(bool on);
+uint32_t host_feedback(void);
+uint32_t host_dropped(void);		/* packets device didn't take */
+
+/*
+ * seeded, so runs are repeatable
+ */
+double sim_rand(void);
@@ -0,0 +1,421 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  usb device core stand-in and the host at other end of the cable.
+ *  usbd.c is built against real libopencm3 usb headers; what's here
+ *  implements the part of their api it uses, so no usbd.h include
+ *  and the request layout is spelled out once more
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "sim/hal.h"
+#include "sim/sim.h"
+
+#define USB_REQ_TYPE_IN			0x80
+#define USB_REQ_TYPE_TYPE		0x60
+#define USB_REQ_TYPE_STANDARD		0x00
+#define USB_REQ_SET_CONFIGURATION	9
+#define USB_REQ_SET_INTERFACE		11
+
+enum { REQ_NOTSUPP, REQ_HANDLED, REQ_NEXT_CALLBACK };
+
+#define OUT_ENDP	0x01		/* as in usbd.c */
+#define FB_ENDP		0x84
+
+#define NCTRL_CB	4
+#define NEP		16
+#define RX_DELAY	50e-6		/* OUT packet after SOF */
+#define MAX_PACKET	1023
+
+struct usb_setup_data {
+	uint8_t bmRequestType;
+	uint8_t bRequest;
+	uint16_t wValue;
+	uint16_t wIndex;
+	uint16_t wLength;
+} __attribute__((packed));
+
+typedef struct _usbd_device usbd_device;
+typedef void (*complete_cb)(usbd_device *, struct usb_setup_data *);
+typedef int (*control_cb)(usbd_device *, struct usb_setup_data *,
+			  uint8_t **, uint16_t *, complete_cb *);
+typedef void (*ep_cb)(usbd_device *, uint8_t);
+
+struct _usbd_driver {
+	int unused;
+};
+
+const struct _usbd_driver st_usbfs_v1_usb_driver;
+
+struct _usbd_device {
+	void (*set_config)(usbd_device *, uint16_t);
+	void (*altset)(usbd_device *, uint16_t, uint16_t);
+	void (*sof)(void);
+	struct {
+		uint8_t type;
+		uint8_t mask;
+		control_cb cb;
+	} ctrl[NCTRL_CB];
+	ep_cb out[NEP];
+	ep_cb in[NEP];
+	uint8_t *buf;
+	uint16_t buflen;
+};
+
+static usbd_device dev;
+
+/*
+ * what's on the wire: control request in progress, SOF and OUT
+ * packet seen since last poll, IN packets waiting for host
+ * and ones it has taken
+ */
+static struct {
+	host_cfg_t cfg;
+	host_req_t *req;
+	bool sof;
+	bool rx;
+	uint8_t pkt[MAX_PACKET];
+	uint16_t pktlen;
+	uint16_t inlen[NEP];
+	uint8_t infb[4];
+	uint16_t indone;
+	uint8_t alt;
+	bool streaming;
+	uint32_t fb;		/* Q10.14, as host got it */
+	uint32_t fbavg;		/* smoothed, if host does */
+	uint32_t fbuse;		/* latched for current urb */
+	uint32_t acc;
+	uint32_t npkt;
+	double sofnom;		/* nominal time of next SOF */
+	double phase;
+	uint32_t dropped;
+} h;
+
+/*
+ * device side
+ */
+usbd_device *usbd_init(const void *driver, const void *desc,
+		       const void *conf, const char * const *strings,
+		       int num_strings, uint8_t *control_buffer,
+		       uint16_t control_buffer_size)
+{
+	(void)driver; (void)desc; (void)conf; (void)strings; (void)num_strings;
+
+	dev.buf = control_buffer;
+	dev.buflen = control_buffer_size;
+	return &dev;
+}
+
+int usbd_register_set_config_callback(usbd_device *d,
+				      void (*cb)(usbd_device *, uint16_t))
+{
+	d->set_config = cb;
+	return 0;
+}
+
+void usbd_register_sof_callback(usbd_device *d, void (*cb)(void))
+{
+	d->sof = cb;
+}
+
+void usbd_register_set_altsetting_callback(usbd_device *d,
+			void (*cb)(usbd_device *, uint16_t, uint16_t))
+{
+	d->altset = cb;
+}
+
+int usbd_register_control_callback(usbd_device *d, uint8_t type,
+				   uint8_t type_mask, control_cb cb)
+{
+	for (unsigned i = 0; i < NCTRL_CB; i++) {
+		if (d->ctrl[i].cb) continue;
+		d->ctrl[i].type = type;
+		d->ctrl[i].mask = type_mask;
+		d->ctrl[i].cb = cb;
+		return 0;
+	}
+	return -1;
+}
+
+void usbd_ep_setup(usbd_device *d, uint8_t addr, uint8_t type,
+		   uint16_t max_size, ep_cb cb)
+{
+	(void)type; (void)max_size;
+
+	if (addr & USB_REQ_TYPE_IN)
+		d->in[addr & (NEP - 1)] = cb;
+	else
+		d->out[addr & (NEP - 1)] = cb;
+}
+
+/*
+ * IN packets go out on next host poll, i.e. with next OUT one;
+ * only first 4 bytes are kept, it's feedback that matters
+ */
+uint16_t usbd_ep_write_packet(usbd_device *d, uint8_t addr,
+			      const void *buf, uint16_t len)
+{
+	unsigned ep = addr & (NEP - 1);
+
+	(void)d;
+	if (h.inlen[ep]) return 0;
+
+	h.inlen[ep] = len ? len : 1;
+	if (addr == FB_ENDP) {
+		memset(h.infb, 0, sizeof(h.infb));
+		memcpy(h.infb, buf, MIN(len, sizeof(h.infb)));
+	}
+	return len;
+}
+
+uint16_t usbd_ep_read_packet(usbd_device *d, uint8_t addr,
+			     void *buf, uint16_t len)
+{
+	(void)d; (void)addr;
+
+	len = MIN(len, h.pktlen);
+	memcpy(buf, h.pkt, len);
+	h.pktlen = 0;
+	return len;
+}
+
+static void control(usbd_device *d, host_req_t *r)
+{
+	struct usb_setup_data req = {
+		.bmRequestType = r->bmRequestType,
+		.bRequest = r->bRequest,
+		.wValue = r->wValue,
+		.wIndex = r->wIndex,
+		.wLength = r->wLength
+	};
+	uint8_t *buf = d->buf;
+	uint16_t len = r->wLength;
+	complete_cb complete = NULL;
+	int ret = REQ_NOTSUPP;
+
+	if ((req.bmRequestType & USB_REQ_TYPE_TYPE) == USB_REQ_TYPE_STANDARD) {
+		switch (req.bRequest) {
+		case USB_REQ_SET_CONFIGURATION:
+			memset(d->ctrl, 0, sizeof(d->ctrl));
+			if (d->set_config) d->set_config(d, req.wValue);
+			ret = REQ_HANDLED;
+			break;
+		case USB_REQ_SET_INTERFACE:
+			if (d->altset) d->altset(d, req.wIndex, req.wValue);
+			h.alt = req.wValue;
+			ret = REQ_HANDLED;
+			break;
+		}
+		goto out;
+	}
+
+	/* as libopencm3: buffer bounds OUT data, IN goes by wLength */
+	if (!(req.bmRequestType & USB_REQ_TYPE_IN)) {
+		len = MIN(len, MIN(d->buflen, sizeof(r->data)));
+		memcpy(buf, r->data, len);
+	}
+
+	for (unsigned i = 0; i < NCTRL_CB && d->ctrl[i].cb; i++) {
+		if ((req.bmRequestType & d->ctrl[i].mask) != d->ctrl[i].type)
+			continue;
+		ret = d->ctrl[i].cb(d, &req, &buf, &len, &complete);
+		if (ret != REQ_NEXT_CALLBACK)
+			break;
+	}
+
+	if (ret == REQ_HANDLED && (req.bmRequestType & USB_REQ_TYPE_IN)) {
+		len = MIN(len, MIN(r->wLength, sizeof(r->data)));
+		memcpy(r->data, buf, len);
+		r->wLength = len;
+	}
+
+	if (ret == REQ_HANDLED && complete)
+		complete(d, &req);
+out:
+	if (ret != REQ_HANDLED)
+		r->wLength = 0;
+	r->ok = ret == REQ_HANDLED;
+}
+
+/*
+ * what usb isr would have found in ISTR and endpoint registers
+ */
+void usbd_poll(usbd_device *d)
+{
+	if (h.req) {
+		host_req_t *r = h.req;
+
+		h.req = NULL;
+		control(d, r);
+		if (r->done) r->done(r);
+	}
+
+	if (h.sof) {
+		h.sof = false;
+		if (d->sof) d->sof();
+	}
+
+	if (h.rx) {
+		h.rx = false;
+		if (d->out[OUT_ENDP]) d->out[OUT_ENDP](d, OUT_ENDP);
+		h.pktlen = 0;
+	}
+
+	for (unsigned ep = 0; h.indone; ep++) {
+		if (!(h.indone & (1 << ep))) continue;
+		h.indone &= ~(1 << ep);
+		if (d->in[ep]) d->in[ep](d, ep | USB_REQ_TYPE_IN);
+	}
+}
+
+/*
+ * host side: 1kHz sine at -6dBFS, every channel. Packets of an urb
+ * are sized when it's queued, off feedback as of then; fractional
+ * frames are carried over, unless host rounds each packet
+ */
+static uint16_t packet(uint8_t *dst)
+{
+	sample_fmt fmt = h.alt;
+	unsigned nch = nchannels(fmt), nframes;
+	uint8_t *p = dst;
+
+	if (!(h.npkt++ % h.cfg.urb))
+		h.fbuse = h.fbavg;
+
+	if (h.cfg.round) {
+		nframes = (h.fbuse + (1 << (FEEDBACK_SHIFT - 1))) >>
+			FEEDBACK_SHIFT;
+	} else {
+		h.acc += h.fbuse;
+		nframes = h.acc >> FEEDBACK_SHIFT;
+		h.acc -= nframes << FEEDBACK_SHIFT;
+	}
+	nframes = MIN(nframes, MAX_PACKET / framesize(fmt));
+
+	for (unsigned i = 0; i < nframes; i++) {
+		double x = .5 * sin(h.phase);
+
+		h.phase = fmod(h.phase + 2 * M_PI * 1000 / h.cfg.rate, 2 * M_PI);
+		for (unsigned k = 0; k < nch; k++) {
+			int32_t v;
+			float f;
+
+			switch (fmt) {
+			case SAMPLE_FORMAT_S16:
+			case SAMPLE_FORMAT_S16_LFE:
+				v = x * INT16_MAX;
+				memcpy(p, &v, 2);
+				break;
+			case SAMPLE_FORMAT_S24:
+			case SAMPLE_FORMAT_S24_LFE:
+				v = x * 0x7fffff;
+				memcpy(p, &v, 3);
+				break;
+			case SAMPLE_FORMAT_S32:
+				v = x * INT32_MAX;
+				memcpy(p, &v, 4);
+				break;
+			case SAMPLE_FORMAT_F32:
+				f = x;
+				memcpy(p, &f, 4);
+				break;
+			default:
+				break;
+			}
+			p += framesize(fmt) / nch;
+		}
+	}
+
+	return p - dst;
+}
+
+/*
+ * feedback as host takes it: to so many fraction bits, then
+ * EWMA-smoothed, if it does either
+ */
+static void feedback(const uint8_t *p)
+{
+	uint32_t fb = p[0] | p[1] << 8 | p[2] << 16;
+
+	h.fb = fb & ~((1U << (FEEDBACK_SHIFT - h.cfg.quant)) - 1);
+	if (h.cfg.smooth)
+		h.fbavg += (int32_t)(h.fb - h.fbavg) >> h.cfg.smooth;
+	else
+		h.fbavg = h.fb;
+}
+
+static void rx_fire(void)
+{
+	for (unsigned ep = 0; ep < NEP; ep++) {
+		if (!h.inlen[ep]) continue;
+		if (ep == (FB_ENDP & (NEP - 1)))
+			feedback(h.infb);
+		h.inlen[ep] = 0;
+		h.indone |= 1 << ep;
+	}
+
+	if (h.streaming) {
+		if (h.rx) h.dropped++;		/* previous one not taken */
+		h.pktlen = packet(h.pkt);
+		h.rx = true;
+	}
+
+	sim_pend(NVIC_USB_LP_IRQ);
+}
+
+/*
+ * SOFs are 1ms of host clock apart, each off its nominal time
+ * by up to half the jitter either way, so it doesn't accumulate;
+ * packet follows within jitter
+ */
+static void sof_fire(void)
+{
+	h.sof = true;
+	sim_pend(NVIC_USB_LP_IRQ);
+	sim_at(SRC_USB_RX, sim_t + RX_DELAY + h.cfg.jitter * sim_rand(), rx_fire);
+
+	h.sofnom += 1e-3 / (1 + h.cfg.ppm * 1e-6);
+	sim_at(SRC_SOF, h.sofnom + h.cfg.jitter * (sim_rand() - .5), sof_fire);
+}
+
+void host_start(const host_cfg_t *cfg)
+{
+	h.cfg = *cfg;
+	h.sofnom = sim_t + 1e-3;
+	sim_at(SRC_SOF, h.sofnom, sof_fire);
+}
+
+/*
+ * one control transfer at a time; stream starts once interface
+ * and rate are both set, nominal rate till first feedback
+ */
+bool host_control(host_req_t *req)
+{
+	if (h.req) return false;
+
+	h.req = req;
+	sim_pend(NVIC_USB_LP_IRQ);
+	return true;
+}
+
+void host_stream(bool on)
+{
+	h.streaming = on && h.alt;
+	h.fb = h.fbavg = FEEDBACK(h.cfg.rate);
+	h.acc = h.npkt = 0;
+	h.rx = false;
+}
+
+uint32_t host_feedback(void)
+{
+	return h.fb;
+}
+
+uint32_t host_dropped(void)
+{
+	return h.dropped;
+}
@@ -27,6 +27,8 @@ BODY = "\
 \n\
 #include <stdint.h>\n\
 \n\
+#define __fastdata __attribute__((section(\".data.fast\")))\n\
+\n\
 const float scale[] = {\n\
 %s\
 };\n\
@@ -35,11 +37,11 @@ const int16_t db[] = {\n\
 %s\
 };\n\
 \n\
-const float hc_sr[] = {\n\
+const float hc_sr[] __fastdata = {\n\
 %s\
 };\n\
 \n\
-const float hc_dr[] = {\n\
+const float hc_dr[] __fastdata = {\n\
 %s\
 };\n\
 \n\
@@ -109,6 +111,15 @@ UPSAMPLE_SHIFT_DR = 2;
 % ---------------------------------------
 
 av = argv();
+% tables.m out [upsample_shift phaselen]: design space points, see
+% tools/explore.py; double rate keeps phase length at half upsample
+if (numel(av) >= 3)
+  UPSAMPLE_SHIFT_SR = str2num(av{2});
+  UPSAMPLE_SHIFT_DR = UPSAMPLE_SHIFT_SR - 1;
+  NUMTAPS_SR = str2num(av{3}) * 2^UPSAMPLE_SHIFT_SR;
+  NUMTAPS_DR = NUMTAPS_SR / 2;
+endif
+
 switch (substr(av{1}, -1))
   case "h"
     fd = fopen(av{1}, "w");
@@ -0,0 +1,87 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * pipeline statistics, served by vendor device request
+ * TELEMETRY_GET (bmRequestType 0xc0), little endian; shared
+ * with host tool, so no firmware headers here.
+ * Counters are free running since power up, ring fill
+ * extremes are since previous request.
+ */
+#include <stdint.h>
+
+#define TELEMETRY_GET		0x01
+#define TELEMETRY_VERSION	2
+
+typedef struct __attribute__((packed)) {
+	uint8_t version;
+	uint8_t format;		/* alt setting */
+	uint8_t state;		/* closed, fill, running, drain */
+	uint8_t load;		/* cpu, percent */
+	uint32_t rate;		/* Hz */
+	uint32_t feedback;	/* Q10.14 frames per ms */
+	uint16_t rbmin;		/* ring fill, bytes */
+	uint16_t rbmax;
+	uint32_t opens;
+	uint32_t late;
+	uint32_t underrun;
+	uint32_t overrun;
+	uint32_t partial;
+	uint32_t missed;
+	uint32_t evlate;	/* frames */
+	uint32_t clip[3];	/* l, r, c */
+	uint32_t pump_avg;	/* cycles per block */
+	uint32_t pump_max;
+	uint16_t rbtarget;	/* ring fill feedback settles to, bytes */
+} telemetry_t;
+
+/*
+ * end-to-end latency off marker frames host plays, l at positive
+ * and r at negative full scale: LATENCY_ARM (bmRequestType 0x40)
+ * with wValue 1 arms measurement, 0 disarms it; LATENCY_GET (0xc0)
+ * reads latest result, there's one once seq is non-zero
+ */
+#define LATENCY_ARM		0x02
+#define LATENCY_GET		0x03
+
+typedef struct __attribute__((packed)) {
+	uint8_t armed;
+	uint8_t format;		/* alt setting */
+	uint16_t sof;		/* SOF count marker packet came after */
+	uint32_t rate;		/* Hz */
+	uint32_t seq;		/* markers found since armed */
+	uint16_t page;		/* pwm dma page marker peak plays from */
+	uint16_t offset;	/* output frame within it */
+	uint32_t ring;		/* packet rx to rendering, us */
+	uint32_t total;		/* packet rx to peak played, us */
+} latency_t;
+
+/*
+ * loopback capture tap, wValue: 0 past filter(), 1 noise shaper
+ * output (bmRequestType 0x40); capture itself is interface 2
+ */
+#define CAPTURE_TAP		0x04
+
+/*
+ * headphone correction FIR, see conv.h: CONV_UPLOAD (0x40) with
+ * up to CONV_CHUNK little endian float taps for channel wIndex,
+ * 0 l, 1 r, starting at tap wValue; CONV_COMMIT (0x40) puts first
+ * wValue taps in use from next block on, 0 bypasses, stalls if over
+ * budget or previous one is still pending; CONV_STATUS (0xc0)
+ */
+#define CONV_UPLOAD		0x05
+#define CONV_COMMIT		0x06
+#define CONV_STATUS		0x07
+
+typedef struct __attribute__((packed)) {
+	uint16_t ntaps;		/* in use, 0 bypassed */
+	uint16_t budget;	/* taps there's room for at rate */
+	uint16_t maxtaps;
+	uint8_t pending;	/* committed, not in use yet */
+	uint8_t chunk;		/* taps per upload */
+	uint32_t overload;	/* times bypassed for pump() going over */
+	uint32_t cost;		/* per block, cpu cycles */
+	uint32_t rate;		/* Hz */
+} conv_status_t;
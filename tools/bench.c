@@ -0,0 +1,192 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-bench [-n blocks] [-c] [-s]: runs dsp core natively over
+ *  every input format, rate and boost setting; -c prints CSV instead,
+ *  -s follows each setting with per stage report, prof_report()
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ctl.h"
+#include "prof.h"
+#include "tables.h"
+#include "tools/host.h"
+
+/*
+ * as usb descriptors have them
+ */
+static const struct {
+	sample_fmt fmt;
+	const char *name;
+	bool dr;		/* 88.2/96k too */
+} formats[] = {
+	{ SAMPLE_FORMAT_S16,	"s16",		true },
+	{ SAMPLE_FORMAT_S24,	"s24",		true },
+	{ SAMPLE_FORMAT_S32,	"s32",		false },
+	{ SAMPLE_FORMAT_F32,	"f32",		false },
+	{ SAMPLE_FORMAT_S16_LFE, "s16lfe",	false },
+	{ SAMPLE_FORMAT_S24_LFE, "s24lfe",	false }
+};
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_44100,
+	SAMPLE_RATE_48000,
+	SAMPLE_RATE_88200,
+	SAMPLE_RATE_96000
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(96 * 3 * 4)
+
+/*
+ * 1ms packet of 1kHz sine at -6dBFS, every channel
+ */
+static uint16_t packet(uint8_t *dst, sample_fmt fmt, sample_rate rate)
+{
+	unsigned nframes = rate / 1000, nch = nchannels(fmt);
+	uint8_t *p = dst;
+
+	for (unsigned i = 0; i < nframes; i++) {
+		double x = .5 * sin(2 * M_PI * 1000 * i / rate);
+		for (unsigned k = 0; k < nch; k++) {
+			int32_t v;
+			switch (fmt) {
+			case SAMPLE_FORMAT_S16:
+			case SAMPLE_FORMAT_S16_LFE:
+				v = x * INT16_MAX;
+				memcpy(p, &v, 2);
+				break;
+			case SAMPLE_FORMAT_S24:
+			case SAMPLE_FORMAT_S24_LFE:
+				v = x * 0x7fffff;
+				memcpy(p, &v, 3);
+				break;
+			case SAMPLE_FORMAT_S32:
+				v = x * INT32_MAX;
+				memcpy(p, &v, 4);
+				break;
+			case SAMPLE_FORMAT_F32: {
+				float f = x;
+				memcpy(p, &f, 4);
+				break;
+			}
+			default:
+				break;
+			}
+			p += framesize(fmt) / nch;
+		}
+	}
+
+	return p - dst;
+}
+
+typedef struct {
+	uint32_t blocks;
+	double ns;		/* per block */
+	double rt;		/* block period, ns */
+} result_t;
+
+static result_t run(sample_fmt fmt, sample_rate rate, bool dr, uint32_t n)
+{
+	uint8_t buf[MAX_PACKET];
+	uint16_t len = packet(buf, fmt, rate);
+	uint32_t blocks = 0, warmup = n / 16;
+	uint64_t total = 0;
+	result_t r;
+
+	rb_setup(fmt, dr);
+	bzero((void *)&stats, sizeof(stats));
+	while (blocks < warmup) {
+		rb_put(buf, len);
+		while (pump()) blocks++;
+	}
+	bzero((void *)prof, sizeof(prof));
+
+	for (blocks = 0; blocks < n; ) {
+		uint32_t t0 = prof_time();
+		rb_put(buf, len);
+		while (pump()) blocks++;
+		total += (uint32_t)(prof_time() - t0);
+	}
+
+	r.blocks = blocks;
+	r.ns = (double)total / blocks;
+	r.rt = 1e9 * (BFRAMES >> (dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR))
+		/ rate;
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n = 20000;
+	bool csv = false, stages = false;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:cs")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			csv = true;
+			break;
+		case 's':
+			stages = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n blocks] [-c] [-s]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (csv)
+		printf("format,rate,boost,blocks,ns_block,blocks_s,headroom,"
+		       "reframe,rms,filter,upsample,sigmadelta,clip\n");
+	else
+		printf("%-7s %6s %5s %10s %10s %9s %8s\n", "format", "rate",
+		       "boost", "ns/block", "blocks/s", "headroom", "clip");
+
+	for (unsigned i = 0; i < NELEM(formats); i++)
+	for (unsigned k = 0; k < NELEM(rates); k++)
+	for (unsigned b = 0; b < 2; b++) {
+		bool dr = rates[k] > SAMPLE_RATE_48000;
+		result_t r;
+
+		if (dr && !formats[i].dr) continue;
+
+		cstate.on[boost] = b;
+		cstate.format = formats[i].fmt;
+		cstate.rate = rates[k];
+		ctl_publish();
+		r = run(formats[i].fmt, rates[k], dr, n);
+
+		if (csv)
+			printf("%s,%u,%u,%u,%.1f,%.0f,%.2f,%u,%u,%u,%u,%u,%u\n",
+			       formats[i].name, rates[k], b, r.blocks,
+			       r.ns, 1e9 / r.ns, r.rt / r.ns,
+			       prof[PROF_REFRAME].avg, prof[PROF_RMS].avg,
+			       prof[PROF_FILTER].avg, prof[PROF_UPSAMPLE].avg,
+			       prof[PROF_SIGMADELTA].avg,
+			       stats.clip[0] + stats.clip[1] + stats.clip[2]);
+		else
+			printf("%-7s %6u %5s %10.1f %10.0f %8.1fx %8u\n",
+			       formats[i].name, rates[k], b ? "on" : "off",
+			       r.ns, 1e9 / r.ns, r.rt / r.ns,
+			       stats.clip[0] + stats.clip[1] + stats.clip[2]);
+
+		if (stages && !csv) {
+			prof_report();
+			printf("\n");
+		}
+	}
+
+	return 0;
+}
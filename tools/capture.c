@@ -0,0 +1,267 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-capture [-v]: checks loopback capture, cap.c and its dsp
+ *  core hooks, on synthetic 1ms packet streams of two tones, with
+ *  pwm played at nominal rate and capture drained a packet a SOF,
+ *  as usbd.c does. Filter tap is checked against input frames as
+ *  reframe() scales them, boost off, noise shaper tap against duty
+ *  pump() rendered; exits 1 on frame off by more than 1 LSB, ring
+ *  overrun, or short packet past prefill
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "cap.h"
+#include "ctl.h"
+#include "tables.h"
+#include "tools/host.h"
+
+static const struct {
+	sample_fmt fmt;
+	const char *name;
+	float fs;		/* full scale, as set_scale() has it */
+	bool dr;		/* 88.2/96k too */
+} formats[] = {
+	{ SAMPLE_FORMAT_S16,	"s16",		1 << 15,	true },
+	{ SAMPLE_FORMAT_S24,	"s24",		1 << 23,	true },
+	{ SAMPLE_FORMAT_F32,	"f32",		1,		false },
+	{ SAMPLE_FORMAT_S16_LFE, "s16lfe",	1 << 15,	false }
+};
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_44100,
+	SAMPLE_RATE_48000,
+	SAMPLE_RATE_88200,
+	SAMPLE_RATE_96000
+};
+
+static const char * const taps[CAP_TAP_NUM] = {
+	[CAP_TAP_FILTER] = "filter",
+	[CAP_TAP_NS] = "ns"
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(97 * 3 * 4)
+
+#define RUN_MS		300
+#define PREFILL		2	/* packets in ring, past full pwm queue */
+#define MAX_IN		(RUN_MS * SAMPLE_RATE_96000 / 1000)
+#define MAX_OUT		(MAX_IN << UPSAMPLE_SHIFT_DR)
+#define MAX_CAP		(RUN_MS * CAP_PACKET_FRAMES)
+
+static bool verbose;
+
+static float in[MAX_IN][2];		/* l/r as host sent them */
+static uint8_t duty[MAX_OUT][2];	/* l/r, per output frame */
+static cap_frame_t got[MAX_CAP];
+
+/*
+ * two tones, 0.4 full scale each, l at ~1k, r at ~3k
+ */
+static float tone(unsigned ch, uint32_t frame, sample_rate rate)
+{
+	return 0.4f * sinf(2 * M_PI * (ch ? 3011.0f : 997.0f) * frame / rate);
+}
+
+static uint16_t packet(uint8_t *dst, sample_fmt fmt, float fs,
+		       unsigned nframes, uint32_t frame, sample_rate rate)
+{
+	unsigned width = framesize(fmt) / nchannels(fmt);
+
+	memset(dst, 0, nframes * framesize(fmt));
+
+	for (unsigned i = 0; i < nframes; i++, frame++) {
+		for (unsigned ch = 0; ch < 2; ch++) {
+			uint8_t *p = dst + i * framesize(fmt) + ch * width;
+			float x = tone(ch, frame, rate);
+			int32_t v = lrintf(x * fs);
+
+			if (fmt == SAMPLE_FORMAT_F32) {
+				memcpy(p, &x, 4);
+			} else {
+				memcpy(p, &v, width);
+				x = v;
+			}
+			in[frame][ch] = x;
+		}
+	}
+
+	return nframes * framesize(fmt);
+}
+
+/*
+ * what cap_filter() should make of input, as reframe() scales it
+ */
+static void expect_filter(cap_frame_t *e, uint32_t k, float fs, bool dr)
+{
+	unsigned decim = CAP_DECIM << dr;
+	float s = scale[cstate.attn] / fs, acc[2] = { 0 };
+
+	for (unsigned i = 0; i < decim; i++)
+		for (unsigned ch = 0; ch < 2; ch++)
+			acc[ch] += s * in[k * decim + i][ch];
+
+	e->l = MAX(MIN(acc[0] * (32768.0f / decim), INT16_MAX), INT16_MIN);
+	e->r = MAX(MIN(acc[1] * (32768.0f / decim), INT16_MAX), INT16_MIN);
+}
+
+/*
+ * ... and cap_duty() of rendered duty
+ */
+static void expect_ns(cap_frame_t *e, uint32_t k, unsigned span)
+{
+	const int32_t qf = 1 << (PWM_WIDTH - 1);
+	int32_t acc[2] = { 0 };
+
+	for (unsigned i = 0; i < span; i++)
+		for (unsigned ch = 0; ch < 2; ch++)
+			acc[ch] += duty[k * span + i][ch] - qf;
+
+	e->l = acc[0] * (32768 / qf) / (int32_t)span;
+	e->r = acc[1] * (32768 / qf) / (int32_t)span;
+}
+
+/*
+ * pump() kept BLOCKS_AHEAD of pwm, as pframe() would have it
+ */
+static void render(void)
+{
+	while (host_blocks - host_played / BFRAMES <= BLOCKS_AHEAD && pump()) {
+		uint32_t pos = pframe_pos();
+
+		for (unsigned i = 0; i < BFRAMES; i++)
+			if (pos + i < MAX_OUT) {
+				duty[pos + i][0] = host_block[i * NCHANNELS];
+				duty[pos + i][1] = host_block[i * NCHANNELS + 1];
+			}
+	}
+}
+
+/*
+ * 1ms ticks: SOF drains a capture packet, packet comes, pwm plays
+ * a ms worth once queue is full and ring has PREFILL packets on top
+ */
+static int run(const char *name, sample_fmt fmt, float fs,
+	       sample_rate rate, cap_tap tap)
+{
+	bool dr = rate > SAMPLE_RATE_48000;
+	unsigned shift = dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+	unsigned span = (CAP_DECIM << dr) << shift;
+	uint32_t orate = (uint32_t)rate << shift;
+	uint32_t frames = 0, ncap = 0, short_pkts = 0, start = 0, end;
+	unsigned nmin = CAP_PACKET_FRAMES, nmax = 0, bad = 0;
+	int worst = 0;
+	bool playing = false, filled = false;
+
+	cstate.format = fmt;
+	cstate.rate = rate;
+	cstate.attn = 0;
+	cstate.on[boost] = false;
+	ctl_publish();
+	rb_setup(fmt, dr);
+	host_blocks = host_played = 0;
+	memset(duty, 0, sizeof(duty));
+	cap.overrun = cap.underrun = 0;
+	cap_set_tap(tap);
+	cap_start(true);
+
+	for (unsigned ms = 0; ms < RUN_MS; ms++) {
+		uint8_t buf[MAX_PACKET];
+		unsigned n = (uint64_t)rate * (ms + 1) / 1000 - frames;
+		uint16_t space, k;
+
+		k = cap_packet(&got[ncap], rate);
+		if (k) {
+			filled = true;
+			nmin = MIN(nmin, k);
+			nmax = MAX(nmax, k);
+		} else if (filled) {
+			short_pkts++;
+		}
+		ncap += k;
+
+		space = rb_put(buf, packet(buf, fmt, fs, n, frames, rate));
+		frames += n;
+
+		render();
+
+		if (!playing && host_blocks > BLOCKS_AHEAD &&
+		    RBSIZE - 1U - space >= PREFILL * n * framesize(fmt)) {
+			playing = true;
+			start = ms;
+		}
+		if (!playing)
+			continue;
+
+		end = (uint64_t)orate * (ms + 1 - start) / 1000;
+		while (host_played < end) {
+			host_played = MIN(end, (host_played / BFRAMES + 1) * BFRAMES);
+			render();
+		}
+	}
+
+	/* only frames pwm has played are sure to be rendered */
+	for (uint32_t i = 0; i < ncap && (i + 1) * span <= host_played; i++) {
+		cap_frame_t e;
+		int d;
+
+		if (tap == CAP_TAP_FILTER)
+			expect_filter(&e, i, fs, dr);
+		else
+			expect_ns(&e, i, span);
+
+		d = MAX(abs(got[i].l - e.l), abs(got[i].r - e.r));
+		worst = MAX(worst, d);
+		if (d > 1) {
+			if (verbose && bad < 8)
+				printf("  frame %u got %d,%d expected %d,%d\n",
+				       i, got[i].l, got[i].r, e.l, e.r);
+			bad++;
+		}
+	}
+
+	printf("%-7s %6u %-6s %6u %3u..%-3u %5u %5u %5u %5d %s\n",
+	       name, rate, taps[tap], ncap, nmin, nmax, cap.overrun,
+	       cap.underrun, short_pkts, worst,
+	       bad || cap.overrun || cap.underrun || short_pkts ? "FAIL" : "ok");
+
+	cap_start(false);
+	return bad || cap.overrun || cap.underrun || short_pkts;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%-7s %6s %-6s %6s %8s %5s %5s %5s %5s\n", "format", "rate",
+	       "tap", "frames", "packet", "over", "under", "short", "worst");
+
+	for (unsigned i = 0; i < NELEM(formats); i++)
+	for (unsigned k = 0; k < NELEM(rates); k++)
+	for (unsigned t = 0; t < CAP_TAP_NUM; t++) {
+		if (rates[k] > SAMPLE_RATE_48000 && !formats[i].dr)
+			continue;
+		fail |= run(formats[i].name, formats[i].fmt, formats[i].fs,
+			    rates[k], t);
+	}
+
+	return fail;
+}
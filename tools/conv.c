@@ -0,0 +1,382 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-conv [-n blocks] [-c]: checks headphone correction FIR,
+ *  conv.c, against direct convolution in double over random taps
+ *  and input, blocks of either rate's length, banks swapped midway;
+ *  then that a unit impulse leaves pump() output bit exact. Then
+ *  runs dsp core over tap counts at every rate, as host-bench does,
+ *  with budget conv_budget() makes of it and times conv_run() had
+ *  to bypass itself; -c prints that as CSV. Overload bypass is
+ *  checked on forged pump() figures, to trip, hold, and come back
+ *  as headroom returns, on new stream and on commit. Exits 1 if any
+ *  check fails, whatever timing host gives
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "conv.h"
+#include "ctl.h"
+#include "prof.h"
+#include "tables.h"
+#include "tools/host.h"
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_44100,
+	SAMPLE_RATE_48000,
+	SAMPLE_RATE_88200,
+	SAMPLE_RATE_96000
+};
+
+static const uint16_t ntaps[] = { 0, 32, 64, 128, 192, 256 };
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(96 * 2 * 2)
+#define NCHECK		12	/* blocks */
+#define MAX_IN		(NCHECK * (BFRAMES >> UPSAMPLE_SHIFT_DR))
+
+#if CONV_MAXTAPS != 256
+#error ntaps[] wants updating
+#endif
+
+static float h[2][2][CONV_MAXTAPS];	/* before and after swap, l/r */
+static float x[2][MAX_IN];
+
+static float rnd(void)
+{
+	return 2.0f * rand() / RAND_MAX - 1.0f;
+}
+
+/*
+ * taps uploaded a chunk at a time, as over usb, committed with
+ * nothing measured, so whole budget's there, then picked up as
+ * dsp would at block start
+ */
+static void use(const float (*taps)[CONV_MAXTAPS], uint16_t n)
+{
+	frame_t none;
+
+	for (unsigned ch = 0; ch < 2; ch++)
+		for (unsigned i = 0; i < n; i += CONV_CHUNK)
+			conv_load(ch, i, &taps[ch][i], MIN(CONV_CHUNK, n - i));
+
+	bzero((void *)prof, sizeof(prof));
+	if (!conv_commit(n, cstate.rate)) {
+		fprintf(stderr, "commit of %u taps refused\n", n);
+		exit(1);
+	}
+	conv_run(&none, 0);
+}
+
+/*
+ * n taps, then m from block swap on; worst error relative
+ * to sum of |taps|, as input is within +-1
+ */
+static double check(uint16_t n, uint16_t m, unsigned nframes, unsigned swap)
+{
+	frame_t buf[BFRAMES >> UPSAMPLE_SHIFT_DR];
+	double worst = 0;
+
+	for (unsigned b = 0; b < 2; b++)
+		for (unsigned ch = 0; ch < 2; ch++)
+			for (unsigned i = 0; i < CONV_MAXTAPS; i++)
+				h[b][ch][i] = rnd() / (i + 1);
+	for (unsigned ch = 0; ch < 2; ch++)
+		for (unsigned i = 0; i < MAX_IN; i++)
+			x[ch][i] = rnd();
+
+	conv_reset();
+	use(h[0], n);
+
+	for (unsigned b = 0; b < NCHECK; b++) {
+		unsigned k = b >= swap, taps = k ? m : n;
+
+		if (b == swap)
+			use(h[1], m);
+
+		for (unsigned i = 0; i < nframes; i++) {
+			buf[i].l = x[0][b * nframes + i];
+			buf[i].r = x[1][b * nframes + i];
+			buf[i].c = 0.0f;
+		}
+		conv_run(buf, nframes);
+
+		for (unsigned i = 0; i < nframes; i++) {
+			unsigned at = b * nframes + i;
+			double y[2] = { 0 }, norm[2] = { 0 };
+
+			for (unsigned ch = 0; ch < 2; ch++) {
+				for (unsigned j = 0; j < taps && j <= at; j++)
+					y[ch] += (double)h[k][ch][j] * x[ch][at - j];
+				for (unsigned j = 0; j < taps; j++)
+					norm[ch] += fabs(h[k][ch][j]);
+			}
+			if (!taps) {	/* bypassed */
+				y[0] = x[0][at];
+				y[1] = x[1][at];
+				norm[0] = norm[1] = 1;
+			}
+			worst = MAX(worst, fabs(buf[i].l - y[0]) / norm[0]);
+			worst = MAX(worst, fabs(buf[i].r - y[1]) / norm[1]);
+		}
+	}
+
+	return worst;
+}
+
+/*
+ * 1ms packet of 1kHz sine at -6dBFS, s16
+ */
+static uint16_t packet(uint8_t *dst, sample_rate rate)
+{
+	unsigned nframes = rate / 1000;
+	int16_t *p = (int16_t *)dst;
+
+	for (unsigned i = 0; i < nframes; i++) {
+		*p++ = .5 * INT16_MAX * sin(2 * M_PI * 1000 * i / rate);
+		*p++ = .5 * INT16_MAX * cos(2 * M_PI * 1000 * i / rate);
+	}
+
+	return nframes * 4;
+}
+
+/*
+ * duty rendered over n blocks, with unit impulse of ntaps or bypassed;
+ * boost off, as filter() state carries over streams, upsample()
+ * backlog is same for same stream
+ */
+static void render(uint8_t *out, unsigned n, uint16_t taps)
+{
+	uint8_t buf[MAX_PACKET];
+	uint16_t len = packet(buf, SAMPLE_RATE_48000);
+	float delta[2][CONV_MAXTAPS] = { { 1.0f }, { 1.0f } };
+
+	cstate.on[boost] = false;
+	cstate.format = SAMPLE_FORMAT_S16;
+	cstate.rate = SAMPLE_RATE_48000;
+	ctl_publish();
+	rb_setup(SAMPLE_FORMAT_S16, false);
+	use(delta, taps);
+
+	while (n) {
+		rb_put(buf, len);
+		while (n && pump()) {
+			memcpy(out, host_block, BLOCKSZ);
+			out += BLOCKSZ;
+			n--;
+		}
+	}
+}
+
+/*
+ * one block at 48k with pump() having taken pump, conv conv, of block
+ * period, conv.c as host builds see it; halving taps are in use, so
+ * true if output is input as is, bypassed
+ */
+static bool bypassed(float pump, float conv)
+{
+	unsigned nframes = BFRAMES >> UPSAMPLE_SHIFT_SR;
+	float period = 1e9f * nframes / SAMPLE_RATE_48000;
+	frame_t buf[BFRAMES >> UPSAMPLE_SHIFT_SR];
+	bool as_is = true;
+
+	prof[PROF_PUMP].n = 1;
+	prof[PROF_PUMP].avg = pump * period;
+	if (conv >= 0) {
+		prof[PROF_CONV].n = 1;
+		prof[PROF_CONV].avg = conv * period;
+	}
+
+	for (unsigned i = 0; i < nframes; i++)
+		buf[i] = (frame_t) { .l = 1.0f, .r = -1.0f };
+	conv_run(buf, nframes);
+
+	for (unsigned i = 0; i < nframes; i++)
+		as_is &= buf[i].l == 1.0f && buf[i].r == -1.0f;
+
+	return as_is;
+}
+
+/*
+ * trip at CONV_LOAD, stay bypassed till pump() less bypassed conv,
+ * plus what conv took at trip, is under CONV_RESUME, then filter
+ * again; tripped, new stream and commit bring it back as well.
+ * Returns steps that went otherwise
+ */
+static unsigned overload(void)
+{
+	static const float half[2][CONV_MAXTAPS] = { { .5f }, { .5f } };
+	static const struct {
+		const char *name;
+		float pump, conv;	/* of period, conv < 0 as it is */
+		bool bypassed;
+		uint32_t overload;
+	} step[] = {
+		{ "under",  .70f,  .10f, false, 0 },
+		{ "trip",   .80f,  .10f, true,  1 },
+		{ "over",   .80f,  -1,   true,  1 },
+		{ "short",  .55f,  .01f, true,  1 },
+		{ "resume", .45f,  .01f, false, 1 },
+		{ "under",  .70f,  .10f, false, 1 },
+		{ "trip",   .90f,  .10f, true,  2 },
+		{ "stream", .70f,  .01f, false, 2 },
+		{ "trip",   .90f,  .10f, true,  3 },
+		{ "commit", .70f,  .01f, false, 3 },
+	};
+	uint32_t bypass0 = stats.bypassed, blocks = 0;
+	unsigned bad = 0;
+
+	cstate.rate = SAMPLE_RATE_48000;
+	conv_reset();
+	use(half, CONV_CHUNK);
+	conv.overload = 0;
+
+	for (unsigned k = 0; k < NELEM(step); k++) {
+		bool b;
+
+		if (!strcmp(step[k].name, "stream"))
+			conv_reset();
+		if (!strcmp(step[k].name, "commit"))
+			use(half, CONV_CHUNK);
+
+		b = bypassed(step[k].pump, step[k].conv);
+		blocks += b;
+		if (b != step[k].bypassed || conv.overload != step[k].overload ||
+		    conv.ntaps != CONV_CHUNK ||
+		    stats.bypassed - bypass0 != blocks) {
+			printf("overload step %u %s: %s, overload %u, "
+			       "bypassed %u, taps %u FAIL\n", k, step[k].name,
+			       b ? "bypassed" : "filtered", conv.overload,
+			       stats.bypassed - bypass0, conv.ntaps);
+			bad++;
+		}
+	}
+
+	return bad;
+}
+
+typedef struct {
+	double ns;		/* pump(), mean per block */
+	double conv;		/* conv stage, mean per block */
+	double rt;		/* block period, ns */
+	uint16_t budget;
+	uint32_t overload;	/* bypassed by pump() going over */
+} result_t;
+
+static result_t run(sample_rate rate, uint16_t taps, uint32_t n)
+{
+	bool dr = rate > SAMPLE_RATE_48000;
+	uint8_t buf[MAX_PACKET];
+	uint16_t len = packet(buf, rate);
+	uint32_t blocks = 0;
+	result_t r;
+
+	cstate.on[boost] = true;
+	cstate.format = SAMPLE_FORMAT_S16;
+	cstate.rate = rate;
+	ctl_publish();
+	rb_setup(SAMPLE_FORMAT_S16, dr);
+	use(h[0], taps);
+	conv.overload = 0;
+
+	while (blocks < n / 16) {
+		rb_put(buf, len);
+		while (pump()) blocks++;
+	}
+	bzero((void *)prof, sizeof(prof));
+	for (blocks = 0; blocks < n; ) {
+		rb_put(buf, len);
+		while (pump()) blocks++;
+	}
+
+	r.ns = (double)prof[PROF_PUMP].acc / prof[PROF_PUMP].n;
+	r.conv = (double)prof[PROF_CONV].acc / prof[PROF_CONV].n;
+	r.rt = 1e9 * (BFRAMES >> (dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR))
+		/ rate;
+	r.budget = conv_budget(rate);
+	r.overload = conv.overload;
+
+	return r;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t a[16 * BLOCKSZ], b[16 * BLOCKSZ];
+	uint32_t n = 4000;
+	unsigned stuck;
+	bool csv = false;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:c")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			csv = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n blocks] [-c]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (unsigned dr = 0; dr < 2; dr++)
+	for (unsigned i = 0; i < NELEM(ntaps); i++) {
+		unsigned nframes = BFRAMES >> (dr ? UPSAMPLE_SHIFT_DR :
+					       UPSAMPLE_SHIFT_SR);
+		uint16_t m = ntaps[(i + 1) % NELEM(ntaps)];
+		double e;
+
+		if (m) m--;		/* odd, and 256 -> 0 bypasses */
+		e = check(ntaps[i], m, nframes, NCHECK / 2);
+
+		if (!csv)
+			printf("check %3u frames %3u -> %3u taps: "
+			       "error %.2e %s\n", nframes, ntaps[i], m, e,
+			       e < 1e-5 ? "ok" : "FAIL");
+		fail |= !(e < 1e-5);
+	}
+
+	render(a, 16, 0);
+	render(a, 16, 0);
+	render(b, 16, CONV_MAXTAPS);
+	if (!csv)
+		printf("unit impulse: %s\n", memcmp(a, b, sizeof(a)) ?
+		       "FAIL" : "bit exact");
+	fail |= !!memcmp(a, b, sizeof(a));
+
+	stuck = overload();
+	if (!csv)
+		printf("overload: trip, hold, resume, stream, commit: %s\n",
+		       stuck ? "FAIL" : "ok");
+	fail |= stuck != 0;
+
+	if (csv)
+		printf("rate,taps,ns_block,ns_conv,headroom,budget,overload\n");
+	else
+		printf("%6s %5s %10s %10s %9s %7s %8s\n", "rate", "taps",
+		       "ns/block", "ns/conv", "headroom", "budget", "overload");
+
+	for (unsigned k = 0; k < NELEM(rates); k++)
+	for (unsigned i = 0; i < NELEM(ntaps); i++) {
+		result_t r = run(rates[k], ntaps[i], n);
+
+		if (csv)
+			printf("%u,%u,%.1f,%.1f,%.2f,%u,%u\n", rates[k],
+			       ntaps[i], r.ns, r.conv, r.rt / r.ns, r.budget,
+			       r.overload);
+		else
+			printf("%6u %5u %10.1f %10.1f %8.1fx %7u %8u\n",
+			       rates[k], ntaps[i], r.ns, r.conv, r.rt / r.ns,
+			       r.budget, r.overload);
+	}
+
+	return fail;
+}
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# dbgdecode.py f4uac.elf swo.bin: decodes DEBUG build binary log,
+# as captured off SWO (raw ITM stream, e.g. openocd
+# 'tpiu config internal swo.bin uart off <cpu hz>'),
+# looking format strings and function names up in the elf
+
+import re
+import struct
+import sys
+
+DBG_SYNC = 0xdb
+DBG_ITM_PORT = 1
+TRACE = {1: "rx len<<16|fill", 2: "feedback", 3: "ac status",
+         4: "measured", 5: "late", 6: "underrun", 7: "pump cycles"}
+
+
+class Elf:
+    def __init__(self, path):
+        self.data = open(path, "rb").read()
+        (phoff,) = struct.unpack_from("<I", self.data, 28)
+        phentsize, phnum = struct.unpack_from("<HH", self.data, 42)
+        self.segs = []
+        for i in range(phnum):
+            (ptype, off, vaddr, _, filesz, _, _, _) = \
+                struct.unpack_from("<8I", self.data, phoff + i * phentsize)
+            if ptype == 1:              # PT_LOAD
+                self.segs.append((vaddr, off, filesz))
+
+    def string(self, addr):
+        for vaddr, off, filesz in self.segs:
+            if vaddr <= addr < vaddr + filesz:
+                p = off + addr - vaddr
+                return self.data[p:self.data.index(b"\0", p)].decode()
+        return "<%08x>" % addr
+
+
+def itm_words(stream, port):
+    """32 bit payloads of instrumentation packets to port"""
+    i = 0
+    while i < len(stream):
+        h = stream[i]
+        i += 1
+        if h in (0, 0x70, 0x80):                # sync, its end, overflow
+            continue
+        if h & 3 == 0:                          # timestamp, extension
+            while i < len(stream) and h & 0x80:
+                h = stream[i]
+                i += 1
+            continue
+        size = {1: 1, 2: 2, 3: 4}[h & 3]
+        payload = stream[i:i + size]
+        i += size
+        if not h & 4 and h >> 3 == port and size == 4:
+            yield struct.unpack("<I", payload)[0]
+
+
+def cformat(fmt, args, elf):
+    it = iter(args)
+
+    def conv(m):
+        spec = m.group(0)
+        if spec == "%%":
+            return "%"
+        v = next(it, 0)
+        spec = re.sub(r"[lhz]", "", spec)
+        if spec[-1] == "s":
+            return spec % elf.string(v)
+        if spec[-1] in "di" and v & 0x80000000:
+            v -= 1 << 32
+        return spec % v
+    return re.sub(r"%[-+ 0#]*\d*(?:\.\d+)?[lhz]*[diouxXcs%]", conv, fmt)
+
+
+def records(words):
+    w = iter(words)
+    for head in w:
+        if head >> 24 != DBG_SYNC:
+            continue                            # resync
+        try:
+            n = head >> 16 & 0xff
+            stamp, fmt, func = next(w), next(w), next(w)
+            args = [next(w) for _ in range(n)]
+        except StopIteration:
+            return
+        yield head & 0xffff, stamp, fmt, func, args
+
+
+def main():
+    elf = Elf(sys.argv[1])
+    stream = open(sys.argv[2], "rb").read()
+    last = None
+    for seq, stamp, fmt, func, args in records(itm_words(stream, DBG_ITM_PORT)):
+        if fmt == 0:
+            print("%10u ---- %u records dropped" % (stamp, args[0]))
+            continue
+        if last is not None and seq != (last + 1) & 0xffff:
+            print("%10u ---- gap %u..%u" % (stamp, last, seq))
+        last = seq
+        if fmt < 0x100:
+            print("%10u %5u trace %u %s: %u (0x%x)" % (
+                stamp, seq, fmt, TRACE.get(fmt, "?"), args[0], args[0]))
+        else:
+            print("%10u %5u %s(): %s" % (
+                stamp, seq, elf.string(func),
+                cformat(elf.string(fmt), args, elf).rstrip("\n")))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,212 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-debug [-p producers] [-n records] [-u spins] [-v]: hammers
+ *  DEBUG build binary log ring, debug.c as is. Producer threads
+ *  stand for isrs, each putting -n records through dbg_log(), with
+ *  its number, record number and check word for arguments, spinning
+ *  -u between; main thread stands for main loop, calling dbg_drain()
+ *  all along, and takes ITM words off itm_send(), spinning as much
+ *  for each, as SWO is slow, so ring fills up. Records are parsed back as dbgdecode.py
+ *  does. Exits 1 if a record is torn, out of its producer's order,
+ *  claim seq isn't one past previous, records drained and dropped
+ *  don't add up to those put, or ring never overflowed
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+
+#define DBG_SYNC	0xdb	/* as debug.c has it */
+#define MAXPROD		16
+#define NARGS		3
+
+static const char fmt[] = "producer %u record %u check %08x";
+
+static bool verbose;
+static unsigned spins = 200;
+
+volatile uint32_t sim_itm_ter[1] = { 1 << 1 };	/* DBG_ITM_PORT */
+
+static __thread unsigned seed;	/* producers only */
+
+/*
+ * stamp is taken between claim and commit: producer gives way
+ * there at times, so drain finds slots claimed, not written yet
+ */
+uint32_t sim_cycles(void)
+{
+	static uint32_t t;
+
+	if (seed && !(rand_r(&seed) % 16))
+		sched_yield();
+	return __atomic_fetch_add(&t, 1, __ATOMIC_RELAXED);
+}
+
+static void spin(void)
+{
+	volatile unsigned i = spins;
+
+	while (i--);
+}
+
+static uint32_t check(uint32_t id, uint32_t k)
+{
+	return ~k ^ id << 24;
+}
+
+static struct {
+	unsigned nprod;
+	uint32_t nrec;
+	unsigned done;
+} put;
+
+static void *produce(void *arg)
+{
+	uint32_t id = (uintptr_t)arg;
+
+	seed = id + 1;
+	for (uint32_t k = 0; k < put.nrec; k++) {
+		dbg_log(fmt, "produce", NARGS, id, k, check(id, k));
+		spin();
+		if (!(rand_r(&seed) % 16))	/* let drain in */
+			sched_yield();
+	}
+
+	__atomic_fetch_add(&put.done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/*
+ * drain side: ITM words parsed back into records as they come
+ */
+static struct {
+	uint32_t w[4 + DBG_NARGS];
+	unsigned nw, want;
+	uint32_t got, dropped, drops;
+	uint32_t seq;
+	bool first;
+	uint32_t next[MAXPROD];
+	uint32_t torn, order, gap;
+} tk = { .first = true };
+
+static void record(void)
+{
+	uint32_t n = tk.w[0] >> 16 & 0xff, seq = tk.w[0] & 0xffff;
+	uint32_t id = tk.w[4], k = tk.w[5];
+
+	if (!tk.w[2]) {			/* dropped count, port 0 */
+		tk.dropped += tk.w[4];
+		tk.drops++;
+		return;
+	}
+
+	tk.got++;
+	if (!tk.first && seq != ((tk.seq + 1) & 0xffff)) {
+		if (verbose && tk.gap < 8)
+			printf("  seq %u after %u\n", seq, tk.seq);
+		tk.gap++;
+	}
+	tk.seq = seq;
+	tk.first = false;
+
+	if (n != NARGS || tk.w[2] != (uint32_t)(uintptr_t)fmt ||
+	    id >= put.nprod || tk.w[6] != check(id, k)) {
+		if (verbose && tk.torn < 8)
+			printf("  torn: n %u producer %u record %u check "
+			       "%08x\n", n, id, k, tk.w[6]);
+		tk.torn++;
+		return;
+	}
+	if (k < tk.next[id]) {
+		if (verbose && tk.order < 8)
+			printf("  producer %u: record %u after %u\n", id, k,
+			       tk.next[id] - 1);
+		tk.order++;
+	}
+	tk.next[id] = k + 1;
+}
+
+void itm_send(uint32_t val)
+{
+	spin();
+
+	if (!tk.nw && val >> 24 != DBG_SYNC) {
+		tk.torn++;		/* out of sync, skip */
+		return;
+	}
+	tk.w[tk.nw++] = val;
+	if (tk.nw == 1)
+		tk.want = 4 + MIN(val >> 16 & 0xff, DBG_NARGS);
+	if (tk.nw == tk.want) {
+		record();
+		tk.nw = 0;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t th[MAXPROD];
+	uint32_t total;
+	int opt, fail;
+
+	put.nprod = 4;
+	put.nrec = 20000;
+
+	while ((opt = getopt(argc, argv, "p:n:u:v")) != -1) {
+		switch (opt) {
+		case 'p':
+			put.nprod = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			put.nrec = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			spins = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p producers] [-n records] "
+				"[-u spins] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!put.nprod || put.nprod > MAXPROD) put.nprod = 4;
+	if (!put.nrec) put.nrec = 1;
+
+	for (uintptr_t i = 0; i < put.nprod; i++)
+		if (pthread_create(&th[i], NULL, produce, (void *)i)) {
+			perror("pthread_create");
+			return 1;
+		}
+
+	while (__atomic_load_n(&put.done, __ATOMIC_ACQUIRE) < put.nprod)
+		dbg_drain();
+
+	for (unsigned i = 0; i < put.nprod; i++)
+		pthread_join(th[i], NULL);
+
+	/* whatever's left, then drop count since */
+	dbg_drain();
+	dbg_drain();
+
+	total = put.nprod * put.nrec;
+	fail = tk.torn || tk.order || tk.gap || tk.nw ||
+		tk.got + tk.dropped != total || !tk.dropped;
+
+	printf("%9s %9s %9s %6s %5s %5s %5s\n", "put", "drained", "dropped",
+	       "drops", "torn", "order", "gap");
+	printf("%9u %9u %9u %6u %5u %5u %5u %s\n", total, tk.got, tk.dropped,
+	       tk.drops, tk.torn, tk.order, tk.gap, fail ? "FAIL" : "ok");
+
+	return fail;
+}
@@ -0,0 +1,193 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-dmabuf [-v]: checks dmabuf byte layout sigmadelta() writes
+ *  against the order pwm dma bursts take it in. pwm.c is built as
+ *  is against mock hal, tools/pwmhal.c, which keeps what pwm() set
+ *  channel and TIM1 DCR up with; dsp core renders blocks of 2.1 DC,
+ *  l, r and c each at a level of its own, into pwm.c dmabuf, as
+ *  pframe() hands them out. Each TIM1 update, dma moves DCR burst
+ *  length items, MSIZE wide off memory, widened to PSIZE, into DMAR,
+ *  which timer passes on to CCRs from DCR base on. Exits 1 if setup
+ *  isn't byte to halfword, memory to TIM1 DMAR, circular, or burst
+ *  isn't CCR1..3, buffer halves don't fall on a frame, or any CCR
+ *  duty is past PWM_PERIOD or off its channel's level
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/timer.h>
+
+#include "common.h"
+#include "ctl.h"
+#include "tools/pwmhal.h"
+
+#define BLOCKSZ		(NCHANNELS * BFRAMES)
+#define DMABUFSZ	(NBLOCKS * BLOCKSZ)
+#define QF		(1U << (PWM_WIDTH - 1))
+
+#define CCR1_OFS	0x34	/* TIM1 CCR1, bytes */
+#define NLEVELS		3
+#define PACKET_FRAMES	48
+
+void rb_setup(sample_fmt fmt, bool dr);
+uint16_t rb_put(void *src, uint16_t len);
+bool pump(void);
+
+uint8_t *__real_pframe(void);
+
+static const float level[NLEVELS] = { 0.5f, -0.5f, 0.25f };	/* l r c */
+static const char *ccr[NLEVELS] = { "CCR1", "CCR2", "CCR3" };
+
+static bool verbose;
+
+/*
+ * last block pframe() gave dsp, and where it goes dma wise
+ */
+static struct {
+	uint8_t *dst;
+	uint32_t pos;
+	uint32_t n;
+} blk;
+
+uint8_t *__wrap_pframe(void)
+{
+	uint8_t *dst = __real_pframe();
+
+	if (dst) {
+		blk.dst = dst;
+		blk.pos = pframe_pos();
+		blk.n++;
+	}
+	return dst;
+}
+
+static unsigned width(uint32_t size, bool mem)
+{
+	if (size == (mem ? DMA_CCR_MSIZE_8BIT : DMA_CCR_PSIZE_8BIT))
+		return 1;
+	if (!mem && size == DMA_CCR_PSIZE_16BIT)
+		return 2;
+	return 0;
+}
+
+/*
+ * channel and timer setup, as pwm() left it
+ */
+static int setup(unsigned *burst, unsigned *base)
+{
+	unsigned mw = width(pwm_dma.msize, true);
+	unsigned pw = width(pwm_dma.psize, false);
+	int fail = 0;
+
+	*burst = ((TIM_DCR(TIM1) >> 8) & 0x1f) + 1;
+	*base = TIM_DCR(TIM1) & 0x1f;
+
+	printf("dma: memory %u, peripheral %u bytes, %u items, "
+	       "%s%s%s, to DMAR at %s\n"
+	       "burst: %u from offset 0x%02x\n",
+	       mw, pw, pwm_dma.ndt,
+	       pwm_dma.minc ? "increment " : "",
+	       pwm_dma.circular ? "circular " : "",
+	       pwm_dma.mem2per ? "from memory" : "to memory",
+	       pwm_dma.paddr == (uint32_t)(uintptr_t)&TIM_DMAR(TIM1) ?
+	       "TIM1" : "?",
+	       *burst, *base << 2);
+
+	fail |= mw != 1 || pw != 2;
+	fail |= !pwm_dma.minc || !pwm_dma.circular || !pwm_dma.mem2per;
+	fail |= pwm_dma.paddr != (uint32_t)(uintptr_t)&TIM_DMAR(TIM1);
+	fail |= pwm_dma.request != DMA_REQ_TIM1_UP;
+	fail |= pwm_dma.ndt * mw != DMABUFSZ;
+	fail |= *burst != NCHANNELS || (*base << 2) != CCR1_OFS;
+	fail |= (pwm_dma.ndt / 2) % *burst != 0;
+
+	return fail;
+}
+
+/*
+ * 2.1 S16 DC, PACKET_FRAMES at a time
+ */
+static void put(void)
+{
+	int16_t buf[PACKET_FRAMES][NLEVELS];
+
+	for (unsigned i = 0; i < PACKET_FRAMES; i++)
+		for (unsigned ch = 0; ch < NLEVELS; ch++)
+			buf[i][ch] = level[ch] * 32767;
+	rb_put(buf, sizeof(buf));
+}
+
+int main(int argc, char *argv[])
+{
+	double sum[NLEVELS] = { 0 };
+	unsigned burst, base, over = 0, off = 0;
+	uint32_t n = 0;
+	int opt, fail;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	pwm();
+	fail = setup(&burst, &base);
+
+	ctl_publish();
+	ctl_reset(SAMPLE_FORMAT_S16_LFE, false);
+	pump();			/* reset carried out */
+
+	/* prefill, as EV_FILL: blocks while pframe() gives them */
+	e.state = STATE_FILL;
+	do put(); while (pump() || blk.n == 0);
+	while (pump())
+		;
+
+	/*
+	 * last block rendered, dma wise: one item a transfer,
+	 * burst of them every update, each to next CCR
+	 */
+	if (blk.dst) {
+		uint8_t *mem = blk.dst;
+		uint32_t t0 = (blk.pos % (NBLOCKS * BFRAMES)) * NCHANNELS;
+
+		for (uint32_t t = t0; t < t0 + BLOCKSZ; t++, mem++) {
+			uint16_t dmar = *mem;		/* zero extended */
+			unsigned reg = ((base << 2) + (t % burst) * 4 -
+					CCR1_OFS) / 4;
+
+			if (dmar > PWM_PERIOD)
+				over++;
+			if (reg < NLEVELS)
+				sum[reg] += dmar;
+			n += reg == 0;
+		}
+	}
+
+	for (unsigned i = 0; i < NLEVELS; i++) {
+		double duty = n ? sum[i] / n : 0;
+		double want = QF * (1 + level[i]);
+		bool bad = fabs(duty - want) > 1;
+
+		printf("%s: duty %6.2f, want %6.2f%s\n", ccr[i], duty, want,
+		       bad ? " off" : "");
+		off += bad;
+	}
+
+	fail |= !blk.n || !n || over || off;
+	printf("blocks %u, frames %u, over period %u: %s\n",
+	       blk.n, n, over, fail ? "FAIL" : "ok");
+
+	return fail;
+}
@@ -0,0 +1,200 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-evq [-n events] [-u us] [-s seed] [-v]: hammers evq.h
+ *  isr -> dsp queue. A timer signal every -u us stands for dma
+ *  and usb interrupts, posting a burst of events, up to twice what
+ *  queue holds, each one numbered, number in stamp, id and arg
+ *  following from it. Consumer stands for pend_sv_handler(): it
+ *  takes events as they come, wherever signal lands, with random
+ *  spins between, and counts lost ones off seq gaps with ev_gap(),
+ *  as pend_sv_handler() does; last event, posted once signals are
+ *  off, shows losses before it. Exits 1 if an event is got torn, out
+ *  of order or twice, seq not its number, lost count off what
+ *  producer saw dropped, or some got neither through nor lost
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "evq.h"
+
+#define ID(k)		(EV_FILL + (k) % 3)
+#define ARG(k)		((uint8_t)((k) * 37))
+
+static bool verbose;
+static volatile evq_t evq;
+
+/*
+ * interrupt side
+ */
+static volatile struct {
+	bool done;
+	uint32_t nevents;
+	uint32_t k;		/* events posted, next number */
+	uint32_t dropped;	/* on full queue */
+	uint32_t bursts;
+	uint32_t full;		/* bursts that found queue full */
+	unsigned short xsubi[3];
+} isr;
+
+/*
+ * consumer side
+ */
+static struct {
+	uint16_t seq;
+	uint32_t got;
+	uint32_t missed;
+	uint32_t next;		/* number expected next, at least */
+	uint32_t torn, order;
+} dsp;
+
+static void tick(int sig)
+{
+	unsigned n = nrand48((unsigned short *)isr.xsubi) % (2 * EVQ_SIZE) + 1;
+	bool full = false;
+
+	(void)sig;
+
+	if (isr.done)
+		return;
+
+	isr.bursts++;
+	while (n--) {
+		uint16_t head = evq.head;
+		uint32_t k = isr.k++;
+
+		ev_put(&evq, ID(k), ARG(k), k);
+		if (evq.head == head) {
+			isr.dropped++;
+			full = true;
+		}
+		if (isr.k == isr.nevents) {
+			isr.done = true;
+			break;
+		}
+	}
+	isr.full += full;
+}
+
+static void spin(void)
+{
+	volatile unsigned i = lrand48() % 64;
+
+	while (i--);
+}
+
+static void take(void)
+{
+	event_t ev;
+
+	while (ev_get(&evq, &ev)) {
+		uint32_t k = ev.stamp;
+
+		dsp.missed += ev_gap(&dsp.seq, &ev);
+		dsp.got++;
+
+		if (ev.seq != (uint16_t)k || ev.id != ID(k) ||
+		    ev.arg != ARG(k)) {
+			if (verbose && dsp.torn < 8)
+				printf("  event %u: seq %u id %u arg %u\n",
+				       k, ev.seq, ev.id, ev.arg);
+			dsp.torn++;
+		}
+		if (k < dsp.next) {
+			if (verbose && dsp.order < 8)
+				printf("  event %u after %u\n", k, dsp.next - 1);
+			dsp.order++;
+		}
+		dsp.next = k + 1;
+		spin();
+	}
+}
+
+static int run(uint32_t nevents, unsigned us, long seed)
+{
+	struct itimerval it = {
+		.it_interval = { .tv_usec = us },
+		.it_value = { .tv_usec = us }
+	};
+	int fail;
+
+	memset((void *)&evq, 0, sizeof(evq));
+	memset((void *)&isr, 0, sizeof(isr));
+	memset(&dsp, 0, sizeof(dsp));
+	isr.nevents = nevents;
+	isr.xsubi[0] = seed;
+	isr.xsubi[1] = seed >> 16;
+
+	setitimer(ITIMER_REAL, &it, NULL);
+
+	while (!isr.done) {
+		take();
+		spin();
+	}
+
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_REAL, &it, NULL);
+
+	/* one more, into drained queue, so trailing losses show */
+	take();
+	ev_put(&evq, ID(isr.k), ARG(isr.k), isr.k);
+	isr.k++;
+	take();
+
+	fail = dsp.torn || dsp.order || dsp.missed != isr.dropped ||
+		dsp.got + dsp.missed != isr.k || !isr.full;
+
+	printf("%8u %7u %6u %8u %8u %8u %5u %5u %s\n",
+	       isr.k, isr.bursts, isr.full, dsp.got, isr.dropped,
+	       dsp.missed, dsp.torn, dsp.order, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t nevents = 1000000;
+	unsigned us = 20;
+	long seed = 1;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:u:s:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			nevents = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			us = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtol(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n events] [-u us] "
+				"[-s seed] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!nevents) nevents = 1;
+	if (!us || us >= 1000000) us = 20;
+
+	srand48(seed);
+	signal(SIGALRM, tick);
+
+	printf("%8s %7s %6s %8s %8s %8s %5s %5s\n",
+	       "posted", "bursts", "full", "got", "dropped", "missed",
+	       "torn", "order");
+
+	return run(nevents, us, seed);
+}
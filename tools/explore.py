@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# explore.py [-j jobs] [--rate R] [--cost macs|time] [--all] > out.csv:
+# design space sweep of upsample factor, fir phase length, noise
+# shaper order and pwm width. Each point gets its own tables (via
+# tables.m) and host build of dsp core, then test tones go through
+# wavrender for in-band SNR/SINAD, worst of tones and l/r, and
+# host-bench for time per input frame. CSV is Pareto front of
+# SINAD against cost, or every point with --all.
+# Host times are taken under load of parallel jobs, -j 1 for
+# cleaner ones; tclk is pwm counter clock the point needs.
+
+import argparse
+import concurrent.futures
+import csv
+import itertools
+import math
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import wave
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# sources including tables.h, linked into each point's dir so
+# that its tables.h is picked over one in tree
+LINKED = ("dsp.c", "conv.c", "lat.c", "tools/bench.c", "tools/wavrender.c")
+COMMON = ("cap.c", "ctl.c", "prof.c", "tools/host.c")
+
+# abg[] length per noise shaper order, see dsp.c
+NS_COEFFS = {3: 4, 4: 6, 5: 7}
+
+
+def ints(s):
+    return [int(x) for x in s.split(",")]
+
+
+def tone_wav(path, rate, hz, dbfs, secs):
+    """s24 stereo sine"""
+    a = (1 << 23) * 10 ** (dbfs / 20)
+    frames = bytearray()
+    for i in range(int(rate * secs)):
+        v = int(round(a * math.sin(2 * math.pi * hz * i / rate)))
+        s = struct.pack("<i", max(min(v, (1 << 23) - 1), -(1 << 23)))[:3]
+        frames += s + s
+    with wave.open(path, "wb") as w:
+        w.setnchannels(2)
+        w.setsampwidth(3)
+        w.setframerate(rate)
+        w.writeframes(bytes(frames))
+
+
+def run(cmd, **kw):
+    return subprocess.run(cmd, check=True, capture_output=True,
+                          text=True, **kw).stdout
+
+
+def render(exe, wav):
+    """worst of l/r: snr, sinad, noise; clip count"""
+    out = run([exe, wav]).splitlines()
+    clip = sum(ints(out[0].split()[-1].replace("/", ",")))
+    snr = sinad = math.inf
+    noise = -math.inf
+    for line in out:
+        f = line.split()
+        if not f or f[0] not in ("l", "r"):
+            continue
+        if f[1] == "-":
+            return -math.inf, -math.inf, float(f[-1]), clip
+        snr = min(snr, float(f[2]) - float(f[6]))
+        sinad = min(sinad, float(f[3]))
+        noise = max(noise, float(f[6]))
+    return snr, sinad, noise, clip
+
+
+def bench(exe, rate):
+    """ns per input frame, s24 without boost"""
+    for row in csv.DictReader(run([exe, "-c", "-n", "2000"]).splitlines()):
+        if (row["format"], row["rate"], row["boost"]) == ("s24", str(rate), "0"):
+            return 1e9 / (float(row["headroom"]) * rate)
+    return math.nan
+
+
+def point(a, tmp, wavs, p):
+    shift, phaselen, order, width = p
+    dr = a.rate > 48000
+    u = 1 << (shift - dr)
+    d = os.path.join(tmp, "u%d-p%d-ns%d-w%d" % (1 << shift, phaselen,
+                                                 order, width))
+    os.makedirs(d)
+
+    for t in ("tables.h", "tables.c"):
+        run(a.octave.split() + ["-qf", "tables.m", os.path.join(d, t),
+                                str(shift), str(phaselen)], cwd=REPO)
+    for s in LINKED:
+        os.symlink(os.path.join(REPO, s), os.path.join(d, os.path.basename(s)))
+
+    srcs = [os.path.join(d, s) for s in ("dsp.c", "conv.c", "lat.c", "tables.c")] + \
+        [os.path.join(REPO, s) for s in COMMON]
+    defs = ["-DPWM_WIDTH=%d" % width, "-DNS_ORDER=%d" % order]
+    for tool in ("wavrender", "bench"):
+        run(a.cc.split() + a.cflags.split() + ["-DHOST"] + defs +
+            ["-I" + d, "-I" + REPO] + srcs +
+            [os.path.join(d, tool + ".c"), "-o", os.path.join(d, tool), "-lm"])
+
+    res = [render(os.path.join(d, "wavrender"), w) for w in wavs]
+    return {
+        "upsample": 1 << shift,
+        "phaselen": phaselen,
+        "numtaps": phaselen << shift,
+        "ns_order": order,
+        "pwm_width": width,
+        "macs": u * 3 * (phaselen + NS_COEFFS[order]),
+        "ns_frame": round(bench(os.path.join(d, "bench"), a.rate), 1)
+        if a.cost == "time" else "",
+        "tclk_mhz": round(a.rate * u * (1 << width) / 1e6, 3),
+        "snr": round(min(r[0] for r in res), 1),
+        "sinad": round(min(r[1] for r in res), 1),
+        "noise": round(max(r[2] for r in res), 1),
+        "clip": sum(r[3] for r in res),
+    }
+
+
+def pareto(points, cost):
+    """best sinad for its cost: nothing as cheap is as good or better"""
+    front = []
+    for p in sorted(points, key=lambda p: (p[cost], -p["sinad"])):
+        if not front or p["sinad"] > front[-1]["sinad"]:
+            front.append(p)
+    return front
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("-j", "--jobs", type=int, default=os.cpu_count())
+    ap.add_argument("--rate", type=int, default=48000,
+                    choices=(44100, 48000, 88200, 96000))
+    ap.add_argument("--upsample-shift", type=ints, default=[3, 4])
+    ap.add_argument("--phaselen", type=ints, default=[2, 3, 4, 6])
+    ap.add_argument("--ns-order", type=ints, default=[3, 4, 5])
+    ap.add_argument("--pwm-width", type=ints, default=[6, 7, 8])
+    ap.add_argument("--tones", type=ints, default=[997, 9973])
+    ap.add_argument("--level", type=float, default=-6, help="dBFS")
+    ap.add_argument("--secs", type=float, default=2)
+    ap.add_argument("--cost", choices=("macs", "time"), default="macs")
+    ap.add_argument("--all", action="store_true")
+    ap.add_argument("--cc", default=os.environ.get("HOSTCC", "cc"))
+    ap.add_argument("--cflags", default="-O2")
+    ap.add_argument("--octave", default=os.environ.get("OCTAVE", "octave"))
+    ap.add_argument("--keep", help="build dir, kept")
+    a = ap.parse_args()
+
+    tmp = a.keep or tempfile.mkdtemp(prefix="explore")
+    os.makedirs(tmp, exist_ok=True)
+    wavs = []
+    for hz in a.tones:
+        wavs.append(os.path.join(tmp, "tone%d.wav" % hz))
+        tone_wav(wavs[-1], a.rate, hz, a.level, a.secs)
+
+    space = list(itertools.product(a.upsample_shift, a.phaselen,
+                                   a.ns_order, a.pwm_width))
+    points = []
+    with concurrent.futures.ThreadPoolExecutor(a.jobs) as ex:
+        jobs = {ex.submit(point, a, tmp, wavs, p): p for p in space}
+        for j in concurrent.futures.as_completed(jobs):
+            try:
+                points.append(j.result())
+            except subprocess.CalledProcessError as e:
+                err = (e.stderr or "").strip().splitlines() or ["failed"]
+                shift, phaselen, order, width = jobs[j]
+                print("u%d p%d ns%d w%d: %s" % (1 << shift, phaselen, order,
+                                                width, err[-1]), file=sys.stderr)
+
+    if not a.keep:
+        shutil.rmtree(tmp)
+
+    cost = "macs" if a.cost == "macs" else "ns_frame"
+    front = pareto(points, cost)
+    fields = list(points[0]) + ["pareto"] if points else []
+    w = csv.DictWriter(sys.stdout, fields)
+    w.writeheader()
+    for p in sorted(points if a.all else front, key=lambda p: p[cost]):
+        w.writerow(dict(p, pareto=int(p in front)))
+
+    return 0 if points else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,281 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  f4uacstat [-i interval_ms] [-l | -L] [-t tap] [-c file | -C]:
+ *  dumps device pipeline statistics; -l arms latency measurement and
+ *  dumps its results instead, host is to play marker frames (see
+ *  host-latency -w), -L disarms it; -t selects loopback capture tap,
+ *  0 filter, 1 noise shaper; -c uploads headphone correction taps,
+ *  a line each, l and r or one for both, -C bypasses correction
+ */
+
+#include <endian.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libusb.h>
+
+#include "telemetry.h"
+#include "tools/tmdecode.h"
+
+#define VID 0x6666
+#define PID 0x2701
+
+#define MAXTAPS 4096		/* read off file; device tells its limit */
+
+static const char * const states[] = {
+	"closed", "fill", "running", "drain"
+};
+
+static void print(const telemetry_t *t)
+{
+	printf("state %s alt %u rate %u load %u%%\n",
+	       t->state < 4 ? states[t->state] : "?", t->format,
+	       t->rate, t->load);
+	printf("feedback %.4f frames/ms ring %u..%u bytes, target %u\n",
+	       t->feedback / 16384.0, t->rbmin, t->rbmax, t->rbtarget);
+	printf("opens %u late %u underrun %u overrun %u partial %u\n",
+	       t->opens, t->late, t->underrun, t->overrun, t->partial);
+	printf("missed %u evlate %u frames\n", t->missed, t->evlate);
+	printf("clip l %u r %u c %u\n", t->clip[0], t->clip[1], t->clip[2]);
+	printf("pump avg %u max %u cycles\n", t->pump_avg, t->pump_max);
+}
+
+static void print_latency(latency_t *l)
+{
+	l->sof = le16toh(l->sof);
+	l->rate = le32toh(l->rate);
+	l->seq = le32toh(l->seq);
+	l->page = le16toh(l->page);
+	l->offset = le16toh(l->offset);
+	l->ring = le32toh(l->ring);
+	l->total = le32toh(l->total);
+
+	if (!l->seq) {
+		printf("%s, alt %u rate %u: no marker yet\n",
+		       l->armed ? "armed" : "disarmed", l->format, l->rate);
+		return;
+	}
+	printf("marker %u sof %u alt %u rate %u\n",
+	       l->seq, l->sof, l->format, l->rate);
+	printf("latency %.3f ms, ring %.3f ms, peak at page %u frame %u\n",
+	       l->total / 1e3, l->ring / 1e3, l->page, l->offset);
+}
+
+static int latency(libusb_device_handle *dev, int interval)
+{
+	latency_t l;
+	int n;
+
+	do {
+		n = libusb_control_transfer(dev,
+			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE,
+			LATENCY_GET, 0, 0, (unsigned char *)&l, sizeof(l), 1000);
+		if (n < 0) {
+			fprintf(stderr, "%s\n", libusb_strerror(n));
+			break;
+		}
+		if (n != sizeof(l)) {
+			fprintf(stderr, "unexpected block: %d bytes\n", n);
+			break;
+		}
+		print_latency(&l);
+		if (interval) {
+			putchar('\n');
+			usleep(interval * 1000);
+		}
+	} while (interval);
+
+	return n;
+}
+
+static int vendor_out(libusb_device_handle *dev, uint8_t req,
+		      uint16_t value, uint16_t index, void *data, uint16_t len)
+{
+	int n = libusb_control_transfer(dev,
+		LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE,
+		req, value, index, data, len, 1000);
+
+	if (n < 0)
+		fprintf(stderr, "%s\n", libusb_strerror(n));
+	return n;
+}
+
+/*
+ * taps off file, or none to bypass; committed, then status read back
+ */
+static int correct(libusb_device_handle *dev, const char *path)
+{
+	static float taps[2][MAXTAPS];
+	conv_status_t c;
+	uint16_t ntaps = 0;
+	int n;
+
+	if (path) {
+		FILE *f = fopen(path, "r");
+		char line[128];
+
+		if (!f) {
+			perror(path);
+			return -1;
+		}
+		while (fgets(line, sizeof(line), f) && ntaps < MAXTAPS) {
+			int k = sscanf(line, "%f %f", &taps[0][ntaps],
+				       &taps[1][ntaps]);
+
+			if (k < 1) continue;
+			if (k == 1) taps[1][ntaps] = taps[0][ntaps];
+			ntaps++;
+		}
+		fclose(f);
+	}
+
+	n = libusb_control_transfer(dev,
+		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE,
+		CONV_STATUS, 0, 0, (unsigned char *)&c, sizeof(c), 1000);
+	if (n != sizeof(c)) {
+		fprintf(stderr, "%s\n", n < 0 ? libusb_strerror(n) :
+			"unexpected block");
+		return -1;
+	}
+	if (ntaps > le16toh(c.maxtaps)) {
+		fprintf(stderr, "%u taps, device takes %u at most\n",
+			ntaps, le16toh(c.maxtaps));
+		return -1;
+	}
+
+	for (unsigned ch = 0; ch < 2; ch++)
+		for (unsigned i = 0; i < ntaps; i += c.chunk) {
+			uint32_t buf[256];
+			unsigned k = ntaps - i < c.chunk ? ntaps - i : c.chunk;
+
+			for (unsigned j = 0; j < k; j++) {
+				memcpy(&buf[j], &taps[ch][i + j], 4);
+				buf[j] = htole32(buf[j]);
+			}
+			if (vendor_out(dev, CONV_UPLOAD, i, ch, buf, 4 * k) < 0)
+				return -1;
+		}
+
+	if (vendor_out(dev, CONV_COMMIT, ntaps, 0, NULL, 0) < 0) {
+		fprintf(stderr, "%u taps over budget of %u at %u Hz\n", ntaps,
+			le16toh(c.budget), le32toh(c.rate));
+		return -1;
+	}
+
+	n = libusb_control_transfer(dev,
+		LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR |
+		LIBUSB_RECIPIENT_DEVICE,
+		CONV_STATUS, 0, 0, (unsigned char *)&c, sizeof(c), 1000);
+	if (n != sizeof(c))
+		return -1;
+
+	printf("correction %u taps%s, budget %u at %u Hz, %u cycles/block, "
+	       "overload %u\n", le16toh(c.ntaps), c.pending ? " pending" : "",
+	       le16toh(c.budget), le32toh(c.rate), le32toh(c.cost),
+	       le32toh(c.overload));
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	libusb_device_handle *dev;
+	telemetry_t t;
+	int c, n, interval = 0, arm = -1, tap = -1;
+	const char *taps = NULL;
+	int bypass = 0;
+
+	while ((c = getopt(argc, argv, "i:lLt:c:C")) != -1) {
+		switch (c) {
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'l':
+			arm = 1;
+			break;
+		case 'L':
+			arm = 0;
+			break;
+		case 't':
+			tap = atoi(optarg);
+			break;
+		case 'c':
+			taps = optarg;
+			break;
+		case 'C':
+			bypass = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-i interval_ms] [-l | -L] "
+				"[-t tap] [-c file | -C]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (libusb_init(NULL)) return 1;
+
+	if (!(dev = libusb_open_device_with_vid_pid(NULL, VID, PID))) {
+		fprintf(stderr, "%04x:%04x not found\n", VID, PID);
+		return 1;
+	}
+
+	if (taps || bypass) {
+		n = correct(dev, taps);
+		goto out;
+	}
+
+	if (tap >= 0) {
+		n = libusb_control_transfer(dev,
+			LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE,
+			CAPTURE_TAP, tap, 0, NULL, 0, 1000);
+		if (n < 0)
+			fprintf(stderr, "%s\n", libusb_strerror(n));
+		goto out;
+	}
+
+	if (arm >= 0) {
+		n = libusb_control_transfer(dev,
+			LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE,
+			LATENCY_ARM, arm, 0, NULL, 0, 1000);
+		if (n < 0)
+			fprintf(stderr, "%s\n", libusb_strerror(n));
+		else if (arm)
+			n = latency(dev, interval);
+		goto out;
+	}
+
+	do {
+		n = libusb_control_transfer(dev,
+			LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR |
+			LIBUSB_RECIPIENT_DEVICE,
+			TELEMETRY_GET, 0, 0, (unsigned char *)&t, sizeof(t), 1000);
+		if (n < 0) {
+			fprintf(stderr, "%s\n", libusb_strerror(n));
+			break;
+		}
+		if (n != sizeof(t) || t.version != TELEMETRY_VERSION) {
+			fprintf(stderr, "unexpected block: %d bytes, version %u\n",
+				n, t.version);
+			break;
+		}
+		tm_decode(&t);
+		print(&t);
+		if (interval) {
+			putchar('\n');
+			usleep(interval * 1000);
+		}
+	} while (interval);
+
+out:
+	libusb_close(dev);
+	libusb_exit(NULL);
+
+	return n < 0;
+}
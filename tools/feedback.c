@@ -0,0 +1,369 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-feedback [-f format] [-r rate] [-p ppm] [-d ppm] [-J us]
+ *                [-t seconds] [-s seed] [-c] [-v]: closes async
+ *  feedback loop, fb.c, on host.
+ *  Host sends a packet each of its ms, sized off last feedback it
+ *  got with fraction carried, as linux does; its clock is -p ppm
+ *  off, device crystal -d ppm, SOFs and packets jitter by -J us.
+ *  Device counts pwm output frames, latched at SOF, as
+ *  pwm_position() would, and takes a block of them off ring each
+ *  time dma gets past one, starting once prefill is reached. With
+ *  no -p, runs host clock from -1000 to +1000 ppm over every rate.
+ *  Fill is sampled per packet, and where dma block boundaries fall
+ *  between packets drifts with clocks, so even averaged over a
+ *  second it wanders by a few frames: it's settled once that
+ *  average stays within 1/8 packet of target. Reports when that
+ *  was, mean error and p-p of fill over feedback periods in second
+ *  half of run, feedback vs actual device rate there, and latency
+ *  at target, ring plus BLOCKS_AHEAD of pwm buffer. Exits 1 on
+ *  ring running dry or over, pwm block late, fill not settled by
+ *  half the run or mean error past 1/8 packet.
+ *  -c runs each case once more with feedback as it was before it
+ *  was measured: ring free space summed over feedback period,
+ *  through DELTA_SHIFT, on top of FEEDBACK_MIN, fill wherever that
+ *  lands. Reports fill and feedback standard deviation over second
+ *  half of run for both, and fill, so latency, old scheme settled
+ *  at; pass or fail is still for current loop alone
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "fb.h"
+#include "tables.h"
+
+static const struct {
+	sample_fmt fmt;
+	const char *name;
+} formats[] = {
+	{ SAMPLE_FORMAT_S16,	"s16" },
+	{ SAMPLE_FORMAT_S24,	"s24" },
+	{ SAMPLE_FORMAT_S32,	"s32" },
+	{ SAMPLE_FORMAT_F32,	"f32" },
+	{ SAMPLE_FORMAT_S16_LFE, "s16lfe" },
+	{ SAMPLE_FORMAT_S24_LFE, "s24lfe" }
+};
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_44100,
+	SAMPLE_RATE_48000,
+	SAMPLE_RATE_88200,
+	SAMPLE_RATE_96000
+};
+
+static const double ppms[] = { -1000, -300, -50, 0, 50, 300, 1000 };
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define RX_DELAY	50e-6		/* OUT packet after SOF, as in sim */
+#define SETTLE_TOL	8		/* 1/N packet, fill error */
+#define SETTLE_AVG	64		/* feedback periods, ~1s */
+
+/*
+ * feedback as it was, centered on 48k, 88.2/96k doubled; prefill
+ * till ring is half full: delta in 0 .. (RBSIZE << SOF_SHIFT) maps
+ * to FEEDBACK_MIN .. + 1/4 of 48k
+ */
+#define FEEDBACK_48	(48 << FEEDBACK_SHIFT)
+#define FEEDBACK_MIN	(42 << FEEDBACK_SHIFT)
+#if (FEEDBACK_SHIFT + 3 - SOF_SHIFT) > RINGBUF_SHIFT
+#define DELTA_SHIFT(x)	((x) << (FEEDBACK_SHIFT + 3 - SOF_SHIFT - RINGBUF_SHIFT))
+#else
+#define DELTA_SHIFT(x)	((x) >> (RINGBUF_SHIFT + SOF_SHIFT - 3 - FEEDBACK_SHIFT))
+#endif
+
+static struct {
+	sample_fmt fmt;
+	sample_rate rate;
+	double ppm;		/* host */
+	double xtal;		/* device */
+	double jitter;		/* s */
+	unsigned ms;
+	long seed;
+	bool compare;
+	bool verbose;
+} opt = {
+	.fmt = SAMPLE_FORMAT_S16,
+	.ms = 60000,
+	.seed = 1
+};
+
+typedef struct {
+	double settle;		/* s, -1 if never */
+	double err;		/* mean fill error, frames */
+	double pp;		/* fill p-p, frames */
+	double fbppm;		/* feedback vs device rate */
+	double fill;		/* mean, frames */
+	double sd;		/* fill standard deviation, frames */
+	double fbsd;		/* feedback ..., ppm */
+	unsigned xruns;
+} result_t;
+
+/*
+ * pump() as dsp runs it, on dma block interrupt and packet arrival:
+ * block after block while ring has one and pframe() a slot, at most
+ * BLOCKS_AHEAD of one playing; short of data, it waits till block
+ * is due, next to play, then conceals it
+ */
+typedef struct {
+	uint32_t ring;		/* bytes */
+	uint32_t bsize;		/* block, ring bytes */
+	uint64_t w;		/* next block to render */
+	unsigned xruns;
+} device_t;
+
+static void pump(device_t *d, uint64_t rblock)
+{
+	if (d->w <= rblock) {		/* late */
+		d->xruns++;
+		d->w = rblock + 1;
+	}
+
+	while (d->w - rblock <= BLOCKS_AHEAD) {
+		if (d->ring < d->bsize) {
+			if (d->w - rblock <= 1) {
+				d->xruns++;
+				d->w++;
+			}
+			break;
+		}
+		d->ring -= d->bsize;
+		d->w++;
+	}
+}
+
+/*
+ * uniform, up to half the jitter either way
+ */
+static double jitter(void)
+{
+	return opt.jitter * (drand48() - 0.5);
+}
+
+static result_t run(sample_fmt fmt, sample_rate rate, double ppm, bool delta)
+{
+	bool dr = doubleratep(rate);
+	unsigned shift = dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+	uint16_t framelen = framesize(fmt);
+	uint32_t prefill = delta ? RBSIZE / 2 :
+		(fb_fill[fmt].prefill << dr) * framelen;
+	double target = fb_fill[fmt].target << dr;
+	double tol = rate / 1e3 / SETTLE_TOL;
+	double sof = 1e-3 / (1 + ppm * 1e-6);		/* host ms */
+	double fo = (double)(rate << shift) * (1 + opt.xtal * 1e-6);
+	double actual = (rate << FEEDBACK_SHIFT) / 1e3 *	/* a host ms */
+		(1 + opt.xtal * 1e-6) / (1 + ppm * 1e-6);
+	double start = 0, smooth = 0, fbsum = 0, lo = 1e9, hi = -1e9;
+	double errsum = 0, sq = 0, fbsq = 0;
+	uint32_t feedback = FEEDBACK(rate), acc = 0, free = 0;
+	uint64_t rblock = 0;
+	unsigned n = 0;
+	bool running = false;
+	device_t d = { .bsize = (BFRAMES >> shift) * framelen, .w = 1 };
+	fb_meter_t meter = { 0 };
+	fb_pi_t pi = { 0 };
+	result_t r = { .settle = -1 };
+
+	srand48(opt.seed);
+	if (delta) feedback = FEEDBACK_48 << dr;
+
+	for (unsigned k = 1; k <= opt.ms; k++) {
+		double t = k * sof + jitter();
+		uint32_t pos = running ? (uint32_t)((t - start) * fo) : 0;
+		uint32_t nframes, len;
+
+		/*
+		 * SOF: feedback every (1 << SOF_SHIFT), host takes it
+		 * for packets to come
+		 */
+		if (k % (1 << SOF_SHIFT) == 0) {
+			double avg = pi.npkts ?
+				(double)pi.fillsum / pi.npkts / framelen : 0;
+			uint32_t m = fb_measure(&meter, pos, rate, running);
+
+			if (delta) {
+				feedback = (running ? FEEDBACK_MIN +
+					    DELTA_SHIFT(free) : FEEDBACK_48) << dr;
+				pi.fillsum = pi.npkts = free = 0;
+			} else {
+				feedback = fb_update(&pi, m, fmt, rate,
+						     framelen, !running);
+			}
+			if (running) {
+				smooth += (avg - target - smooth) /
+					(meter.n > 1 ? SETTLE_AVG : 1);
+				if (fabs(smooth) > tol)
+					r.settle = -1;
+				else if (r.settle < 0)
+					r.settle = t;
+			}
+			if (running && t > opt.ms * 1e-3 / 2) {
+				errsum += avg - target;
+				sq += (avg - target) * (avg - target);
+				fbsum += feedback;
+				fbsq += (double)feedback * feedback;
+				lo = fmin(lo, avg);
+				hi = fmax(hi, avg);
+				n++;
+			}
+			if (opt.verbose)
+				printf("%8.3f %8u %8.2f %10.4f\n", t,
+				       d.ring / framelen, avg,
+				       feedback / (double)(1 << FEEDBACK_SHIFT));
+		}
+
+		/*
+		 * dma block interrupts till packet comes
+		 */
+		t = k * sof + RX_DELAY + jitter();
+		if (running) {
+			uint64_t now = (uint64_t)((t - start) * fo) / BFRAMES;
+
+			while (rblock < now)
+				pump(&d, ++rblock);
+		}
+
+		acc += feedback;
+		nframes = acc >> FEEDBACK_SHIFT;
+		acc -= nframes << FEEDBACK_SHIFT;
+		len = nframes * framelen;
+
+		if (d.ring + len > RBSIZE - 1)
+			d.xruns++;
+		else
+			d.ring += len;
+
+		pi.fillsum += d.ring;
+		pi.npkts++;
+		free += RBSIZE - 1 - d.ring;
+
+		if (running) {
+			pump(&d, rblock);
+		} else if (d.ring >= prefill) {
+			pump(&d, 0);		/* EV_FILL, then pwm_enable() */
+			running = true;
+			start = t;
+		}
+	}
+
+	r.xruns = d.xruns;
+	if (!n) return r;
+
+	r.err = errsum / n;
+	r.fill = target + r.err;
+	r.sd = sqrt(fmax(sq / n - r.err * r.err, 0));
+	r.pp = hi - lo;
+	r.fbppm = (fbsum / n / actual - 1) * 1e6;
+	r.fbsd = sqrt(fmax(fbsq / n - fbsum / n * fbsum / n, 0)) /
+		actual * 1e6;
+	return r;
+}
+
+static int report(sample_fmt fmt, sample_rate rate, double ppm)
+{
+	result_t r = run(fmt, rate, ppm, false), o;
+	unsigned shift = doubleratep(rate) ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+	double target = fb_fill[fmt].target << doubleratep(rate);
+	double ms = (target + (BLOCKS_AHEAD * BFRAMES >> shift)) * 1e3 / rate;
+	bool fail = r.xruns || r.settle < 0 || r.settle > opt.ms * 1e-3 / 2 ||
+		fabs(r.err) > rate / 1e3 / SETTLE_TOL;
+
+	if (opt.compare) {
+		o = run(fmt, rate, ppm, true);
+		printf("%6u %+7.0f %7.0f %6.2f %8.1f %6u %7.0f %6.2f %8.1f %6u "
+		       "%7.2f %s\n", rate, ppm, r.fill, r.sd, r.fbsd, r.xruns,
+		       o.fill, o.sd, o.fbsd, o.xruns, o.fill * 1e3 / rate,
+		       fail ? "FAIL" : "ok");
+		return fail;
+	}
+
+	printf("%6u %+7.0f %7.0f %7.2f %7.2f %7.2f %8.1f %6u %7.2f %s\n",
+	       rate, ppm, target, r.settle, r.err, r.pp, r.fbppm, r.xruns,
+	       ms, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	bool sweep = true;
+	int o, fail = 0;
+	unsigned i;
+
+	while ((o = getopt(argc, argv, "f:r:p:d:J:t:s:cv")) != -1) {
+		switch (o) {
+		case 'f':
+			for (i = 0; i < NELEM(formats); i++)
+				if (!strcmp(optarg, formats[i].name)) break;
+			if (i == NELEM(formats)) goto usage;
+			opt.fmt = formats[i].fmt;
+			break;
+		case 'r':
+			opt.rate = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			opt.ppm = strtod(optarg, NULL);
+			sweep = false;
+			break;
+		case 'd':
+			opt.xtal = strtod(optarg, NULL);
+			break;
+		case 'J':
+			opt.jitter = strtod(optarg, NULL) * 1e-6;
+			break;
+		case 't':
+			opt.ms = strtod(optarg, NULL) * 1000;
+			break;
+		case 's':
+			opt.seed = strtol(optarg, NULL, 0);
+			break;
+		case 'c':
+			opt.compare = true;
+			break;
+		case 'v':
+			opt.verbose = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	for (i = 0; i < NELEM(rates); i++)
+		if (rates[i] == opt.rate) break;
+	if ((opt.rate && i == NELEM(rates)) || opt.ms < 1000 ||
+	    opt.jitter < 0 || opt.jitter >= 500e-6)
+		goto usage;
+
+	if (opt.compare)
+		printf("%6s %7s %7s %6s %8s %6s %7s %6s %8s %6s %7s\n",
+		       "rate", "ppm", "fill", "sd", "fb sd", "xruns",
+		       "delta", "sd", "fb sd", "xruns", "ms");
+	else
+		printf("%6s %7s %7s %7s %7s %7s %8s %6s %7s\n", "rate",
+		       "ppm", "target", "settle", "error", "p-p", "fb ppm",
+		       "xruns", "ms");
+
+	for (i = 0; i < NELEM(rates); i++) {
+		if (opt.rate && rates[i] != opt.rate)
+			continue;
+		if (!sweep) {
+			fail |= report(opt.fmt, rates[i], opt.ppm);
+			continue;
+		}
+		for (unsigned j = 0; j < NELEM(ppms); j++)
+			fail |= report(opt.fmt, rates[i], ppms[j]);
+	}
+
+	return fail;
+
+usage:
+	fprintf(stderr, "usage: %s [-f format] [-r rate] [-p ppm] [-d ppm] "
+		"[-J us]\n\t[-t seconds] [-s seed] [-c] [-v]\n", argv[0]);
+	return 1;
+}
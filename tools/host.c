@@ -0,0 +1,39 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include "common.h"
+#include "tools/host.h"
+
+volatile cs_t cstate;
+volatile stats_t stats;
+
+uint8_t host_block[BLOCKSZ];
+uint32_t host_blocks;
+uint32_t host_played;
+bool host_due;
+
+/*
+ * one block, always free, due as host_due says
+ */
+uint8_t *pframe(void)
+{
+	host_blocks++;
+	return host_block;
+}
+
+uint32_t pframe_pos(void)
+{
+	return (host_blocks - 1) * BFRAMES;
+}
+
+uint32_t pwm_position(void)
+{
+	return host_played;
+}
+
+bool pframe_due(void)
+{
+	return host_due;
+}
@@ -0,0 +1,29 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * what dsp core wants from the rest of firmware, for host tools
+ */
+#define BLOCKSZ		(NCHANNELS * BFRAMES)
+
+extern volatile cs_t cstate;
+extern volatile stats_t stats;
+
+/*
+ * pwm stand-in: pframe() always hands out host_block,
+ * interleaved l/r/c duty bytes after each pump(); it counts
+ * host_blocks handed out, pwm_position() is host_played,
+ * pframe_due() is host_due, false unless set
+ */
+extern uint8_t host_block[BLOCKSZ];
+extern uint32_t host_blocks;
+extern uint32_t host_played;
+extern bool host_due;
+
+uint32_t pframe_pos(void);
+
+void rb_setup(sample_fmt fmt, bool dr);
+uint16_t rb_put(void *src, uint16_t len);
+bool pump(void);
@@ -0,0 +1,303 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-latency [-v] [-w file.wav]: checks latency marker detection
+ *  and accounting, lat.c and its dsp core hooks, on synthetic 1ms
+ *  packet streams over every input format and rate, with pwm played
+ *  at nominal rate in step with them. What's measured is checked
+ *  against peak found in rendered l duty and SOFs actually counted;
+ *  exits 1 on marker missed, SOF mismatch or peak off by an input
+ *  frame or more. -w writes s24 48k stereo wav with a marker a
+ *  second, for measuring on device, see f4uacstat -l
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ctl.h"
+#include "lat.h"
+#include "tables.h"
+#include "tools/host.h"
+
+static const struct {
+	sample_fmt fmt;
+	const char *name;
+	bool dr;		/* 88.2/96k too */
+} formats[] = {
+	{ SAMPLE_FORMAT_S16,	"s16",		true },
+	{ SAMPLE_FORMAT_S24,	"s24",		true },
+	{ SAMPLE_FORMAT_S32,	"s32",		false },
+	{ SAMPLE_FORMAT_F32,	"f32",		false },
+	{ SAMPLE_FORMAT_S16_LFE, "s16lfe",	false },
+	{ SAMPLE_FORMAT_S24_LFE, "s24lfe",	false }
+};
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_44100,
+	SAMPLE_RATE_48000,
+	SAMPLE_RATE_88200,
+	SAMPLE_RATE_96000
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(97 * 3 * 4)
+
+#define RUN_MS		400
+#define MARK_MS		40	/* first marker, then each ... */
+#define MARK_EVERY	37	/* ms, drifting over packet */
+#define NMARKS		((RUN_MS - MARK_MS - 20) / MARK_EVERY)
+#define PREFILL		2	/* packets in ring, past full pwm queue */
+#define MAX_FRAMES	(RUN_MS * (SAMPLE_RATE_96000 << UPSAMPLE_SHIFT_DR) / 1000)
+
+static bool verbose;
+static uint16_t sofs;		/* as lat_sof() counts them */
+
+static uint8_t duty[MAX_FRAMES];	/* l, per output frame */
+
+typedef struct {
+	uint32_t frame;		/* input frame # in stream */
+	uint16_t sof;		/* SOFs counted till its packet */
+	uint32_t rx;		/* host_played then */
+	bool found;
+	uint16_t lsof;		/* what lat has */
+	uint32_t lrx;
+	uint32_t lrender;
+	uint32_t lpeak;
+} marker_t;
+
+/*
+ * silence, or marker at given frame
+ */
+static uint16_t packet(uint8_t *dst, sample_fmt fmt, unsigned nframes,
+		       int mark)
+{
+	unsigned len = nframes * framesize(fmt);
+	unsigned width = framesize(fmt) / nchannels(fmt);
+	uint8_t *p = dst + mark * framesize(fmt);
+
+	memset(dst, 0, len);
+	if (mark < 0)
+		return len;
+
+	if (fmt == SAMPLE_FORMAT_F32) {
+		memcpy(p, &(const float[]) { 1.0f, -1.0f }, 8);
+	} else {
+		memset(p, 0xff, width - 1);
+		p[width - 1] = 0x7f;
+		p[2 * width - 1] = 0x80;
+	}
+
+	return len;
+}
+
+/*
+ * centroid of l excursion over impulse response of input frame m:
+ * FIR is symmetric, shaped noise sums to next to nothing
+ */
+static double peak(uint32_t m, unsigned shift, unsigned numtaps)
+{
+	uint32_t from = m << shift, to = from + numtaps + (1 << shift);
+	double sum = 0, moment = 0;
+
+	for (uint32_t i = from; i < to && i < MAX_FRAMES; i++) {
+		int x = duty[i] - (1 << (PWM_WIDTH - 1));
+
+		sum += x;
+		moment += (double)x * i;
+	}
+
+	return sum ? moment / sum : 0;
+}
+
+/*
+ * pump() kept BLOCKS_AHEAD of pwm, as pframe() would have it;
+ * l duty is kept, what lat finds is matched to markers in order
+ */
+static void render(marker_t *m, unsigned nm, uint32_t *seq)
+{
+	while (host_blocks - host_played / BFRAMES <= BLOCKS_AHEAD && pump()) {
+		uint32_t pos = pframe_pos();
+
+		for (unsigned i = 0; i < BFRAMES; i++)
+			if (pos + i < MAX_FRAMES)
+				duty[pos + i] = host_block[i * NCHANNELS];
+	}
+
+	if (lat.seq != *seq && *seq < nm) {
+		m[*seq].found = true;
+		m[*seq].lsof = lat.sof;
+		m[*seq].lrx = lat.rx;
+		m[*seq].lrender = lat.render;
+		m[*seq].lpeak = lat.peak;
+		*seq = lat.seq;
+	}
+}
+
+/*
+ * 1ms ticks: SOF, packet, then pwm plays a ms worth; it starts
+ * once queue is full and ring has PREFILL packets on top
+ */
+static int run(const char *name, sample_fmt fmt, sample_rate rate)
+{
+	bool dr = rate > SAMPLE_RATE_48000;
+	unsigned shift = dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+	unsigned numtaps = dr ? NUMTAPS_DR : NUMTAPS_SR;
+	uint32_t orate = (uint32_t)rate << shift;
+	uint32_t frames = 0, seq = 0, late = 0, start = 0, end;
+	bool playing = false;
+	marker_t m[NMARKS] = { 0 };
+	unsigned nm = 0, nfound = 0, bad = 0;
+	double err = 0, worst = 0, total = 0, ring = 0;
+
+	cstate.format = fmt;
+	cstate.rate = rate;
+	cstate.attn = 12;		/* keeps noise shaper off clipping */
+	ctl_publish();
+	rb_setup(fmt, dr);
+	host_blocks = host_played = 0;
+	memset(duty, 0, sizeof(duty));
+	lat_arm(true);
+
+	for (unsigned ms = 0; ms < RUN_MS; ms++) {
+		uint8_t buf[MAX_PACKET];
+		unsigned n = (uint64_t)rate * (ms + 1) / 1000 - frames;
+		int at = -1;
+		uint16_t space;
+
+		if (ms >= MARK_MS && (ms - MARK_MS) % MARK_EVERY == 0 &&
+		    nm < NMARKS) {
+			at = ms % n;
+			m[nm].frame = frames + at;
+			m[nm].sof = sofs + 1;
+			m[nm].rx = host_played;
+			nm++;
+		}
+
+		lat_sof();
+		sofs++;
+		space = rb_put(buf, packet(buf, fmt, n, at));
+		frames += n;
+
+		render(m, nm, &seq);
+
+		if (!playing && host_blocks > BLOCKS_AHEAD &&
+		    RBSIZE - 1U - space >= PREFILL * n * framesize(fmt)) {
+			playing = true;
+			start = ms;
+		}
+		if (!playing)
+			continue;
+
+		/* block by block, as dma would have pump() pended */
+		end = (uint64_t)orate * (ms + 1 - start) / 1000;
+		while (host_played < end) {
+			host_played = MIN(end, (host_played / BFRAMES + 1) * BFRAMES);
+			if (host_blocks * BFRAMES < host_played)
+				late++;
+			render(m, nm, &seq);
+		}
+	}
+
+	for (unsigned i = 0; i < nm; i++) {
+		double p = peak(m[i].frame, shift, numtaps);
+		double e = m[i].lpeak - p;
+
+		if (!m[i].found || m[i].lsof != m[i].sof || m[i].lrx != m[i].rx ||
+		    fabs(e) >= (1 << shift)) {
+			bad++;
+		}
+		if (m[i].found) {
+			nfound++;
+			total += m[i].lpeak - m[i].lrx;
+			ring += m[i].lrender - m[i].lrx;
+			err += e;
+			worst = MAX(worst, fabs(e));
+		}
+		if (verbose)
+			printf("  frame %u sof %u/%u rx %u/%u render %u "
+			       "peak %u/%.1f\n",
+			       m[i].frame, m[i].lsof, m[i].sof,
+			       m[i].lrx, m[i].rx, m[i].lrender, m[i].lpeak, p);
+	}
+
+	if (nfound) {
+		total /= nfound;
+		ring /= nfound;
+		err /= nfound;
+	}
+	printf("%-7s %6u %4u/%-4u %8.3f %8.3f %+8.1f %6.1f %5u %s\n",
+	       name, rate, nfound, nm, 1e3 * total / orate, 1e3 * ring / orate,
+	       err, worst, late, bad || late ? "FAIL" : "ok");
+
+	return bad || late;
+}
+
+static void wr16(FILE *f, uint16_t v) { fwrite(&v, 2, 1, f); }
+static void wr32(FILE *f, uint32_t v) { fwrite(&v, 4, 1, f); }
+
+static int marker_wav(const char *path)
+{
+	const unsigned rate = 48000, secs = 10, len = 6 * rate * secs;
+	FILE *f = fopen(path, "wb");
+	uint8_t frame[6];
+
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+
+	fwrite("RIFF", 4, 1, f);
+	wr32(f, 36 + len);
+	fwrite("WAVEfmt ", 8, 1, f);
+	wr32(f, 16);
+	wr16(f, 1);
+	wr16(f, 2);
+	wr32(f, rate);
+	wr32(f, 6 * rate);
+	wr16(f, 6);
+	wr16(f, 24);
+	fwrite("data", 4, 1, f);
+	wr32(f, len);
+
+	for (unsigned i = 0; i < rate * secs; i++) {
+		packet(frame, SAMPLE_FORMAT_S24, 1, i % rate ? -1 : 0);
+		fwrite(frame, 6, 1, f);
+	}
+
+	return fclose(f) != 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "vw:")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		case 'w':
+			return marker_wav(optarg);
+		default:
+			fprintf(stderr, "usage: %s [-v] [-w file.wav]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%-7s %6s %9s %8s %8s %8s %6s %5s\n", "format", "rate",
+	       "markers", "total_ms", "ring_ms", "err", "worst", "late");
+
+	for (unsigned i = 0; i < NELEM(formats); i++)
+	for (unsigned k = 0; k < NELEM(rates); k++) {
+		if (rates[k] > SAMPLE_RATE_48000 && !formats[i].dr)
+			continue;
+		fail |= run(formats[i].name, formats[i].fmt, rates[k]);
+	}
+
+	return fail;
+}
@@ -0,0 +1,258 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-pframe [-n streams] [-s seed] [-v]: checks pwm.c block
+ *  bookkeeping, pwm_position(), pframe(), pframe_pos() and
+ *  pframe_due(), against a synthetic dma channel. pwm.c is built
+ *  as is against mock hal, tools/pwmhal.c; dma transfer count and
+ *  flags follow a position moved by so many output frames at a
+ *  time. Half/complete interrupt is taken at once, or left pending
+ *  for up to a quarter buffer, as when usb isr at same priority runs.
+ *  Renderer stands for pump(): every so often it takes blocks while
+ *  pframe() gives them, stamping each with its number; now and then
+ *  it stalls for blocks on end. Second run chases dma instead, as
+ *  pump() pended on TIM8 block ticks under CHASE does: one block a poll
+ *  if ring has data, else one to conceal only once pframe_due()
+ *  says so, which has to start within one block of dma read
+ *  position. Each stream is prefilled, runs, then drains through
+ *  dma isr, as main.c has it. Exits 1 on position off, block given
+ *  out of order, played or past BLOCKS_AHEAD, pframe_pos() not
+ *  where block starts, pframe_due() wrong, chased block not just
+ *  ahead, or stale blocks played not matching stats.late
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "tools/pwmhal.h"
+
+#define BLOCKSZ		(NCHANNELS * BFRAMES)
+#define DMABUFSZ	(NBLOCKS * BLOCKSZ)
+#define BUFFRAMES	(NPAGES * NFRAMES)
+
+#define NSTREAMS	200
+#define STREAM_BUFS	40	/* dma buffers per stream, about */
+
+static bool verbose;
+static unsigned defer;		/* frames isr is held back for */
+
+static struct {
+	uint8_t *base;		/* dmabuf, as first block tells */
+	uint32_t pos;		/* pwm_position() to be */
+	uint64_t next;		/* block pframe() should give next */
+	bool running;
+	bool chase;		/* one block a poll */
+	uint32_t taken;		/* blocks */
+	uint64_t lead;		/* frames, chased blocks took early */
+	uint32_t nlead, maxlead;
+	uint32_t stale;		/* played unstamped */
+	uint32_t skipped;	/* late, given up by pframe() */
+	uint32_t offpos, order, ahead, blkpos, due, slot, chased;
+} chk;
+
+#define FAIL(what, ...) do {						\
+	if (verbose && chk.what < 8)					\
+		printf("  " #what ": " __VA_ARGS__);			\
+	chk.what++;							\
+} while (0)
+
+static uint32_t rnd(uint32_t n)
+{
+	return n ? (uint32_t)(drand48() * n) : 0;
+}
+
+static void isr(void)
+{
+	dma1_channel1_isr();
+	defer = 0;
+}
+
+/*
+ * dma moves a frame: bytes for it go out, block it starts is
+ * checked for its stamp; flags are raised at buffer half and end,
+ * isr taken at once unless held back
+ */
+static void frame(void)
+{
+	uint32_t rblock;
+
+	if (!pwm_dma.on) return;
+
+	if (chk.running && pwm_dma.done % BLOCKSZ == 0) {
+		rblock = chk.pos / BFRAMES;
+		if (memcmp(chk.base + pwm_dma.done, &rblock, sizeof(rblock)))
+			chk.stale++;
+	}
+
+	pwm_dma.done += NCHANNELS;
+	chk.pos++;
+
+	if (pwm_dma.done == DMABUFSZ / 2) pwm_dma.htif = true;
+	if (pwm_dma.done == DMABUFSZ) {
+		pwm_dma.done = 0;
+		pwm_dma.tcif = true;
+	}
+
+	if (pwm_dma.tcif || pwm_dma.htif) {
+		if (!defer)
+			defer = rnd(2) ? 1 : 1 + rnd(BUFFRAMES / 4);
+		if (!--defer)
+			isr();
+	}
+}
+
+static void position(const char *where)
+{
+	uint32_t pos = pwm_position();
+
+	if (pos != chk.pos)
+		FAIL(offpos, "%s: %u, not %u\n", where, pos, chk.pos);
+}
+
+/*
+ * as pump() does, till pframe() gives no more; chasing, one
+ * block if ring has data, else one to conceal if it's due
+ */
+static void render(void)
+{
+	uint32_t rblock = chk.pos / BFRAMES;
+	uint8_t *dst;
+	bool due;
+
+	position("render");
+
+	due = chk.running && (int64_t)(chk.next - rblock) <= 1;
+	if (pframe_due() != due)
+		FAIL(due, "at %u: %d, next %lu\n", chk.pos, !due,
+		     (unsigned long)chk.next);
+
+	if (chk.running && chk.next <= rblock) {
+		chk.skipped += rblock + 1 - chk.next;
+		chk.next = rblock + 1;
+	}
+
+	if (chk.chase && chk.running && !rnd(4) && !due)
+		return;
+
+	while ((dst = pframe())) {
+		uint32_t blk = chk.next;
+		uint32_t lead = blk * BFRAMES - chk.pos;
+
+		if (!chk.base)
+			chk.base = dst - (blk % NBLOCKS) * BLOCKSZ;
+		if (dst != chk.base + (blk % NBLOCKS) * BLOCKSZ)
+			FAIL(order, "at %u: block %d, not %u\n", chk.pos,
+			     (int)((dst - chk.base) / BLOCKSZ), blk % NBLOCKS);
+		if (blk < rblock + chk.running)
+			FAIL(order, "at %u: block %u played\n", chk.pos, blk);
+		if (blk - rblock > BLOCKS_AHEAD)
+			FAIL(ahead, "at %u: block %u\n", chk.pos, blk);
+		if (pframe_pos() != blk * BFRAMES)
+			FAIL(blkpos, "block %u: %u\n", blk, pframe_pos());
+		if (chk.chase && chk.running) {
+			if (lead == 0 || lead > (due ? BFRAMES : BLOCKS_AHEAD * BFRAMES))
+				FAIL(chased, "at %u: block %u\n", chk.pos, blk);
+			chk.lead += lead;
+			chk.nlead++;
+			chk.maxlead = MAX(chk.maxlead, lead);
+		}
+
+		memset(dst, 0, BLOCKSZ);
+		memcpy(dst, &blk, sizeof(blk));
+		chk.next++;
+		chk.taken++;
+		if (chk.chase && chk.running)
+			break;
+	}
+
+	if (!chk.chase && chk.next - rblock <= BLOCKS_AHEAD)
+		FAIL(slot, "at %u: none, next %lu\n", chk.pos,
+		     (unsigned long)chk.next);
+}
+
+static void stream(void)
+{
+	uint32_t end = chk.pos + BUFFRAMES * (STREAM_BUFS / 2 + rnd(STREAM_BUFS));
+
+	/* prefill, EV_FILL */
+	e.state = STATE_FILL;
+	render();
+	e.state = STATE_RUNNING;
+	chk.running = true;
+	pwm_enable();
+
+	while (chk.pos < end) {
+		unsigned n = rnd(chk.chase ? BFRAMES / 4 + 1 : BFRAMES);
+
+		if (rnd(64) == 0)	/* stall */
+			n += rnd(BLOCKS_AHEAD + 4) * BFRAMES;
+		while (n--)
+			frame();
+		render();
+	}
+
+	/* drain: next half or complete stops dma and rewinds */
+	e.state = STATE_DRAIN;
+	chk.running = false;
+	while (pwm_dma.on)
+		frame();
+	chk.pos = (chk.pos / BUFFRAMES + 1) * BUFFRAMES;
+	chk.next = chk.pos / BFRAMES;
+	position("restart");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned nstreams = NSTREAMS;
+	long seed = 1;
+	int opt, fail;
+
+	while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			nstreams = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtol(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n streams] [-s seed] [-v]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	srand48(seed);
+	pwm();
+
+	printf("blocks %u (%u frames, %u ahead)\n",
+	       NBLOCKS, BFRAMES, BLOCKS_AHEAD);
+
+	for (int chase = 0; chase < 2; chase++) {
+		chk.chase = chase;
+		for (unsigned i = 0; i < nstreams; i++)
+			stream();
+	}
+
+	fail = chk.offpos || chk.order || chk.ahead || chk.blkpos ||
+		chk.due || chk.slot || chk.chased ||
+		chk.stale != stats.late || chk.skipped != stats.late;
+
+	printf("frames %u taken %u late %u stale %u skipped %u\n"
+	       "chased lead %.1f max %u frames\n"
+	       "position %u order %u ahead %u blkpos %u due %u slot %u "
+	       "chased %u: %s\n",
+	       chk.pos, chk.taken, stats.late, chk.stale, chk.skipped,
+	       chk.nlead ? (double)chk.lead / chk.nlead : 0, chk.maxlead,
+	       chk.offpos, chk.order, chk.ahead, chk.blkpos, chk.due,
+	       chk.slot, chk.chased, fail ? "FAIL" : "ok");
+
+	return fail;
+}
@@ -0,0 +1,111 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  what pwm.c calls, stubbed for host tools, see tools/pwmhal.h;
+ *  dma transfer count and flags follow pwm_dma
+ */
+
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+
+#include "common.h"
+#include "evq.h"
+#include "tools/pwmhal.h"
+
+#define DMABUFSZ	(NBLOCKS * NCHANNELS * BFRAMES)
+
+/*
+ * what main.c and sim hal would have
+ */
+volatile ev_t e;
+volatile cs_t cstate;
+volatile stats_t stats;
+volatile evq_t evq;
+volatile uint32_t dsp_pended;
+volatile uint32_t sim_icsr;
+volatile uint32_t sim_reg[SIM_NPERIPH][SIM_NREGS];
+
+uint32_t sim_cycles(void) { return 0; }
+uint32_t cm_mask_interrupts(uint32_t mask) { (void)mask; return 0; }
+
+pwm_dma_t pwm_dma;
+
+void dma_enable_flex_mode(uint32_t d) { (void)d; }
+void dma_channel_reset(uint32_t d, uint8_t c) { (void)d; (void)c; }
+void dma_set_channel_request(uint32_t d, uint8_t c, uint32_t r) { (void)d; (void)c; pwm_dma.request = r; }
+void dma_set_priority(uint32_t d, uint8_t c, uint32_t p) { (void)d; (void)c; (void)p; }
+void dma_set_memory_size(uint32_t d, uint8_t c, uint32_t s) { (void)d; (void)c; pwm_dma.msize = s; }
+void dma_set_peripheral_size(uint32_t d, uint8_t c, uint32_t s) { (void)d; (void)c; pwm_dma.psize = s; }
+void dma_enable_memory_increment_mode(uint32_t d, uint8_t c) { (void)d; (void)c; pwm_dma.minc = true; }
+void dma_enable_circular_mode(uint32_t d, uint8_t c) { (void)d; (void)c; pwm_dma.circular = true; }
+void dma_set_read_from_memory(uint32_t d, uint8_t c) { (void)d; (void)c; pwm_dma.mem2per = true; }
+void dma_set_peripheral_address(uint32_t d, uint8_t c, uint32_t a) { (void)d; (void)c; pwm_dma.paddr = a; }
+void dma_set_memory_address(uint32_t d, uint8_t c, uint32_t a) { (void)d; (void)c; (void)a; }
+void dma_enable_half_transfer_interrupt(uint32_t d, uint8_t c) { (void)d; (void)c; pwm_dma.htie = true; }
+void dma_enable_transfer_complete_interrupt(uint32_t d, uint8_t c) { (void)d; (void)c; pwm_dma.tcie = true; }
+
+void dma_set_number_of_data(uint32_t d, uint8_t c, uint16_t n)
+{
+	(void)d; (void)c;
+	pwm_dma.ndt = n;
+	pwm_dma.done = DMABUFSZ - n;
+}
+
+uint16_t dma_get_number_of_data(uint32_t d, uint8_t c)
+{
+	(void)d; (void)c;
+	return DMABUFSZ - pwm_dma.done;
+}
+
+void dma_enable_channel(uint32_t d, uint8_t c) { (void)d; (void)c; }
+void dma_disable_channel(uint32_t d, uint8_t c) { (void)d; (void)c; }
+
+bool dma_get_interrupt_flag(uint32_t d, uint8_t c, uint32_t f)
+{
+	(void)d; (void)c;
+	return ((f & DMA_TCIF) && pwm_dma.tcif) ||
+		((f & DMA_HTIF) && pwm_dma.htif);
+}
+
+void dma_clear_interrupt_flags(uint32_t d, uint8_t c, uint32_t f)
+{
+	(void)d; (void)c;
+	if (f & (DMA_GIF | DMA_TCIF)) pwm_dma.tcif = false;
+	if (f & (DMA_GIF | DMA_HTIF)) pwm_dma.htif = false;
+}
+
+void nvic_set_priority(uint8_t irqn, uint8_t prio) { (void)irqn; (void)prio; }
+void nvic_enable_irq(uint8_t irqn) { (void)irqn; }
+
+void timer_set_period(uint32_t t, uint32_t v) { (void)t; (void)v; }
+void timer_set_prescaler(uint32_t t, uint32_t v) { (void)t; (void)v; }
+void timer_set_deadtime(uint32_t t, uint32_t v) { (void)t; (void)v; }
+void timer_set_enabled_off_state_in_idle_mode(uint32_t t) { (void)t; }
+void timer_set_enabled_off_state_in_run_mode(uint32_t t) { (void)t; }
+void timer_disable_break(uint32_t t) { (void)t; }
+void timer_disable_oc_clear(uint32_t t, enum tim_oc_id o) { (void)t; (void)o; }
+void timer_enable_oc_preload(uint32_t t, enum tim_oc_id o) { (void)t; (void)o; }
+void timer_set_oc_slow_mode(uint32_t t, enum tim_oc_id o) { (void)t; (void)o; }
+void timer_set_oc_mode(uint32_t t, enum tim_oc_id o, enum tim_oc_mode m) { (void)t; (void)o; (void)m; }
+void timer_set_oc_polarity_high(uint32_t t, enum tim_oc_id o) { (void)t; (void)o; }
+void timer_set_oc_idle_state_set(uint32_t t, enum tim_oc_id o) { (void)t; (void)o; }
+void timer_enable_oc_output(uint32_t t, enum tim_oc_id o) { (void)t; (void)o; }
+void timer_enable_preload(uint32_t t) { (void)t; }
+void timer_generate_event(uint32_t t, uint32_t ev) { (void)t; (void)ev; }
+void timer_enable_irq(uint32_t t, uint32_t irq) { (void)t; (void)irq; }
+void timer_enable_break_main_output(uint32_t t) { (void)t; }
+void timer_disable_break_main_output(uint32_t t) { (void)t; }
+void timer_enable_counter(uint32_t t) { if (t == TIM1) pwm_dma.on = true; }
+void timer_disable_counter(uint32_t t) { if (t == TIM1) pwm_dma.on = false; }
+uint32_t timer_get_counter(uint32_t t) { (void)t; return 0; }
+void timer_set_counter(uint32_t t, uint32_t v) { (void)t; (void)v; }
+void timer_clear_flag(uint32_t t, uint32_t f) { (void)t; (void)f; }
+void timer_set_master_mode(uint32_t t, uint32_t m) { (void)t; (void)m; }
+void timer_slave_set_mode(uint32_t t, uint8_t m) { (void)t; (void)m; }
+void timer_slave_set_trigger(uint32_t t, uint8_t tr) { (void)t; (void)tr; }
+
+void gpio_set(uint32_t p, uint16_t g) { (void)p; (void)g; }
+void gpio_clear(uint32_t p, uint16_t g) { (void)p; (void)g; }
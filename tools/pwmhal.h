@@ -0,0 +1,38 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * mock hal pwm.c runs against in host tools, built with sim/include;
+ * no clock behind it, tools move dma along themselves
+ */
+
+/*
+ * pwm dma channel: bytes transferred since last count reload,
+ * flags raised, and what pwm() set it up with
+ */
+typedef struct {
+	uint32_t done;
+	bool on;		/* timer counting, requests going */
+	bool tcif, htif;
+	uint32_t msize, psize;
+	uint32_t paddr;
+	uint16_t ndt;
+	bool minc, circular, mem2per, htie, tcie;
+	uint32_t request;
+} pwm_dma_t;
+
+extern pwm_dma_t pwm_dma;
+
+extern volatile ev_t e;
+extern volatile cs_t cstate;
+extern volatile stats_t stats;
+
+uint32_t pwm_position(void);
+uint8_t *pframe(void);
+uint32_t pframe_pos(void);
+bool pframe_due(void);
+void pwm(void);
+void pwm_enable(void);
+void dma1_channel1_isr(void);
@@ -0,0 +1,163 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-reframe [-v]: checks reframe() unpacks every input format
+ *  into the right channel at the right level, 2.1 ones included:
+ *  l, r and, for 2.1, c are each DC at a level of its own, r below
+ *  zero so sign extension shows, packets of a ms put into ring till
+ *  it has wrapped a few times, frames straddling its end as 2.1
+ *  ones do. Every block pump() renders past first few is checked
+ *  for mean duty of each channel, as noise shaper gives it for that
+ *  level, boost off. Exits 1 on any channel's block mean off by
+ *  more than a step, or too few blocks rendered
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ctl.h"
+#include "tables.h"
+#include "tools/host.h"
+
+static const struct {
+	sample_fmt fmt;
+	const char *name;
+	float fs;		/* full scale, as set_scale() has it */
+} formats[] = {
+	{ SAMPLE_FORMAT_S16,	"s16",		1 << 15 },
+	{ SAMPLE_FORMAT_S24,	"s24",		1 << 23 },
+	{ SAMPLE_FORMAT_S32,	"s32",		1U << 31 },
+	{ SAMPLE_FORMAT_F32,	"f32",		1 },
+	{ SAMPLE_FORMAT_S16_LFE, "s16lfe",	1 << 15 },
+	{ SAMPLE_FORMAT_S24_LFE, "s24lfe",	1 << 23 }
+};
+
+static const sample_rate rates[] = {
+	SAMPLE_RATE_44100,
+	SAMPLE_RATE_48000
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(49 * 3 * 4)
+#define QF		(1U << (PWM_WIDTH - 1))
+#define WRAPS		8	/* times round ring */
+#define SETTLE		4	/* blocks, fir backlog filling */
+
+static const float level[NCHANNELS] = { 0.375f, -0.25f, 0.125f };	/* l r c */
+
+static bool verbose;
+
+/*
+ * a ms of DC, channels at their levels
+ */
+static uint16_t packet(uint8_t *dst, unsigned f, sample_rate rate)
+{
+	sample_fmt fmt = formats[f].fmt;
+	unsigned nch = nchannels(fmt);
+	unsigned width = framesize(fmt) / nch;
+	unsigned nframes = rate / 1000;
+
+	for (unsigned i = 0; i < nframes; i++) {
+		for (unsigned ch = 0; ch < nch; ch++) {
+			uint8_t *p = dst + (i * nch + ch) * width;
+			float y = level[ch];
+			int32_t v = y * formats[f].fs;
+
+			if (fmt == SAMPLE_FORMAT_F32)
+				memcpy(p, &y, width);
+			else if (fmt == SAMPLE_FORMAT_S32)
+				memcpy(p, &v, width);
+			else if (width == 3)	/* s24: low bytes, le */
+				memcpy(p, &v, 3);
+			else
+				memcpy(p, &(int16_t) { v }, 2);
+		}
+	}
+
+	return nframes * framesize(fmt);
+}
+
+static int run(unsigned f, sample_rate rate)
+{
+	sample_fmt fmt = formats[f].fmt;
+	unsigned nch = nchannels(fmt);
+	uint32_t len, put = 0, blocks = 0, off[NCHANNELS] = { 0 };
+	double worst[NCHANNELS] = { 0 };
+	uint8_t buf[MAX_PACKET];
+	int fail = 0;
+
+	ctl_reset(fmt, false);
+	pump();			/* reset carried out */
+
+	while (put < WRAPS * RBSIZE) {
+		len = packet(buf, f, rate);
+		rb_put(buf, len);
+		put += len;
+
+		while (pump()) {
+			if (++blocks <= SETTLE)
+				continue;
+
+			for (unsigned ch = 0; ch < nch; ch++) {
+				double sum = 0, d;
+
+				for (unsigned i = 0; i < BFRAMES; i++)
+					sum += host_block[i * NCHANNELS + ch];
+				d = sum / BFRAMES - QF * (1 + level[ch]);
+				if (fabs(d) > fabs(worst[ch]))
+					worst[ch] = d;
+				if (fabs(d) > 1) {
+					if (verbose && off[ch] < 4)
+						printf("  block %u ch %u: %+.2f\n",
+						       blocks, ch, d);
+					off[ch]++;
+				}
+			}
+		}
+	}
+
+	printf("%-7s %6u %6u", formats[f].name, rate, blocks);
+	for (unsigned ch = 0; ch < NCHANNELS; ch++) {
+		if (ch < nch)
+			printf(" %+7.3f %5u", worst[ch], off[ch]);
+		else
+			printf(" %7s %5s", "-", "-");
+		fail |= off[ch] != 0;
+	}
+	fail |= blocks <= SETTLE + 1;
+	printf(" %s\n", fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	ctl_publish();
+
+	printf("%-7s %6s %6s %7s %5s %7s %5s %7s %5s\n",
+	       "format", "rate", "blocks", "l", "off", "r", "off",
+	       "c", "off");
+
+	for (unsigned f = 0; f < NELEM(formats); f++)
+		for (unsigned r = 0; r < NELEM(rates); r++)
+			fail |= run(f, rates[r]);
+
+	return fail;
+}
@@ -0,0 +1,131 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2023 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-screen [-o dir] [-v]: renders screen_t snapshots, idle,
+ *  streaming, 2.1 with boost, latency armed and measured, levels
+ *  clipping, through screen_page(), every page of both displays,
+ *  as disp.c does; -o writes each display as plain pbm,
+ *  dir/name-n.pbm, off screen_pbm(). Going from every snapshot to
+ *  every other, pages screen_dirty() leaves out are checked to
+ *  render same as before. Exits 1 if any of them doesn't, as
+ *  retained framebuffer would keep it stale
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "screen.h"
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+
+static const struct {
+	const char *name;
+	screen_t s;
+} snap[] = {
+	{ "idle", {
+		.format = SAMPLE_FORMAT_NONE, .rate = SAMPLE_RATE_NONE } },
+	{ "s24-48k", {
+		.on = { [usb] = true }, .running = true, .attn = 12,
+		.format = SAMPLE_FORMAT_S24, .rate = SAMPLE_RATE_48000,
+		.rms = { 40, 36 }, .peak = { 70, 64 }, .vol = 90,
+		.load = 42 } },
+	{ "lfe-44k", {
+		.on = { [usb] = true, [boost] = true, [spmuted] = true },
+		.running = true, .attn = 3,
+		.format = SAMPLE_FORMAT_S16_LFE, .rate = SAMPLE_RATE_44100,
+		.rms = { 60, 58 }, .peak = { 90, 88 }, .vol = 112,
+		.load = 75 } },
+	{ "lat-armed", {
+		.on = { [usb] = true, [sine] = true }, .running = true,
+		.attn = 12, .format = SAMPLE_FORMAT_S24,
+		.rate = SAMPLE_RATE_96000, .rms = { 40, 36 },
+		.peak = { 70, 64 }, .vol = 90, .load = 42,
+		.lat = SCREEN_LAT_NONE } },
+	{ "lat-12ms", {
+		.on = { [usb] = true, [sine] = true }, .running = true,
+		.attn = 12, .format = SAMPLE_FORMAT_S24,
+		.rate = SAMPLE_RATE_96000, .rms = { 40, 36 },
+		.peak = { 70, 64 }, .vol = 90, .load = 42, .lat = 123 } },
+	{ "clip", {
+		.on = { [usb] = true, [muted] = true }, .running = true,
+		.attn = 60, .format = SAMPLE_FORMAT_F32,
+		.rate = SAMPLE_RATE_88200, .rms = { 119, 119 },
+		.peak = { 119, 119 }, .vol = 0, .load = 119 } }
+};
+
+static uint8_t fb[NELEM(snap)][SCREEN_PAGES][DISP_PAGE_SIZE];
+
+static bool verbose;
+
+static int dump(const char *dir, unsigned k)
+{
+	for (unsigned d = 0; d < DISPNUM; d++) {
+		char path[256];
+		FILE *f;
+
+		snprintf(path, sizeof(path), "%s/%s-%u.pbm", dir,
+			 snap[k].name, d);
+		if (!(f = fopen(path, "w"))) {
+			perror(path);
+			return 1;
+		}
+		screen_pbm(f, fb[k], d);
+		fclose(f);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dir = NULL;
+	unsigned pairs = 0, stale = 0;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "o:v")) != -1) {
+		switch (opt) {
+		case 'o':
+			dir = optarg;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-o dir] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (unsigned k = 0; k < NELEM(snap); k++) {
+		for (unsigned p = 0; p < SCREEN_PAGES; p++)
+			screen_page(fb[k][p], p, &snap[k].s);
+		if (dir)
+			fail |= dump(dir, k);
+	}
+
+	for (unsigned a = 0; a < NELEM(snap); a++)
+		for (unsigned b = 0; b < NELEM(snap); b++) {
+			uint32_t dirty = screen_dirty(&snap[a].s, &snap[b].s);
+
+			if (a == b) continue;
+			pairs++;
+			for (unsigned p = 0; p < SCREEN_PAGES; p++) {
+				if (dirty & 1U << p ||
+				    !memcmp(fb[a][p], fb[b][p], DISP_PAGE_SIZE))
+					continue;
+				if (verbose || stale < 8)
+					printf("  %s -> %s: page %u stale\n",
+					       snap[a].name, snap[b].name, p);
+				stale++;
+			}
+		}
+
+	fail |= stale != 0;
+	printf("snapshots %zu, pairs %u, stale pages %u%s%s: %s\n",
+	       NELEM(snap), pairs, stale, dir ? ", pbm in " : "",
+	       dir ? dir : "", fail ? "FAIL" : "ok");
+
+	return fail;
+}
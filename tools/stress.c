@@ -0,0 +1,309 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-stress [-n packets] [-r every] [-u us] [-v]: hammers control
+ *  state, ctl.c, concurrently with streaming. Dsp core runs blocks
+ *  as fast as ring has them, as pump() would at dsp priority; a
+ *  timer signal every -u us stands for interrupts preempting it,
+ *  wherever it is. Each one publishes next volume, mute and boost
+ *  tuple, whose boost follows from attn and mute, as encoder or
+ *  usb control would, then puts a packet, asking for a format and
+ *  rate reset every so many, as usb would. Each stream between
+ *  resets is DC at a level of its own, l positive, r its negative,
+ *  so filter capture tap tells what dsp made of ring. First run
+ *  leaves controls alone, second hammers them too. Exits 1 if dsp
+ *  ever ran with a torn tuple, captured l and r apart, level not
+ *  of any stream with controls left alone, or stream going back
+ *  to one reset away
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "cap.h"
+#include "ctl.h"
+#include "tables.h"
+#include "tools/host.h"
+
+static const struct {
+	sample_fmt fmt;
+	sample_rate rate;
+	float fs;		/* full scale, as set_scale() has it */
+} streams[] = {
+	{ SAMPLE_FORMAT_S16,	SAMPLE_RATE_48000,	1 << 15 },
+	{ SAMPLE_FORMAT_S24,	SAMPLE_RATE_96000,	1 << 23 },
+	{ SAMPLE_FORMAT_F32,	SAMPLE_RATE_48000,	1 },
+	{ SAMPLE_FORMAT_S24,	SAMPLE_RATE_44100,	1 << 23 },
+	{ SAMPLE_FORMAT_S16,	SAMPLE_RATE_88200,	1 << 15 }
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(97 * 3 * 2)
+#define NLEVELS		64	/* of 1/128 full scale, per stream */
+#define LEVEL(g)	((g) % NLEVELS + 1)
+
+static bool verbose;
+
+/*
+ * interrupt side
+ */
+static volatile struct {
+	bool hammer;
+	bool done;
+	uint32_t npackets;
+	uint32_t every;
+	uint32_t i;		/* packets put or dropped */
+	uint32_t g;		/* stream, resets asked for */
+	uint32_t k;		/* tuples published */
+	uint32_t dropped;	/* reset pending */
+} isr;
+
+/*
+ * dsp side
+ */
+static struct {
+	uint32_t blocks;
+	uint32_t taken;		/* tuples dsp changed to */
+	uint32_t torn;
+	uint32_t frames;	/* captured */
+	uint32_t apart;		/* l and r not of same frame */
+	uint32_t stray;		/* not any stream's level */
+	uint32_t back;		/* older stream after newer one */
+	uint32_t changes;	/* level changes seen */
+	int last;
+} dsp;
+
+/*
+ * attn steps by one, mute every other step pair; boost is
+ * parity of both, so either field from another tuple shows
+ */
+static void tuple(uint32_t k)
+{
+	cstate.attn = k % VOLSTEPS;
+	cstate.on[muted] = (k >> 1) & 1;
+	cstate.on[boost] = (cstate.attn ^ cstate.on[muted]) & 1;
+}
+
+/*
+ * 1ms of DC at level, l positive, r negative
+ */
+static uint16_t packet(uint8_t *dst, unsigned s, uint32_t g)
+{
+	unsigned nframes = streams[s].rate / 1000;
+	sample_fmt fmt = streams[s].fmt;
+	unsigned width = framesize(fmt) / nchannels(fmt);
+	float x = LEVEL(g) / 128.0f;
+
+	for (unsigned i = 0; i < nframes; i++) {
+		for (unsigned ch = 0; ch < 2; ch++) {
+			uint8_t *p = dst + i * framesize(fmt) + ch * width;
+			float y = ch ? -x : x;
+			int32_t v = y * streams[s].fs;
+
+			memcpy(p, fmt == SAMPLE_FORMAT_F32 ?
+			       (void *)&y : (void *)&v, width);
+		}
+	}
+
+	return nframes * framesize(fmt);
+}
+
+/*
+ * packet is retried next time round should ring be full
+ */
+static void tick(int sig)
+{
+	uint8_t buf[MAX_PACKET];
+	uint32_t overrun = stats.overrun;
+	unsigned s;
+
+	(void)sig;
+
+	if (isr.hammer) {
+		tuple(++isr.k);
+		ctl_publish();
+	}
+
+	if (isr.done)
+		return;
+
+	if (isr.i && isr.i % isr.every == 0) {
+		s = ++isr.g % NELEM(streams);
+		cstate.format = streams[s].fmt;
+		cstate.rate = streams[s].rate;
+		ctl_reset(streams[s].fmt, streams[s].rate > SAMPLE_RATE_48000);
+	}
+
+	if (ctl_pending()) {
+		isr.dropped++;
+	} else {
+		s = isr.g % NELEM(streams);
+		rb_put(buf, packet(buf, s, isr.g));
+		if (stats.overrun != overrun)
+			return;
+	}
+
+	if (++isr.i == isr.npackets)
+		isr.done = true;
+}
+
+/*
+ * captured level, 1/128 full scale steps, -1 if not a whole one
+ */
+static int level(const cap_frame_t *f, bool *apart)
+{
+	int v = f->l;
+
+	*apart = abs(f->l + f->r) > 1;
+	if ((v + 1) % 256 > 2)
+		return -1;
+	return (v + 1) / 256;
+}
+
+static void check(const cap_frame_t *f, unsigned n, bool fixed)
+{
+	for (unsigned i = 0; i < n; i++, f++) {
+		bool apart;
+		int v = level(f, &apart);
+
+		dsp.frames++;
+		if (apart) {
+			if (verbose && dsp.apart < 8)
+				printf("  frame %u: l %d r %d\n",
+				       dsp.frames, f->l, f->r);
+			dsp.apart++;
+		}
+		if (!fixed)
+			continue;
+		if (v < 1 || v > NLEVELS) {
+			if (verbose && dsp.stray < 8)
+				printf("  frame %u: l %d\n", dsp.frames, f->l);
+			dsp.stray++;
+			continue;
+		}
+		if (v == dsp.last)
+			continue;
+		if (dsp.last &&
+		    (v - dsp.last + NLEVELS) % NLEVELS >= NLEVELS / 2) {
+			if (verbose && dsp.back < 8)
+				printf("  frame %u: level %d after %d\n",
+				       dsp.frames, v, dsp.last);
+			dsp.back++;
+		}
+		dsp.changes++;
+		dsp.last = v;
+	}
+}
+
+static int run(const char *name, uint32_t npackets, uint32_t every,
+	       unsigned us, bool hammer)
+{
+	struct itimerval it = {
+		.it_interval = { .tv_usec = us },
+		.it_value = { .tv_usec = us }
+	};
+	ctl_t prev = { 0 };
+	bool fixed = !hammer;
+	int fail;
+
+	memset(&dsp, 0, sizeof(dsp));
+	memset((void *)&isr, 0, sizeof(isr));
+	isr.hammer = hammer;
+	isr.npackets = npackets;
+	isr.every = every;
+
+	tuple(0);
+	ctl_publish();
+	ctl_reset(streams[0].fmt, streams[0].rate > SAMPLE_RATE_48000);
+	cap_set_tap(CAP_TAP_FILTER);
+	cap_start(true);
+
+	setitimer(ITIMER_REAL, &it, NULL);
+
+	while (!isr.done) {
+		cap_frame_t buf[CAP_PACKET_FRAMES];
+		uint16_t n;
+
+		if (!pump())
+			continue;
+		dsp.blocks++;
+
+		if (ctl.boost != ((ctl.attn ^ ctl.muted) & 1)) {
+			if (verbose && dsp.torn < 8)
+				printf("  block %u: attn %u muted %u boost %u\n",
+				       dsp.blocks, ctl.attn, ctl.muted,
+				       ctl.boost);
+			dsp.torn++;
+		}
+		if (memcmp(&prev, &ctl, sizeof(ctl))) {
+			dsp.taken++;
+			prev = ctl;
+		}
+
+		while ((n = cap_packet(buf, SAMPLE_RATE_48000)))
+			check(buf, n, fixed);
+	}
+
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_REAL, &it, NULL);
+	cap_start(false);
+
+	fail = dsp.torn || dsp.apart || dsp.stray || dsp.back ||
+		!dsp.blocks || (hammer && dsp.taken < 2) ||
+		(fixed && !dsp.changes);
+
+	printf("%-7s %8u %6u %7u %8u %9u %7u %8u %5u %5u %5u %5u %s\n",
+	       name, npackets, isr.g, isr.dropped, dsp.blocks, isr.k,
+	       dsp.taken, dsp.frames, dsp.torn, dsp.apart, dsp.stray,
+	       dsp.back, fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t npackets = 20000, every = 20;
+	unsigned us = 20;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:r:u:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			npackets = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			every = strtoul(optarg, NULL, 0);
+			break;
+		case 'u':
+			us = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n packets] [-r every] "
+				"[-u us] [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (!every) every = 1;
+	if (!us || us >= 1000000) us = 20;
+
+	signal(SIGALRM, tick);
+
+	printf("%-7s %8s %6s %7s %8s %9s %7s %8s %5s %5s %5s %5s\n",
+	       "run", "packets", "resets", "dropped", "blocks", "published",
+	       "taken", "captured", "torn", "apart", "stray", "back");
+
+	fail |= run("resets", npackets, every, us, false);
+	fail |= run("both", npackets, every, us, true);
+
+	return fail;
+}
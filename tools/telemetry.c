@@ -0,0 +1,131 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-telemetry [-v]: checks telemetry counters against what
+ *  f4uacstat makes of them. stats and pump() profile are set to
+ *  known values, each with bytes of its own, prof_telemetry() packs
+ *  them as usb side does, block is read back at TELEMETRY_VERSION
+ *  wire offsets, little endian, and through tm_decode(), as
+ *  f4uacstat does. Exits 1 if block size, any counter's offset or
+ *  value is off, or decoded one differs from what was packed
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "prof.h"
+#include "telemetry.h"
+#include "tools/host.h"
+#include "tools/tmdecode.h"
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define WIRE_SIZE	66	/* TELEMETRY_VERSION 2 */
+
+void prof_telemetry(telemetry_t *t);
+
+/*
+ * counters, where version 2 has them on the wire
+ */
+static const struct {
+	const char *name;
+	unsigned wire;
+	size_t ofs;
+} field[] = {
+	{ "opens",	16,	offsetof(telemetry_t, opens) },
+	{ "late",	20,	offsetof(telemetry_t, late) },
+	{ "underrun",	24,	offsetof(telemetry_t, underrun) },
+	{ "overrun",	28,	offsetof(telemetry_t, overrun) },
+	{ "partial",	32,	offsetof(telemetry_t, partial) },
+	{ "missed",	36,	offsetof(telemetry_t, missed) },
+	{ "evlate",	40,	offsetof(telemetry_t, evlate) },
+	{ "clip l",	44,	offsetof(telemetry_t, clip[0]) },
+	{ "clip r",	48,	offsetof(telemetry_t, clip[1]) },
+	{ "clip c",	52,	offsetof(telemetry_t, clip[2]) },
+	{ "pump avg",	56,	offsetof(telemetry_t, pump_avg) },
+	{ "pump max",	60,	offsetof(telemetry_t, pump_max) }
+};
+
+static bool verbose;
+
+/*
+ * k-th counter's value: every byte tells counter and its place
+ */
+static uint32_t value(unsigned k)
+{
+	return (k + 1) << 24 | (k + 1) << 16 | 0xa0 << 8 | (k + 1) << 4;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t want[NELEM(field)];
+	uint8_t wire[sizeof(telemetry_t)];
+	telemetry_t t;
+	unsigned off = 0;
+	int opt, fail;
+
+	while ((opt = getopt(argc, argv, "v")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (unsigned k = 0; k < NELEM(field); k++)
+		want[k] = value(k);
+
+	stats.opens = want[0];
+	stats.late = want[1];
+	stats.underrun = want[2];
+	stats.overrun = want[3];
+	stats.partial = want[4];
+	stats.missed = want[5];
+	stats.evlate = want[6];
+	for (unsigned i = 0; i < NCHANNELS; i++)
+		stats.clip[i] = want[7 + i];
+	prof[PROF_PUMP].avg = want[10];
+	prof[PROF_PUMP].max = want[11];
+
+	memset(&t, 0, sizeof(t));
+	t.version = TELEMETRY_VERSION;
+	prof_telemetry(&t);
+	memcpy(wire, &t, sizeof(wire));
+	tm_decode(&t);
+
+	printf("%-9s %4s %4s %10s %10s %10s\n", "counter", "wire", "ofs",
+	       "want", "wire", "decoded");
+
+	for (unsigned k = 0; k < NELEM(field); k++) {
+		uint32_t w = le32(wire + field[k].wire), d;
+		bool bad;
+
+		memcpy(&d, (uint8_t *)&t + field[k].ofs, sizeof(d));
+		bad = field[k].ofs != field[k].wire || w != want[k] ||
+			d != want[k];
+		if (verbose || bad)
+			printf("%-9s %4u %4zu 0x%08x 0x%08x 0x%08x%s\n",
+			       field[k].name, field[k].wire, field[k].ofs,
+			       want[k], w, d, bad ? " off" : "");
+		off += bad;
+	}
+
+	fail = sizeof(telemetry_t) != WIRE_SIZE ||
+		TELEMETRY_VERSION != 2 || off;
+	printf("version %u, %zu bytes (%u on wire), counters %zu, off %u: "
+	       "%s\n", TELEMETRY_VERSION, sizeof(telemetry_t), WIRE_SIZE,
+	       NELEM(field), off, fail ? "FAIL" : "ok");
+
+	return fail;
+}
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# timeline.py [--hz N] [--csv out.csv] swo.bin > trace.json:
+# turns trace() points of a DEBUG build SWO capture into Chrome /
+# Perfetto trace JSON (chrome://tracing, ui.perfetto.dev) and,
+# optionally, CSV; stamps are cpu cycles, --hz converts them to us
+
+import argparse
+import csv
+import json
+import sys
+
+from dbgdecode import DBG_ITM_PORT, itm_words, records
+
+# port: (name, kind, value conversion)
+PORTS = {
+    1: ("rx", "packet", None),
+    2: ("feedback", "counter", lambda v: v / 16384.0),
+    3: ("ac status", "instant", None),
+    4: ("measured", "counter", lambda v: v / 16384.0),
+    5: ("late", "instant", None),
+    6: ("underrun", "instant", None),
+    7: ("pump", "span", None),
+}
+
+
+def unwrap(stamps):
+    """32 bit cycle counter to 64 bit: steps are taken mod 2^32, ones
+    past half way round as small steps back, as stamp is read after
+    slot is claimed, and an isr in between stores an earlier one in
+    a later slot; that's reordering, not a wrap"""
+    t, last = 0, None
+    for s in stamps:
+        if last is None:
+            t = s
+        else:
+            d = (s - last) & 0xffffffff
+            t += d - (1 << 32) if d >= 1 << 31 else d
+        last = s
+        yield t
+
+
+def events(stream):
+    recs = list(records(itm_words(stream, DBG_ITM_PORT)))
+    for (seq, _, fmt, _, args), t in zip(recs, unwrap(r[1] for r in recs)):
+        if fmt == 0:
+            yield t, "dropped", "instant", args[0]
+        elif fmt in PORTS:
+            name, kind, conv = PORTS[fmt]
+            v = args[0]
+            if kind == "packet":
+                yield t, "packet len", "counter", v >> 16
+                yield t, "ring fill", "counter", v & 0xffff
+            else:
+                yield t, name, kind, conv(v) if conv else v
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--hz", type=float, default=244e6)
+    ap.add_argument("--csv")
+    ap.add_argument("capture")
+    a = ap.parse_args()
+
+    us = 1e6 / a.hz
+    evs = list(events(open(a.capture, "rb").read()))
+    t0 = evs[0][0] if evs else 0
+    out = []
+
+    for t, name, kind, v in evs:
+        ts = (t - t0) * us
+        e = {"name": name, "ts": ts, "pid": 1, "tid": 1}
+        if kind == "counter":
+            e.update(ph="C", args={name: v})
+        elif kind == "span":
+            e.update(ph="X", ts=ts - v * us, dur=v * us, tid=2)
+        else:
+            e.update(ph="i", s="g", args={"value": v})
+        out.append(e)
+
+    json.dump({"traceEvents": out, "displayTimeUnit": "ms"}, sys.stdout)
+
+    if a.csv:
+        with open(a.csv, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(["us", "event", "value"])
+            for t, name, _, v in evs:
+                w.writerow(["%.3f" % ((t - t0) * us), name, v])
+
+
+if __name__ == "__main__":
+    main()
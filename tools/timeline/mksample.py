@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: MIT
+#
+# mksample.py > sample.swo: hand built, synthetic SWO capture for
+# make host-timeline, laid out as a DEBUG build's log ring drains it
+# over ITM port 1, see debug.c. 8 ms of every trace point with the
+# cycle counter wrapping 3 ms in, a dropped record, a pair stored
+# out of stamp order as an isr preempting between claim and stamp
+# leaves it, and overflow, local timestamp, port 0 and short port 1
+# packets mixed in. Seeded, so output is the same every run
+
+import random
+import struct
+import sys
+
+HZ = 244000000
+SYNC = 0xdb
+
+out = bytearray()
+seq = 0
+
+
+def sync():
+    out.extend(b"\x00" * 5 + b"\x80")
+
+
+def word(port, v):
+    out.append(port << 3 | 3)
+    out.extend(struct.pack("<I", v & 0xffffffff))
+
+
+def rec(stamp, fmt, args):
+    global seq
+    dropped = fmt == 0
+    if not dropped:
+        seq += 1
+    word(1, SYNC << 24 | len(args) << 16 | (0 if dropped else seq & 0xffff))
+    word(1, stamp)
+    word(1, fmt)
+    word(1, 0)
+    for a in args:
+        word(1, a)
+
+
+def main():
+    random.seed(39)
+    t = 0xffffffff - 3 * HZ // 1000         # wraps 3 ms in
+    fb = 48 << 14
+    fill = 1152
+
+    sync()
+    for ms in range(8):
+        base = t + ms * HZ // 1000
+        fill += random.randint(-24, 24)
+        ev = [(base, 1, [288 << 16 | fill])]
+        if ms % 2 == 0:
+            fb += random.randint(-40, 40)
+            ev += [(base + 1200, 2, [fb]),
+                   (base + 1500, 4, [fb + random.randint(-8, 8)])]
+        ev += [(base + 60000, 7, [random.randint(90000, 110000)]),
+               (base + 182000, 7, [random.randint(90000, 110000)])]
+        if ms == 3:
+            ev.append((base + 3000, 3, [0x0101]))
+        if ms == 5:
+            ev += [(base + 4000, 0, [3]), (base + 5000, 5, [1]),
+                   (base + 5100, 6, [2])]
+        if ms == 6:
+            ev += [(base + 3000, 3, [0x0001]), (base + 3400, 5, [1])]
+        ev.sort(key=lambda e: e[0])
+        if ms == 6:                         # isr got its stamp in first
+            i = [e[0] for e in ev].index(base + 3000)
+            ev[i], ev[i + 1] = ev[i + 1], ev[i]
+        for i, (s, f, a) in enumerate(ev):
+            rec(s, f, a)
+            if ms == 2 and i == 1:
+                out.append(0x70)                # overflow
+                out.extend(b"\xc1\x85\x02")     # local timestamp, continued
+                word(0, 0x41424344)             # port 0, not ours
+                out.extend(b"\x09\x55")         # 1 byte to port 1, ignored
+                sync()
+
+    sys.stdout.buffer.write(out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,29 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+#include <endian.h>
+
+#include "telemetry.h"
+#include "tools/tmdecode.h"
+
+void tm_decode(telemetry_t *t)
+{
+	t->rate = le32toh(t->rate);
+	t->feedback = le32toh(t->feedback);
+	t->rbmin = le16toh(t->rbmin);
+	t->rbmax = le16toh(t->rbmax);
+	t->rbtarget = le16toh(t->rbtarget);
+	t->opens = le32toh(t->opens);
+	t->late = le32toh(t->late);
+	t->underrun = le32toh(t->underrun);
+	t->overrun = le32toh(t->overrun);
+	t->partial = le32toh(t->partial);
+	t->missed = le32toh(t->missed);
+	t->evlate = le32toh(t->evlate);
+	for (unsigned i = 0; i < 3; i++)
+		t->clip[i] = le32toh(t->clip[i]);
+	t->pump_avg = le32toh(t->pump_avg);
+	t->pump_max = le32toh(t->pump_max);
+}
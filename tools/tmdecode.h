@@ -0,0 +1,10 @@
+/*
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ */
+
+/*
+ * telemetry block as it came off the wire, little endian,
+ * to host order in place; f4uacstat and host-telemetry share it
+ */
+void tm_decode(telemetry_t *t);
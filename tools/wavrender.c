@@ -0,0 +1,559 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  wavrender [-b] [-a attn] [-d duty.raw] [-o out.wav] in.wav:
+ *  runs wav through dsp core as the device would, optionally writing
+ *  pwm duty stream (interleaved l/r/c bytes at pwm frame rate) and
+ *  its ideal reconstruction (float wav at input rate), and reports
+ *  SINAD, THD+N, in-band noise and idle tones per channel
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "ctl.h"
+#include "tables.h"
+#include "tools/host.h"
+
+#define QF		(1U << (PWM_WIDTH - 1))
+
+static uint16_t le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+	return le16(p) | (uint32_t)le16(p + 2) << 16;
+}
+
+/*
+ * wav in, anything usb would take
+ */
+typedef struct {
+	sample_fmt fmt;
+	sample_rate rate;
+	uint32_t len;		/* data bytes left */
+} wav_t;
+
+static sample_fmt wav_format(unsigned tag, unsigned bits, unsigned nch)
+{
+	if (tag == 3 && bits == 32 && nch == 2)
+		return SAMPLE_FORMAT_F32;
+	if (tag != 1 || nch < 2 || nch > 3)
+		return SAMPLE_FORMAT_NONE;
+
+	switch (bits) {
+	case 16:
+		return nch > 2 ? SAMPLE_FORMAT_S16_LFE : SAMPLE_FORMAT_S16;
+	case 24:
+		return nch > 2 ? SAMPLE_FORMAT_S24_LFE : SAMPLE_FORMAT_S24;
+	case 32:
+		return nch > 2 ? SAMPLE_FORMAT_NONE : SAMPLE_FORMAT_S32;
+	}
+
+	return SAMPLE_FORMAT_NONE;
+}
+
+static int wav_open(FILE *f, wav_t *w)
+{
+	uint8_t h[12], fmt[40];
+	unsigned tag = 0, bits = 0, nch = 0;
+	uint32_t n;
+
+	if (fread(h, 1, 12, f) != 12 ||
+	    memcmp(h, "RIFF", 4) || memcmp(h + 8, "WAVE", 4))
+		return -1;
+
+	while (fread(h, 1, 8, f) == 8) {
+		n = le32(h + 4);
+		if (!memcmp(h, "fmt ", 4)) {
+			if (n < 16 || n > sizeof(fmt) || fread(fmt, 1, n, f) != n)
+				return -1;
+			tag = le16(fmt);
+			nch = le16(fmt + 2);
+			w->rate = le32(fmt + 4);
+			bits = le16(fmt + 14);
+			if (tag == 0xfffe && n >= 26)	/* extensible */
+				tag = le16(fmt + 24);
+			if (n & 1) fgetc(f);
+		} else if (!memcmp(h, "data", 4)) {
+			w->fmt = wav_format(tag, bits, nch);
+			if (w->fmt == SAMPLE_FORMAT_NONE)
+				return -1;
+			w->len = n - n % framesize(w->fmt);
+			return 0;
+		} else if (fseek(f, n + (n & 1), SEEK_CUR)) {
+			return -1;
+		}
+	}
+
+	return -1;
+}
+
+/*
+ * float wav out, header rewritten with actual size at close
+ */
+static void wav_header(FILE *f, uint32_t rate, uint32_t nframes)
+{
+	uint32_t len = nframes * NCHANNELS * sizeof(float);
+	uint8_t h[44];
+
+#define PUT16(o, v) do { h[o] = (v); h[o + 1] = (v) >> 8; } while (0)
+#define PUT32(o, v) do { PUT16(o, (v) & 0xffff); PUT16(o + 2, (v) >> 16); } while (0)
+	memcpy(h, "RIFF", 4);
+	PUT32(4, 36 + len);
+	memcpy(h + 8, "WAVEfmt ", 8);
+	PUT32(16, 16);
+	PUT16(20, 3);				/* ieee float */
+	PUT16(22, NCHANNELS);
+	PUT32(24, rate);
+	PUT32(28, rate * NCHANNELS * sizeof(float));
+	PUT16(32, NCHANNELS * sizeof(float));
+	PUT16(34, 32);
+	memcpy(h + 36, "data", 4);
+	PUT32(40, len);
+#undef PUT32
+#undef PUT16
+
+	fwrite(h, 1, sizeof(h), f);
+}
+
+/*
+ * ideal reconstruction: kaiser windowed sinc low pass at pwm frame
+ * rate, stopband (~100dB) from input nyquist on, decimated back to
+ * input rate. Delay is RECON_TAPS/2 pwm frames, RECON_DELAY output
+ */
+#define RECON_PHASES	128
+#define RECON_TAPS(u)	(RECON_PHASES * (u) + 1)
+#define RECON_DELAY	(RECON_PHASES / 2)
+#define KAISER_BETA	10.0
+
+static struct {
+	unsigned u;
+	unsigned ntaps;
+	unsigned phase;
+	unsigned idx;
+	float *h;
+	float *hist[NCHANNELS];		/* twice ntaps, mirrored */
+} rc;
+
+static double i0(double x)
+{
+	double s = 1.0, t = 1.0;
+
+	for (unsigned k = 1; k < 32; k++) {
+		t *= (x / (2 * k)) * (x / (2 * k));
+		s += t;
+	}
+
+	return s;
+}
+
+static void recon_setup(unsigned u)
+{
+	unsigned n = RECON_TAPS(u);
+	double fc = .475 / u, sum = 0.0;	/* cycles per pwm frame */
+
+	rc.u = u;
+	rc.ntaps = n;
+	rc.h = malloc(n * sizeof(float));
+	for (unsigned ch = 0; ch < NCHANNELS; ch++)
+		rc.hist[ch] = calloc(2 * n, sizeof(float));
+
+	for (unsigned i = 0; i < n; i++) {
+		double t = i - (n - 1) / 2.0, r = 2.0 * i / (n - 1) - 1.0;
+		double s = t ? sin(2 * M_PI * fc * t) / (M_PI * t) : 2 * fc;
+		rc.h[i] = s * i0(KAISER_BETA * sqrt(1 - r * r)) / i0(KAISER_BETA);
+		sum += rc.h[i];
+	}
+
+	for (unsigned i = 0; i < n; i++)
+		rc.h[i] /= sum;
+}
+
+static bool recon_put(const float *x, float *y)
+{
+	unsigned n = rc.ntaps;
+
+	for (unsigned ch = 0; ch < NCHANNELS; ch++)
+		rc.hist[ch][rc.idx] = rc.hist[ch][rc.idx + n] = x[ch];
+	rc.idx = (rc.idx + 1) % n;
+
+	if (++rc.phase < rc.u)
+		return false;
+	rc.phase = 0;
+
+	for (unsigned ch = 0; ch < NCHANNELS; ch++) {
+		const float *p = &rc.hist[ch][rc.idx];
+		double acc = 0.0;
+
+		for (unsigned i = 0; i < n; i++)
+			acc += rc.h[i] * p[i];
+		y[ch] = acc;
+	}
+
+	return true;
+}
+
+/*
+ * analysis: welch averaged power spectrum, 4 term blackman-harris,
+ * half overlap; bins are one sided power, full scale sine is 0.5
+ */
+#define FFT_SHIFT	14
+#define FFT_N		(1 << FFT_SHIFT)
+#define LOBE		6	/* bins either side taken as a tone */
+#define IDLE_MAX	8	/* idle tones listed, loudest first */
+
+static struct {
+	double w[FFT_N];
+	double wss;
+	double cs[FFT_N / 2];		/* twiddles */
+	double sn[FFT_N / 2];
+	float buf[NCHANNELS][FFT_N];
+	double psd[NCHANNELS][FFT_N / 2 + 1];
+	unsigned fill;
+	unsigned nseg;
+} an;
+
+static void an_setup(void)
+{
+	for (unsigned i = 0; i < FFT_N; i++) {
+		double x = 2 * M_PI * i / FFT_N;
+		an.w[i] = .35875 - .48829 * cos(x) +
+			.14128 * cos(2 * x) - .01168 * cos(3 * x);
+		an.wss += an.w[i] * an.w[i];
+	}
+
+	for (unsigned i = 0; i < FFT_N / 2; i++) {
+		an.cs[i] = cos(2 * M_PI * i / FFT_N);
+		an.sn[i] = -sin(2 * M_PI * i / FFT_N);
+	}
+}
+
+static void fft(double *re, double *im)
+{
+	for (unsigned i = 1, j = 0; i < FFT_N; i++) {
+		unsigned bit = FFT_N >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			double t;
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+
+	for (unsigned len = 2, step = FFT_N / 2; len <= FFT_N; len <<= 1, step >>= 1)
+		for (unsigned i = 0; i < FFT_N; i += len)
+		for (unsigned k = 0; k < len / 2; k++) {
+			double wr = an.cs[k * step], wi = an.sn[k * step];
+			double *ur = &re[i + k], *ui = &im[i + k];
+			double *vr = &re[i + k + len / 2], *vi = &im[i + k + len / 2];
+			double tr = *vr * wr - *vi * wi, ti = *vr * wi + *vi * wr;
+			*vr = *ur - tr;
+			*vi = *ui - ti;
+			*ur += tr;
+			*ui += ti;
+		}
+}
+
+static void an_put(const float *y)
+{
+	static double re[FFT_N], im[FFT_N];
+
+	for (unsigned ch = 0; ch < NCHANNELS; ch++)
+		an.buf[ch][an.fill] = y[ch];
+
+	if (++an.fill < FFT_N)
+		return;
+
+	for (unsigned ch = 0; ch < NCHANNELS; ch++) {
+		for (unsigned i = 0; i < FFT_N; i++) {
+			re[i] = an.buf[ch][i] * an.w[i];
+			im[i] = 0.0;
+		}
+		fft(re, im);
+		for (unsigned k = 0; k <= FFT_N / 2; k++)
+			an.psd[ch][k] += 2 * (re[k] * re[k] + im[k] * im[k]) /
+				(FFT_N * an.wss);
+		memmove(an.buf[ch], an.buf[ch] + FFT_N / 2,
+			FFT_N / 2 * sizeof(float));
+	}
+
+	an.fill = FFT_N / 2;
+	an.nseg++;
+}
+
+static double dbfs(double p)
+{
+	return 10 * log10(p / .5 + 1e-30);
+}
+
+static int cmp(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static double lobe(const double *p, unsigned k)
+{
+	double s = 0.0;
+
+	for (unsigned i = k - LOBE; i <= k + LOBE; i++)
+		s += p[i];
+
+	return s;
+}
+
+/*
+ * tone lobes and their skirts, where sidelobes of a loud one
+ * could pass for idle tones
+ */
+static void mark(bool *skip, unsigned k, unsigned lo, unsigned hi)
+{
+	for (unsigned i = MAX(k, lo + 2 * LOBE) - 2 * LOBE;
+	     i <= MIN(k + 2 * LOBE, hi); i++)
+		skip[i] = true;
+}
+
+static bool peak(const double *p, unsigned k)
+{
+	for (unsigned i = k - LOBE; i <= k + LOBE; i++)
+		if (p[i] > p[k])
+			return false;
+
+	return true;
+}
+
+/*
+ * noise floor around bin k, shaped noise rises towards band edge
+ */
+#define FLOOR_BINS	64
+
+static double floor_at(const double *p, unsigned k, unsigned lo, unsigned hi)
+{
+	double v[2 * FLOOR_BINS + 1];
+	unsigned a = MAX(k, lo + FLOOR_BINS) - FLOOR_BINS;
+	unsigned b = MIN(k + FLOOR_BINS, hi), n = b - a + 1;
+
+	memcpy(v, p + a, n * sizeof(double));
+	qsort(v, n, sizeof(double), cmp);
+	return v[n / 2];
+}
+
+/*
+ * tone is largest in-band peak, if it stands 40dB over median bin;
+ * noise is what's left in band past the tone and its harmonics,
+ * idle tones are other peaks 20dB over local noise floor
+ */
+static void an_report(unsigned ch, const char *name, double fs)
+{
+	static double sorted[FFT_N / 2 + 1];
+	static bool skip[FFT_N / 2 + 1];
+	double *p = an.psd[ch], df = fs / FFT_N;
+	unsigned lo = MAX(ceil(20 / df), LOBE), hi = MIN(20000, fs / 2) / df;
+	unsigned k0, nb;
+	double med, tot = 0.0, sig = 0.0, harm = 0.0, noise;
+	struct { double f, p; } idle[IDLE_MAX];
+	unsigned nidle = 0;
+	bool tone;
+
+	hi = MIN(hi, FFT_N / 2 - LOBE);
+	k0 = lo;
+	nb = hi - lo + 1;
+	for (unsigned k = lo; k <= hi; k++) {
+		p[k] /= an.nseg;
+		tot += sorted[k - lo] = p[k];
+		if (p[k] > p[k0]) k0 = k;
+		skip[k] = false;
+	}
+	qsort(sorted, nb, sizeof(double), cmp);
+	med = sorted[nb / 2];
+
+	tone = p[k0] > med * 1e4;
+	if (tone) {
+		sig = lobe(p, k0);
+		mark(skip, k0, lo, hi);
+		for (unsigned h = 2; h * k0 + LOBE <= hi; h++) {
+			harm += lobe(p, h * k0);
+			mark(skip, h * k0, lo, hi);
+		}
+	}
+	noise = tot - sig - harm;
+
+	if (tone)
+		printf("%-2s %9.1f %8.1f %8.1f %8.1f %9.4f %8.1f\n", name,
+		       k0 * df, dbfs(sig), 10 * log10(sig / (tot - sig)),
+		       10 * log10((tot - sig) / sig),
+		       100 * sqrt((tot - sig) / sig), dbfs(noise));
+	else
+		printf("%-2s %9s %8s %8s %8s %9s %8.1f\n", name,
+		       "-", "-", "-", "-", "-", dbfs(noise));
+
+	for (unsigned k = lo; k <= hi; k++) {
+		unsigned i;
+
+		if (skip[k] || !peak(p, k) ||
+		    !(p[k] > floor_at(p, k, lo, hi) * 100))
+			continue;
+		mark(skip, k, lo, hi);
+		for (i = MIN(nidle, IDLE_MAX); i && idle[i - 1].p < lobe(p, k); i--)
+			if (i < IDLE_MAX) idle[i] = idle[i - 1];
+		if (i < IDLE_MAX)
+			idle[i] = (typeof(idle[0])) { k * df, lobe(p, k) };
+		nidle++;
+	}
+
+	for (unsigned i = 0; i < MIN(nidle, IDLE_MAX); i++)
+		printf("   idle tone %9.1f Hz %8.1f dBFS\n",
+		       idle[i].f, dbfs(idle[i].p));
+	if (nidle > IDLE_MAX)
+		printf("   %u more idle tones\n", nidle - IDLE_MAX);
+}
+
+/*
+ * streaming state
+ */
+static FILE *duty, *out;
+static uint32_t nin, nout, nwritten;
+
+static void block(void)
+{
+	float x[NCHANNELS], y[NCHANNELS];
+
+	if (duty)
+		fwrite(host_block, 1, BLOCKSZ, duty);
+
+	for (unsigned i = 0; i < BFRAMES; i++) {
+		for (unsigned ch = 0; ch < NCHANNELS; ch++)
+			x[ch] = ((float)host_block[i * NCHANNELS + ch] - QF) / QF;
+		if (!recon_put(x, y) || ++nout <= RECON_DELAY ||
+		    nout > RECON_DELAY + nin)
+			continue;
+		an_put(y);
+		if (out) {
+			fwrite(y, sizeof(float), NCHANNELS, out);
+			nwritten++;
+		}
+	}
+}
+
+static void feed(void *buf, uint16_t len)
+{
+	rb_put(buf, len);
+	while (pump()) block();
+}
+
+int main(int argc, char *argv[])
+{
+	const char *dname = NULL, *oname = NULL;
+	uint8_t buf[96 * 3 * 4];
+	unsigned attn = 0, shift;
+	uint16_t plen, fsz;
+	bool dr, boosted = false;
+	FILE *in;
+	wav_t w = { 0 };
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ba:d:o:")) != -1) {
+		switch (opt) {
+		case 'b':
+			boosted = true;
+			break;
+		case 'a':
+			attn = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dname = optarg;
+			break;
+		case 'o':
+			oname = optarg;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc - 1 || attn >= VOLSTEPS) {
+	usage:
+		fprintf(stderr, "usage: %s [-b] [-a attn] [-d duty.raw] "
+			"[-o out.wav] in.wav\n", argv[0]);
+		return 1;
+	}
+
+	if (!(in = fopen(argv[optind], "rb")) || wav_open(in, &w)) {
+		fprintf(stderr, "%s: unsupported or bad wav\n", argv[optind]);
+		return 1;
+	}
+
+	dr = w.rate == SAMPLE_RATE_88200 || w.rate == SAMPLE_RATE_96000;
+	if ((w.rate != SAMPLE_RATE_44100 && w.rate != SAMPLE_RATE_48000 && !dr) ||
+	    (dr && w.fmt != SAMPLE_FORMAT_S16 && w.fmt != SAMPLE_FORMAT_S24)) {
+		fprintf(stderr, "%s: unsupported rate %u\n", argv[optind], w.rate);
+		return 1;
+	}
+
+	if ((dname && !(duty = fopen(dname, "wb"))) ||
+	    (oname && !(out = fopen(oname, "wb")))) {
+		perror(dname && !duty ? dname : oname);
+		return 1;
+	}
+
+	cstate.on[boost] = boosted;
+	cstate.attn = attn;
+	cstate.format = w.fmt;
+	cstate.rate = w.rate;
+	ctl_publish();
+	rb_setup(w.fmt, dr);
+
+	shift = dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR;
+	recon_setup(1U << shift);
+	an_setup();
+
+	fsz = framesize(w.fmt);
+	plen = w.rate / 1000 * fsz;
+	nin = w.len / fsz;
+	if (out)
+		wav_header(out, w.rate, 0);
+
+	while (w.len) {
+		uint16_t n = MIN(plen, w.len);
+		if (fread(buf, 1, n, in) != n) break;
+		w.len -= n;
+		feed(buf, n);
+	}
+
+	/* past the end: zeros, until reconstruction catches up */
+	bzero(buf, sizeof(buf));
+	while (nout < RECON_DELAY + nin)
+		feed(buf, plen);
+
+	if (out) {
+		fseek(out, 0, SEEK_SET);
+		wav_header(out, w.rate, nwritten);
+		fclose(out);
+	}
+	if (duty)
+		fclose(duty);
+
+	printf("%u frames at %u, %u averages, clip l/r/c %u/%u/%u\n",
+	       nin, w.rate, an.nseg, stats.clip[0], stats.clip[1], stats.clip[2]);
+	if (!an.nseg) {
+		fprintf(stderr, "too short for analysis, %u frames min\n", FFT_N);
+		return 1;
+	}
+	printf("%-2s %9s %8s %8s %8s %9s %8s\n", "ch", "tone Hz", "dBFS",
+	       "SINAD", "THD+N", "THD+N %", "noise");
+	an_report(0, "l", w.rate);
+	an_report(1, "r", w.rate);
+	if (boosted || nchannels(w.fmt) > 2)
+		an_report(2, "c", w.rate);
+
+	return 0;
+}
@@ -0,0 +1,322 @@
+/* -*- mode: c; tab-width: 8 -*-
+ *  SPDX-License-Identifier: MIT
+ *  Copyright (C) 2021-2022 Sergey Bolshakov <beefdeadbeef@gmail.com>
+ *
+ *  host-xrun [-n ms] [-s seed] [-v]: feeds rb_put() a sine over a
+ *  packet schedule gone wrong, and runs pump() once a block is due,
+ *  as pwm would have it. Schedule changes every so often between
+ *  jitter, packets short, long or with a stray incomplete frame at
+ *  end, starving, no packets for a while, and flooding, several
+ *  packets a ms. Frames ring has no room for are sent again, so
+ *  input stays continuous and any step filter capture tap shows is
+ *  dsp's doing. Ring fill is followed alongside, to tell which
+ *  blocks are to be concealed and which packets dropped. Exits 1 if
+ *  a captured step is past what sine and fade account for,
+ *  underrun, overrun or partial counts aren't what ring fill says,
+ *  or schedule never got ring to run dry, overflow, or drop a frame
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "cap.h"
+#include "ctl.h"
+#include "tables.h"
+#include "tools/host.h"
+
+static const struct {
+	sample_fmt fmt;
+	sample_rate rate;
+	float fs;		/* full scale, as set_scale() has it */
+} streams[] = {
+	{ SAMPLE_FORMAT_S16,	SAMPLE_RATE_48000,	1 << 15 },
+	{ SAMPLE_FORMAT_S24,	SAMPLE_RATE_96000,	1 << 23 },
+	{ SAMPLE_FORMAT_F32,	SAMPLE_RATE_48000,	1 },
+	{ SAMPLE_FORMAT_S24,	SAMPLE_RATE_44100,	1 << 23 },
+	{ SAMPLE_FORMAT_S16,	SAMPLE_RATE_88200,	1 << 15 }
+};
+
+#define NELEM(a)	(sizeof(a)/sizeof(a[0]))
+#define MAX_PACKET	(4 * 97 * 4 * 2)
+#define TONE		100.0f	/* Hz */
+#define LEVEL		0.5f	/* of full scale */
+#define PHASE_MS	64	/* schedule changes at most this often */
+
+typedef enum {
+	SCHED_JITTER,
+	SCHED_STARVE,
+	SCHED_FLOOD,
+	SCHED_NUM
+} sched_t;
+
+static bool verbose;
+
+static struct {
+	unsigned s;		/* stream */
+	uint32_t g;		/* frames sent */
+	uint32_t pacc;		/* 1/1000 frames, packet sizing */
+	uint32_t bacc;		/* same, block clock */
+	uint32_t fill;		/* ring, bytes, as it should be */
+	uint16_t framelen;
+	uint16_t chunk;		/* bytes a block takes */
+	uint32_t underrun, overrun, partial;
+} feed;
+
+static struct {
+	uint32_t blocks;
+	uint32_t frames;
+	int last;
+	bool first;
+	int step;		/* largest captured */
+} out;
+
+/*
+ * n frames of sine from frame g on, l and r same
+ */
+static uint16_t packet(uint8_t *dst, uint32_t g, unsigned n)
+{
+	sample_fmt fmt = streams[feed.s].fmt;
+	unsigned width = framesize(fmt) / nchannels(fmt);
+
+	for (unsigned i = 0; i < n; i++, g++) {
+		float y = LEVEL * sinf(2 * M_PI * TONE * g /
+				       streams[feed.s].rate);
+		int32_t v = y * streams[feed.s].fs;
+
+		for (unsigned ch = 0; ch < 2; ch++)
+			memcpy(dst + i * feed.framelen + ch * width,
+			       fmt == SAMPLE_FORMAT_F32 ?
+			       (void *)&y : (void *)&v, width);
+	}
+
+	return n * feed.framelen;
+}
+
+/*
+ * n frames, plus so many bytes of a frame to be dropped
+ */
+static void put(unsigned n, unsigned extra)
+{
+	uint8_t buf[MAX_PACKET];
+	uint32_t overrun = stats.overrun;
+	uint16_t len = packet(buf, feed.g, n);
+
+	memset(buf + len, 0x55, extra);
+	if (extra)
+		feed.partial++;
+
+	if (RBSIZE - 1 - feed.fill < len) {
+		feed.overrun++;
+	} else {
+		feed.fill += len;
+		feed.g += n;
+	}
+
+	rb_put(buf, len + extra);
+	if (verbose && stats.overrun != overrun && feed.overrun == overrun)
+		printf("  overrun at fill %u, len %u\n", feed.fill, len);
+}
+
+static void capture(void)
+{
+	cap_frame_t buf[CAP_PACKET_FRAMES];
+	uint16_t n;
+
+	while ((n = cap_packet(buf, streams[feed.s].rate))) {
+		for (unsigned i = 0; i < n; i++) {
+			int d = abs(buf[i].l - out.last);
+
+			if (!out.first && d > out.step) {
+				out.step = d;
+				if (verbose)
+					printf("  frame %u: step %d\n",
+					       out.frames, d);
+			}
+			out.first = false;
+			out.last = buf[i].l;
+			out.frames++;
+		}
+	}
+}
+
+/*
+ * blocks due by now, one pump() each; it renders one if ring
+ * has a chunk, conceals otherwise
+ */
+static void play(void)
+{
+	unsigned nframes = feed.chunk / feed.framelen;
+
+	feed.bacc += streams[feed.s].rate;
+	while (feed.bacc >= nframes * 1000) {
+		feed.bacc -= nframes * 1000;
+		if (feed.fill < feed.chunk)
+			feed.underrun++;
+		else
+			feed.fill -= feed.chunk;
+		host_due = true;
+		pump();
+		host_due = false;
+		out.blocks++;
+		capture();
+	}
+}
+
+/*
+ * one ms: packets as schedule has it, then blocks due
+ */
+static void ms(sched_t sched)
+{
+	unsigned n;
+
+	feed.pacc += streams[feed.s].rate;
+	n = feed.pacc / 1000;
+	feed.pacc %= 1000;
+
+	switch (sched) {
+	case SCHED_JITTER:
+		switch (lrand48() % 4) {
+		case 0:			/* short */
+			put(n - 1 - lrand48() % (n / 2), 0);
+			break;
+		case 1:			/* long */
+			put(n + 1, 0);
+			break;
+		case 2:			/* incomplete frame at end */
+			put(n, 1 + lrand48() % (feed.framelen - 1));
+			break;
+		default:
+			put(n, 0);
+			break;
+		}
+		break;
+
+	case SCHED_STARVE:
+		break;
+
+	case SCHED_FLOOD:
+		for (unsigned i = 0; i < 3; i++)
+			put(n, 0);
+		break;
+
+	default:
+		break;
+	}
+
+	play();
+}
+
+/*
+ * step sine makes between captured frames, plus that of fade
+ * to or from silence over a block, with a quarter to spare
+ */
+static int step_limit(void)
+{
+	unsigned decim = CAP_DECIM << (streams[feed.s].rate > SAMPLE_RATE_48000);
+	unsigned nframes = feed.chunk / feed.framelen;
+	float fs = LEVEL * 32768;
+
+	return fs * (2 * M_PI * TONE * decim / streams[feed.s].rate +
+		     (float)decim / nframes) * 1.25f + 1;
+}
+
+static int run(unsigned s, uint32_t nms)
+{
+	sample_fmt fmt = streams[s].fmt;
+	bool dr = streams[s].rate > SAMPLE_RATE_48000;
+	uint32_t u0 = stats.underrun, o0 = stats.overrun, p0 = stats.partial;
+	uint32_t underrun, overrun, partial;
+	sched_t sched = SCHED_JITTER;
+	int limit, fail;
+
+	memset(&feed, 0, sizeof(feed));
+	memset(&out, 0, sizeof(out));
+	out.first = true;
+	feed.s = s;
+	feed.framelen = framesize(fmt);
+	feed.chunk = feed.framelen *
+		(BFRAMES >> (dr ? UPSAMPLE_SHIFT_DR : UPSAMPLE_SHIFT_SR));
+	limit = step_limit();
+
+	cstate.format = fmt;
+	cstate.rate = streams[s].rate;
+	ctl_reset(fmt, dr);
+	pump();			/* reset carried out */
+	cap_set_tap(CAP_TAP_FILTER);
+	cap_start(true);
+
+	/* prefill, half ring */
+	while (feed.fill < RBSIZE / 2)
+		put(streams[s].rate / 1000, 0);
+
+	for (uint32_t t = 0; t < nms; t++) {
+		if (t % PHASE_MS == 0)
+			sched = lrand48() % 2 ? SCHED_JITTER :
+				lrand48() % SCHED_NUM;
+		ms(sched);
+	}
+
+	cap_start(false);
+
+	underrun = stats.underrun - u0;
+	overrun = stats.overrun - o0;
+	partial = stats.partial - p0;
+
+	fail = out.step > limit ||
+		underrun != feed.underrun || overrun != feed.overrun ||
+		partial != feed.partial ||
+		!underrun || !overrun || !partial;
+
+	printf("%-3s %6u %7u %8u %6u/%-6u %6u/%-6u %6u/%-6u %5d/%-5d %s\n",
+	       (const char *[]) {
+		       [SAMPLE_FORMAT_S16] = "s16",
+		       [SAMPLE_FORMAT_S24] = "s24",
+		       [SAMPLE_FORMAT_F32] = "f32" } [fmt],
+	       streams[s].rate, out.blocks, out.frames,
+	       underrun, feed.underrun, overrun, feed.overrun,
+	       partial, feed.partial, out.step, limit,
+	       fail ? "FAIL" : "ok");
+
+	return fail;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t nms = 20000;
+	long seed = 1;
+	int opt, fail = 0;
+
+	while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			nms = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtol(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n ms] [-s seed] [-v]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	srand48(seed);
+	ctl_publish();
+
+	printf("%-3s %6s %7s %8s %13s %13s %13s %11s\n",
+	       "fmt", "rate", "blocks", "captured", "underrun",
+	       "overrun", "partial", "step");
+
+	for (unsigned s = 0; s < NELEM(streams); s++)
+		fail |= run(s, nms);
+
+	return fail;
+}
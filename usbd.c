@@ -8,7 +8,16 @@
 #include <libopencm3/usb/usbd.h>
 
 #include "common.h"
+#include "cap.h"
+#include "conv.h"
+#include "ctl.h"
+#include "evq.h"
+#include "fb.h"
+#include "irq.h"
+#include "lat.h"
+#include "prof.h"
 #include "tables.h"
+#include "telemetry.h"
 
 #define __usb_isr usb_lp_isr
 #define __usb_driver st_usbfs_v1_usb_driver
@@ -18,13 +27,45 @@
 #define MIN_PACKET_SIZE 8
 
 #define ISO_PACKET_SIZE 576
+#define ISO_PACKET_SIZE_FS 1023
 #define ISO_SYNC_PACKET_SIZE 3
 #define ISO_OUT_ENDP_ADDR 0x01
 #define ISO_IN_ENDP_ADDR 0x84
 
+/*
+ * largest packet at given rate and frame size, feedback at its
+ * clamp: 2.1 alt settings are 44.1/48k only to stay within
+ */
+#define MAX_PACKET(rate, fsz) \
+	((((rate) + ((rate) >> FB_RANGE_SHIFT)) / 1000 + 1) * (fsz))
+
+#if ISO_PACKET_SIZE > ISO_PACKET_SIZE_FS
+#error ISO_PACKET_SIZE exceeds full speed limit
+#endif
+
+#if MAX_PACKET(48000, 3 * 2) > ISO_PACKET_SIZE || \
+	MAX_PACKET(48000, 3 * 3) > ISO_PACKET_SIZE
+#error 2.1 packets exceed ISO_PACKET_SIZE
+#endif
+
 #define INTR_PACKET_SIZE 2
 #define INTR_IN_ENDP_ADDR 0x86
 
+#define CAP_PACKET_SIZE (CAP_PACKET_FRAMES * 4)	/* s16 stereo */
+#define CAP_IN_ENDP_ADDR 0x85
+
+/*
+ * usb packet memory, 768 bytes as remapped in main.c: btable,
+ * ep0 both ways, then buffers usbd_set_config() sets up; loopback
+ * capture gets what's left after playback
+ */
+#define PMA_SIZE 768
+#define PMA_BTABLE 64
+#if (PMA_BTABLE + 2 * PKTSIZE0 + ISO_PACKET_SIZE + 2 * MIN_PACKET_SIZE + \
+     CAP_PACKET_SIZE) > PMA_SIZE
+#error endpoint buffers exceed packet memory
+#endif
+
 typedef enum  {
 	UAC_SET_CUR = 1,
 	UAC_SET_MIN,
@@ -69,6 +110,14 @@ struct usb_audio_format_type1_descriptor_2freq {
         struct usb_audio_format_discrete_sampling_frequency freqs[2];
 } __attribute__((packed));
 
+struct usb_audio_feature_unit_descriptor_3ch {
+	struct usb_audio_feature_unit_descriptor_head head;
+	struct {
+		uint16_t bmaControl;
+	} __attribute__((packed)) channel_control[3];
+	struct usb_audio_feature_unit_descriptor_tail tail;
+} __attribute__((packed));
+
 struct usb_audio_format_type1_descriptor_4freq {
         struct usb_audio_format_type1_descriptor_head head;
         struct usb_audio_format_discrete_sampling_frequency freqs[4];
@@ -80,11 +129,17 @@ static const struct {
 	struct usb_interface_descriptor audio_control_iface;
 	struct usb_audio_header_descriptor_head header_head;
 	struct usb_audio_header_descriptor_body header_body;
+	struct usb_audio_header_descriptor_body header_body_capture;
 	struct usb_audio_input_terminal_descriptor input_terminal_desc;
 	struct usb_audio_feature_unit_descriptor_2ch feature_unit_desc;
 	struct usb_audio_feature_unit_descriptor_2ch feature_unit_desc_speaker;
 	struct usb_audio_output_terminal_descriptor headset_desc;
 	struct usb_audio_output_terminal_descriptor speaker_desc;
+	struct usb_audio_input_terminal_descriptor capture_it_desc;
+	struct usb_audio_output_terminal_descriptor capture_ot_desc;
+	struct usb_audio_input_terminal_descriptor input_terminal_desc_21;
+	struct usb_audio_feature_unit_descriptor_3ch feature_unit_desc_21;
+	struct usb_audio_output_terminal_descriptor speaker_desc_21;
 	struct usb_audio_stream_endpoint_descriptor intr_ep;
 
 	struct usb_interface_descriptor audio_streaming_iface_0;
@@ -117,12 +172,34 @@ static const struct {
 	struct usb_audio_stream_endpoint_descriptor isochronous_ep_4;
 	struct usb_audio_stream_endpoint_descriptor synch_ep_4;
 
+	struct usb_interface_descriptor audio_streaming_iface_5;
+	struct usb_audio_stream_audio_endpoint_descriptor audio_streaming_cs_ep_desc_5;
+	struct usb_audio_stream_interface_descriptor audio_cs_streaming_iface_desc_5;
+	struct usb_audio_format_type1_descriptor_2freq audio_type1_format_desc_5;
+	struct usb_audio_stream_endpoint_descriptor isochronous_ep_5;
+	struct usb_audio_stream_endpoint_descriptor synch_ep_5;
+
+	struct usb_interface_descriptor audio_streaming_iface_6;
+	struct usb_audio_stream_audio_endpoint_descriptor audio_streaming_cs_ep_desc_6;
+	struct usb_audio_stream_interface_descriptor audio_cs_streaming_iface_desc_6;
+	struct usb_audio_format_type1_descriptor_2freq audio_type1_format_desc_6;
+	struct usb_audio_stream_endpoint_descriptor isochronous_ep_6;
+	struct usb_audio_stream_endpoint_descriptor synch_ep_6;
+
+	struct usb_interface_descriptor capture_iface_0;
+
+	struct usb_interface_descriptor capture_iface_1;
+	struct usb_audio_stream_interface_descriptor capture_cs_iface_desc;
+	struct usb_audio_format_type1_descriptor_2freq capture_type1_format_desc;
+	struct usb_audio_stream_endpoint_descriptor capture_ep;
+	struct usb_audio_stream_audio_endpoint_descriptor capture_cs_ep_desc;
+
 } __attribute__((packed)) config = {
 	.cdesc = {
 		.bLength = USB_DT_CONFIGURATION_SIZE,
 		.bDescriptorType = USB_DT_CONFIGURATION,
 		.wTotalLength = sizeof(config),
-		.bNumInterfaces = 2,
+		.bNumInterfaces = 3,
 		.bConfigurationValue = 1,
 		.iConfiguration = 0,
 		.bmAttributes = 0x80,
@@ -141,23 +218,31 @@ static const struct {
 	},
 	.header_head = {
 		.bLength = sizeof(struct usb_audio_header_descriptor_head) +
-		sizeof(struct usb_audio_header_descriptor_body),
+		2 * sizeof(struct usb_audio_header_descriptor_body),
 		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
 		.bDescriptorSubtype = USB_AUDIO_TYPE_HEADER,
 		.bcdADC = 0x0100,
 		.wTotalLength = sizeof(struct usb_audio_header_descriptor_head) +
-		sizeof(struct usb_audio_header_descriptor_body) +
+		2 * sizeof(struct usb_audio_header_descriptor_body) +
 		sizeof(struct usb_audio_input_terminal_descriptor) +
 		sizeof(struct usb_audio_feature_unit_descriptor_2ch) +
 		sizeof(struct usb_audio_feature_unit_descriptor_2ch) +
 		sizeof(struct usb_audio_output_terminal_descriptor) +
 		sizeof(struct usb_audio_output_terminal_descriptor) +
+		sizeof(struct usb_audio_input_terminal_descriptor) +
+		sizeof(struct usb_audio_output_terminal_descriptor) +
+		sizeof(struct usb_audio_input_terminal_descriptor) +
+		sizeof(struct usb_audio_feature_unit_descriptor_3ch) +
+		sizeof(struct usb_audio_output_terminal_descriptor) +
 		sizeof(struct usb_audio_stream_endpoint_descriptor),
-		.binCollection = 1,
+		.binCollection = 2,
 	},
 	.header_body = {
 		.baInterfaceNr = 0x01,
 	},
+	.header_body_capture = {
+		.baInterfaceNr = 0x02,
+	},
 	.input_terminal_desc = {
 		.bLength = sizeof(struct usb_audio_input_terminal_descriptor),
 		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
@@ -228,6 +313,77 @@ static const struct {
 		.bSourceID = UAC_FU_SPEAKER_ID,
 		.iTerminal = 0,
 	},
+
+	.capture_it_desc = {
+		.bLength = sizeof(struct usb_audio_input_terminal_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = USB_AUDIO_TYPE_INPUT_TERMINAL,
+		.bTerminalID = UAC_IT_CAPTURE_ID,
+		.wTerminalType = 0x200,		/* input, undefined */
+		.bAssocTerminal = 0,
+		.bNrChannels = 2,
+		.wChannelConfig = 3,
+		.iChannelNames = 0,
+		.iTerminal = 0,
+	},
+	.capture_ot_desc = {
+		.bLength = sizeof(struct usb_audio_output_terminal_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = USB_AUDIO_TYPE_OUTPUT_TERMINAL,
+		.bTerminalID = UAC_OT_CAPTURE_ID,
+		.wTerminalType = 0x101,		/* usb streaming */
+		.bAssocTerminal = 0,
+		.bSourceID = UAC_IT_CAPTURE_ID,
+		.iTerminal = 0,
+	},
+	/* 2.1: l, r, lfe; same mute and volume as stereo path */
+	.input_terminal_desc_21 = {
+		.bLength = sizeof(struct usb_audio_input_terminal_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = USB_AUDIO_TYPE_INPUT_TERMINAL,
+		.bTerminalID = UAC_IT_PCM21_ID,
+		.wTerminalType = 0x101,
+		.bAssocTerminal = 0,
+		.bNrChannels = 3,
+		.wChannelConfig = 0x000b,
+		.iChannelNames = 0,
+		.iTerminal = 0,
+	},
+	.feature_unit_desc_21 = {
+		.head = {
+			.bLength = sizeof(struct usb_audio_feature_unit_descriptor_3ch),
+			.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+			.bDescriptorSubtype = USB_AUDIO_TYPE_FEATURE_UNIT,
+			.bUnitID = UAC_FU_MAIN21_ID,
+			.bSourceID = UAC_IT_PCM21_ID,
+			.bControlSize = 2,
+			.bmaControlMaster = 1,
+		},
+		.channel_control = {
+			{
+				.bmaControl = 2,
+			},
+			{
+				.bmaControl = 2,
+			},
+			{
+				.bmaControl = 2,
+			}
+		},
+		.tail = {
+			.iFeature = 0,
+		}
+	},
+	.speaker_desc_21 = {
+		.bLength = sizeof(struct usb_audio_output_terminal_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = USB_AUDIO_TYPE_OUTPUT_TERMINAL,
+		.bTerminalID = UAC_OT_SPEAKER21_ID,
+		.wTerminalType = 0x304,		/* desktop speaker */
+		.bAssocTerminal = 0,
+		.bSourceID = UAC_FU_MAIN21_ID,
+		.iTerminal = 0,
+	},
 	.intr_ep = {
 		.bLength = USB_DT_ENDPOINT_SIZE + 2,
 		.bDescriptorType = USB_DT_ENDPOINT,
@@ -273,7 +429,7 @@ static const struct {
 		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
 		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
 		.bDescriptorSubtype = 1,
-		.bTerminalLink = 1,
+		.bTerminalLink = UAC_IT_PCM_ID,
 		.bDelay = 1,
 		.wFormatTag = 1,
 	},
@@ -347,7 +503,7 @@ static const struct {
 		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
 		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
 		.bDescriptorSubtype = 1,
-		.bTerminalLink = 1,
+		.bTerminalLink = UAC_IT_PCM_ID,
 		.bDelay = 1,
 		.wFormatTag = 1,
 	},
@@ -421,7 +577,7 @@ static const struct {
 		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
 		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
 		.bDescriptorSubtype = 1,
-		.bTerminalLink = 1,
+		.bTerminalLink = UAC_IT_PCM_ID,
 		.bDelay = 1,
 		.wFormatTag = 1,
 	},
@@ -489,7 +645,7 @@ static const struct {
 		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
 		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
 		.bDescriptorSubtype = 1,
-		.bTerminalLink = 1,
+		.bTerminalLink = UAC_IT_PCM_ID,
 		.bDelay = 1,
 		.wFormatTag = 3,
 	},
@@ -532,6 +688,211 @@ static const struct {
 		.bInterval = 1,
 		.bRefresh = SOF_SHIFT,
 		.bSynchAddress = 0,
+	},
+
+	.audio_streaming_iface_5 = {
+		.bLength = USB_DT_INTERFACE_SIZE,
+		.bDescriptorType = USB_DT_INTERFACE,
+		.bInterfaceNumber = 1,
+		.bAlternateSetting = 5,
+		.bNumEndpoints = 2,
+		.bInterfaceClass = USB_CLASS_AUDIO,
+		.bInterfaceSubClass = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	},
+	.audio_streaming_cs_ep_desc_5 = {
+		.bLength = sizeof(struct usb_audio_stream_audio_endpoint_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_ENDPOINT,
+		.bDescriptorSubtype = 1,
+		.bmAttributes = 1,
+		.bLockDelayUnits = 0x02,
+		.wLockDelay = 0x0000,
+	},
+	.audio_cs_streaming_iface_desc_5 = {
+		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = 1,
+		.bTerminalLink = UAC_IT_PCM21_ID,
+		.bDelay = 1,
+		.wFormatTag = 1,
+	},
+	.audio_type1_format_desc_5 = {
+		.head = {
+			.bLength = sizeof(struct usb_audio_format_type1_descriptor_2freq),
+			.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+			.bDescriptorSubtype = 2,
+			.bFormatType = 1,
+			.bNrChannels = 3,
+			.bSubFrameSize = 2,
+			.bBitResolution = 16,
+			.bSamFreqType = 2,
+		},
+		.freqs = {
+			{
+				.tSamFreq = 44100,
+			},
+			{
+				.tSamFreq = 48000,
+			}
+		},
+	},
+	.isochronous_ep_5 = {
+		.bLength = USB_DT_ENDPOINT_SIZE + 2,
+		.bDescriptorType = USB_DT_ENDPOINT,
+		.bEndpointAddress = ISO_OUT_ENDP_ADDR,
+		.bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+		.wMaxPacketSize = ISO_PACKET_SIZE,
+		.bInterval = 1,
+		.bRefresh = 0,
+		.bSynchAddress = ISO_IN_ENDP_ADDR,
+	},
+	.synch_ep_5 = {
+		.bLength = USB_DT_ENDPOINT_SIZE + 2,
+		.bDescriptorType = USB_DT_ENDPOINT,
+		.bEndpointAddress = ISO_IN_ENDP_ADDR,
+		.bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_FEEDBACK,
+		.wMaxPacketSize = ISO_SYNC_PACKET_SIZE,
+		.bInterval = 1,
+		.bRefresh = SOF_SHIFT,
+		.bSynchAddress = 0,
+	},
+
+	.audio_streaming_iface_6 = {
+		.bLength = USB_DT_INTERFACE_SIZE,
+		.bDescriptorType = USB_DT_INTERFACE,
+		.bInterfaceNumber = 1,
+		.bAlternateSetting = 6,
+		.bNumEndpoints = 2,
+		.bInterfaceClass = USB_CLASS_AUDIO,
+		.bInterfaceSubClass = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	},
+	.audio_streaming_cs_ep_desc_6 = {
+		.bLength = sizeof(struct usb_audio_stream_audio_endpoint_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_ENDPOINT,
+		.bDescriptorSubtype = 1,
+		.bmAttributes = 1,
+		.bLockDelayUnits = 0x02,
+		.wLockDelay = 0x0000,
+	},
+	.audio_cs_streaming_iface_desc_6 = {
+		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = 1,
+		.bTerminalLink = UAC_IT_PCM21_ID,
+		.bDelay = 1,
+		.wFormatTag = 1,
+	},
+	.audio_type1_format_desc_6 = {
+		.head = {
+			.bLength = sizeof(struct usb_audio_format_type1_descriptor_2freq),
+			.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+			.bDescriptorSubtype = 2,
+			.bFormatType = 1,
+			.bNrChannels = 3,
+			.bSubFrameSize = 3,
+			.bBitResolution = 24,
+			.bSamFreqType = 2,
+		},
+		.freqs = {
+			{
+				.tSamFreq = 44100,
+			},
+			{
+				.tSamFreq = 48000,
+			}
+		},
+	},
+	.isochronous_ep_6 = {
+		.bLength = USB_DT_ENDPOINT_SIZE + 2,
+		.bDescriptorType = USB_DT_ENDPOINT,
+		.bEndpointAddress = ISO_OUT_ENDP_ADDR,
+		.bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+		.wMaxPacketSize = ISO_PACKET_SIZE,
+		.bInterval = 1,
+		.bRefresh = 0,
+		.bSynchAddress = ISO_IN_ENDP_ADDR,
+	},
+	.synch_ep_6 = {
+		.bLength = USB_DT_ENDPOINT_SIZE + 2,
+		.bDescriptorType = USB_DT_ENDPOINT,
+		.bEndpointAddress = ISO_IN_ENDP_ADDR,
+		.bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_FEEDBACK,
+		.wMaxPacketSize = ISO_SYNC_PACKET_SIZE,
+		.bInterval = 1,
+		.bRefresh = SOF_SHIFT,
+		.bSynchAddress = 0,
+	},
+
+	.capture_iface_0 = {
+		.bLength = USB_DT_INTERFACE_SIZE,
+		.bDescriptorType = USB_DT_INTERFACE,
+		.bInterfaceNumber = 2,
+		.bAlternateSetting = 0,
+		.bNumEndpoints = 0,
+		.bInterfaceClass = USB_CLASS_AUDIO,
+		.bInterfaceSubClass = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	},
+	.capture_iface_1 = {
+		.bLength = USB_DT_INTERFACE_SIZE,
+		.bDescriptorType = USB_DT_INTERFACE,
+		.bInterfaceNumber = 2,
+		.bAlternateSetting = 1,
+		.bNumEndpoints = 1,
+		.bInterfaceClass = USB_CLASS_AUDIO,
+		.bInterfaceSubClass = USB_AUDIO_SUBCLASS_AUDIOSTREAMING,
+		.bInterfaceProtocol = 0,
+		.iInterface = 0,
+	},
+	.capture_cs_iface_desc = {
+		.bLength = sizeof(struct usb_audio_stream_interface_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+		.bDescriptorSubtype = 1,
+		.bTerminalLink = UAC_OT_CAPTURE_ID,
+		.bDelay = 1,
+		.wFormatTag = 1,
+	},
+	.capture_type1_format_desc = {	/* playback rate over CAP_DECIM */
+		.head = {
+			.bLength = sizeof(struct usb_audio_format_type1_descriptor_2freq),
+			.bDescriptorType = USB_AUDIO_DT_CS_INTERFACE,
+			.bDescriptorSubtype = 2,
+			.bFormatType = 1,
+			.bNrChannels = 2,
+			.bSubFrameSize = 2,
+			.bBitResolution = 16,
+			.bSamFreqType = 2,
+		},
+		.freqs = {
+			{
+				.tSamFreq = SAMPLE_RATE_44100 / CAP_DECIM,
+			},
+			{
+				.tSamFreq = SAMPLE_RATE_48000 / CAP_DECIM,
+			}
+		},
+	},
+	.capture_ep = {
+		.bLength = USB_DT_ENDPOINT_SIZE + 2,
+		.bDescriptorType = USB_DT_ENDPOINT,
+		.bEndpointAddress = CAP_IN_ENDP_ADDR,
+		.bmAttributes = USB_ENDPOINT_ATTR_ISOCHRONOUS | USB_ENDPOINT_ATTR_ASYNC,
+		.wMaxPacketSize = CAP_PACKET_SIZE,
+		.bInterval = 1,
+		.bRefresh = 0,
+		.bSynchAddress = 0,
+	},
+	.capture_cs_ep_desc = {
+		.bLength = sizeof(struct usb_audio_stream_audio_endpoint_descriptor),
+		.bDescriptorType = USB_AUDIO_DT_CS_ENDPOINT,
+		.bDescriptorSubtype = 1, /* EP_GENERAL */
+		.bmAttributes = 1,
+		.bLockDelayUnits = 0x02, /* PCM samples */
+		.wLockDelay = 0x0000,
 	}
 };
 
@@ -542,29 +903,41 @@ static const struct usb_config_descriptor *configs[] = {
 uint8_t usbd_control_buffer[64];
 
 extern void pll_setup(sample_rate freq);
-extern void rb_setup(sample_fmt format, bool dr);
 extern uint16_t rb_put(void *src, uint16_t len);
-extern void set_scale();
+extern uint32_t pwm_position(void);
 extern void speaker();
+extern void prof_telemetry(telemetry_t *t);
 extern volatile ev_t e;
+extern volatile evq_t evq;
 extern volatile cs_t cstate;
+extern volatile stats_t stats;
 
 static usbd_device * usbdev;
-static uint32_t delta;
 static uint32_t total;
+static uint32_t feedback;
 static uint16_t framelen;
+static bool filled;
+
+static fb_pi_t pi;
+static fb_meter_t meter;
 
 static struct {
 	bool rts;
 	bool cts;
-} fb, ac = { false, true };
+} fb, ac = { false, true }, cp;
 
-static uint8_t acstatus[2];
+static struct {
+	uint16_t min;
+	uint16_t max;
+} rbfill = { RBSIZE, 0 };
 
-static inline bool doubleratep(sample_rate rate)
-{
-	return rate == SAMPLE_RATE_88200 || rate == SAMPLE_RATE_96000;
-}
+static union {
+	telemetry_t tm;
+	latency_t lm;
+	conv_status_t cm;
+} vendor;
+
+static uint8_t acstatus[2];
 
 void uac_notify(uac_id_t id)
 {
@@ -589,26 +962,74 @@ static void iso_tx_cb(usbd_device *usbd_dev, uint8_t ep)
 	fb.cts = true;
 }
 
+static void cap_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	(void)usbd_dev;
+	(void)ep;
+
+	cp.cts = true;
+}
+
 static void iso_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 {
 	uint8_t buf[ISO_PACKET_SIZE];
 	uint16_t len, rb;
 
 	total += len = usbd_ep_read_packet(usbd_dev, ep, buf, ISO_PACKET_SIZE);
-	len -= (len % framelen);	/* drop incomplete frame, if any */
-
-	delta += rb = rb_put(buf, len);		/* space left */
+	rb = RBSIZE - 1 - rb_put(buf, len);	/* ring fill */
 	trace(1, len << 16 | rb);
 
-	if (e.state == STATE_FILL && (rb < RBSIZE / 2)) {
-		e.seen = false;
+	rbfill.min = MIN(rbfill.min, rb);
+	rbfill.max = MAX(rbfill.max, rb);
+
+	pi.fillsum += rb;
+	pi.npkts++;
+
+	if (e.state == STATE_FILL && !filled &&
+	    rb >= (fb_fill[cstate.format].prefill << doubleratep(cstate.rate)) * framelen) {
+		filled = true;
+		ev_put(&evq, EV_FILL, cstate.format, pwm_position());
 	}
+
+	if (e.state != STATE_CLOSED)	/* new data may unblock pump() */
+		dsp_pend();
+}
+
+/*
+ * feedback for next (1 << SOF_SHIFT) ms, see fb.h
+ */
+static uint32_t fb_next(void)
+{
+	uint32_t rate = fb_measure(&meter, pwm_position(), cstate.rate,
+				   e.state == STATE_RUNNING);
+
+	return fb_update(&pi, rate, cstate.format, cstate.rate, framelen,
+			 e.state == STATE_FILL);
+}
+
+/*
+ * loopback capture, a packet a SOF, short or even empty ones
+ * included, so host sees device rate
+ */
+static void capture(void)
+{
+	cap_frame_t buf[CAP_PACKET_FRAMES];
+	uint16_t n;
+
+	if (!(cp.rts && cp.cts)) return;
+
+	n = cap_packet(buf, cstate.rate);
+	usbd_ep_write_packet(usbdev, CAP_IN_ENDP_ADDR, (const void *)buf,
+			     n * sizeof(cap_frame_t));
+	cp.cts = false;
 }
 
 static void sof_cb(void)
 {
 	static uint32_t sofn = (1 << SOF_SHIFT);
-	static uint32_t feedback;
+
+	lat_sof();
+	capture();
 
 	if (!(ac.rts && ac.cts)) goto feedback;
 
@@ -625,11 +1046,9 @@ feedback:
 	if (cstate.format == SAMPLE_FORMAT_NONE) return;
 
 	if (!--sofn) {
-		feedback = ((e.state == STATE_FILL) ? FEEDBACK :
-			    FEEDBACK_MIN + DELTA_SHIFT(delta)) << doubleratep(cstate.rate);
+		feedback = fb_next();
 		trace(2, feedback);
 		sofn = (1 << SOF_SHIFT);
-		delta = 0;
 		fb.rts = true;
 	}
 
@@ -653,16 +1072,25 @@ static void altset_cb(usbd_device *usbd_dev,
 	case 1:				/* wValue: alt setting # */
 		cstate.format = wValue;
 		framelen = framesize(wValue);
+		filled = false;
 		if (wValue) {
-			rb_setup(wValue, doubleratep(cstate.rate));
+			stats.opens++;
+			debugf("prefill: %d target: %d frames\n",
+			       fb_fill[wValue].prefill, fb_fill[wValue].target);
+			ctl_reset(wValue, doubleratep(cstate.rate));
 			e.state = STATE_FILL;
 			fb.rts = fb.cts = true;
 		} else {
-			rb_setup(wValue, false);
+			ctl_reset(wValue, false);
 			e.state = total ? STATE_DRAIN : STATE_CLOSED;
 			fb.rts = fb.cts = false;
 			total = 0;
 		}
+		dsp_pend();
+		break;
+	case 2:
+		cap_start(wValue);
+		cp.rts = cp.cts = wValue;
 	}
 }
 
@@ -683,10 +1111,11 @@ static enum usbd_request_return_codes control_cs_cb(
 	/* wValue: ControlSelector | ChannelNumber */
 	switch ((req->wIndex & 0xff00) | (req->wValue >> 8)) {
 	case (UAC_FU_MAIN_ID <<8 | UAC_FU_MUTE):
+	case (UAC_FU_MAIN21_ID << 8 | UAC_FU_MUTE):
 		switch(req->bRequest) {
 		case UAC_SET_CUR:
 			cstate.on[muted] = **buf;
-			set_scale();
+			ctl_publish();
 			return USBD_REQ_HANDLED;
 		case UAC_GET_CUR:
 			**buf = cstate.on[muted];
@@ -695,13 +1124,14 @@ static enum usbd_request_return_codes control_cs_cb(
 			return USBD_REQ_NOTSUPP;
 		}
 	case (UAC_FU_MAIN_ID << 8 | UAC_FU_VOLUME):
+	case (UAC_FU_MAIN21_ID << 8 | UAC_FU_VOLUME):
 		switch (req->bRequest) {
 		case UAC_SET_CUR:
 		{
 			uint16_t i = 0;
 			while (i < VOLSTEPS && db[i] > *(int16_t *)*buf) i++;
 			cstate.attn = i;
-			set_scale();
+			ctl_publish();
 			break;
 		}
 		case UAC_GET_CUR:
@@ -738,6 +1168,7 @@ static enum usbd_request_return_codes control_cs_cb(
 		switch (req->bRequest) {
 		case UAC_SET_CUR:
 			cstate.on[boost] = **buf;
+			ctl_publish();
 			speaker();
 			return USBD_REQ_HANDLED;
 		case UAC_GET_CUR:
@@ -775,7 +1206,8 @@ static enum usbd_request_return_codes control_cs_ep_cb(
 		switch (req->bRequest) {
 		case UAC_SET_CUR:
 			debugf("set_cur: freq: %d new: %d\n", cstate.rate , r->freq);
-			rb_setup(cstate.format, doubleratep(r->freq));
+			ctl_reset(cstate.format, doubleratep(r->freq));
+			dsp_pend();
 			if (cstate.rate == r->freq) break;
 			pll_setup(r->freq);
 			cstate.rate = r->freq;
@@ -790,9 +1222,118 @@ static enum usbd_request_return_codes control_cs_ep_cb(
 		return USBD_REQ_HANDLED;
 	}
 
+	/* capture follows playback rate, set_cur is taken, not acted on */
+	if (req->wValue == 0x100 && req->wIndex == CAP_IN_ENDP_ADDR) {
+		struct __attribute__((packed)) {
+			uint32_t freq : 24;
+		} *r = (typeof(r))*buf;
+
+		if (req->bRequest == UAC_GET_CUR)
+			r->freq = cstate.rate /
+				(CAP_DECIM << doubleratep(cstate.rate));
+
+		return USBD_REQ_HANDLED;
+	}
+
 	return USBD_REQ_NOTSUPP;
 }
 
+/*
+ * telemetry block is put together right here, at usb isr priority,
+ * so neither pwm isr nor dsp update stats midway; it stays put till
+ * data stage completes, as control transfers don't overlap
+ */
+static void telemetry(telemetry_t *t)
+{
+	t->version = TELEMETRY_VERSION;
+	t->format = cstate.format;
+	t->state = e.state;
+	t->load = 100 * cstate.load;
+	t->rate = cstate.rate;
+	t->feedback = feedback;
+	t->rbmin = rbfill.min;
+	t->rbmax = rbfill.max;
+	t->rbtarget = (fb_fill[cstate.format].target <<
+		       doubleratep(cstate.rate)) * framelen;
+	prof_telemetry(t);
+
+	rbfill.min = RBSIZE;
+	rbfill.max = 0;
+}
+
+/*
+ * latest latency measurement, in usecs at nominal rate
+ */
+static void latency(latency_t *l)
+{
+	l->armed = lat.armed;
+	l->format = cstate.format;
+	l->sof = lat.sof;
+	l->rate = cstate.rate;
+	l->seq = lat.seq;
+	l->page = lat.peak / NFRAMES % NPAGES;
+	l->offset = lat.peak % NFRAMES;
+	l->ring = lat_us(lat.render - lat.rx, cstate.rate);
+	l->total = lat_us(lat.peak - lat.rx, cstate.rate);
+}
+
+static void correction(conv_status_t *c)
+{
+	c->ntaps = conv.overloaded ? 0 : conv.ntaps;
+	c->budget = conv_budget(cstate.rate);
+	c->maxtaps = CONV_MAXTAPS;
+	c->pending = conv.pending;
+	c->chunk = CONV_CHUNK;
+	c->overload = conv.overload;
+	c->cost = prof[PROF_CONV].avg;
+	c->rate = cstate.rate;
+}
+
+static enum usbd_request_return_codes control_vendor_cb(
+	usbd_device *usbd_dev,
+	struct usb_setup_data *req,
+	uint8_t **buf,
+	uint16_t *len,
+	usbd_control_complete_callback *complete)
+{
+	(void) usbd_dev;
+	(void) complete;
+
+	switch (req->bRequest | (req->bmRequestType & USB_REQ_TYPE_IN)) {
+	case TELEMETRY_GET | USB_REQ_TYPE_IN:
+		telemetry(&vendor.tm);
+		*buf = (uint8_t *)&vendor.tm;
+		*len = MIN(*len, sizeof(vendor.tm));
+		return USBD_REQ_HANDLED;
+	case LATENCY_ARM:
+		lat_arm(req->wValue);
+		return USBD_REQ_HANDLED;
+	case LATENCY_GET | USB_REQ_TYPE_IN:
+		latency(&vendor.lm);
+		*buf = (uint8_t *)&vendor.lm;
+		*len = MIN(*len, sizeof(vendor.lm));
+		return USBD_REQ_HANDLED;
+	case CAPTURE_TAP:
+		cap_set_tap(req->wValue);
+		return USBD_REQ_HANDLED;
+	case CONV_UPLOAD:
+		if (*len % sizeof(float) ||
+		    !conv_load(req->wIndex, req->wValue, *buf, *len / sizeof(float)))
+			return USBD_REQ_NOTSUPP;
+		return USBD_REQ_HANDLED;
+	case CONV_COMMIT:
+		return conv_commit(req->wValue, cstate.rate) ?
+			USBD_REQ_HANDLED : USBD_REQ_NOTSUPP;
+	case CONV_STATUS | USB_REQ_TYPE_IN:
+		correction(&vendor.cm);
+		*buf = (uint8_t *)&vendor.cm;
+		*len = MIN(*len, sizeof(vendor.cm));
+		return USBD_REQ_HANDLED;
+	default:
+		return USBD_REQ_NOTSUPP;
+	}
+}
+
 static void usbd_set_config(usbd_device *usbd_dev, uint16_t wValue)
 {
 	(void)wValue;
@@ -818,6 +1359,13 @@ static void usbd_set_config(usbd_device *usbd_dev, uint16_t wValue)
 		MIN_PACKET_SIZE,
 		intr_tx_cb);
 
+	usbd_ep_setup(
+		usbd_dev,
+		CAP_IN_ENDP_ADDR,
+		USB_ENDPOINT_ATTR_ISOCHRONOUS,
+		CAP_PACKET_SIZE,
+		cap_tx_cb);
+
 	usbd_register_sof_callback(usbd_dev, sof_cb);
 
 	usbd_register_set_altsetting_callback(usbd_dev, altset_cb);
@@ -834,6 +1382,12 @@ static void usbd_set_config(usbd_device *usbd_dev, uint16_t wValue)
 		USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
 		control_cs_ep_cb);
 
+	usbd_register_control_callback(
+		usbd_dev,
+		USB_REQ_TYPE_VENDOR | USB_REQ_TYPE_DEVICE,
+		USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+		control_vendor_cb);
+
 	cstate.on[usb] = true;
 }
 
@@ -844,10 +1398,14 @@ void usbd(void)
 			   usbd_control_buffer, sizeof(usbd_control_buffer));
 
 	usbd_register_set_config_callback(usbdev, usbd_set_config);
+	nvic_set_priority(__usb_irq, IRQ_PRIO_USB);
 	nvic_enable_irq(__usb_irq);
 }
 
 void __usb_isr(void)
 {
+	uint32_t t0 = irq_enter(IRQ_USB, 0);
+
 	usbd_poll(usbdev);
+	irq_exit(IRQ_USB, t0);
 }